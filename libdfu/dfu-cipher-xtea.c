@@ -22,12 +22,22 @@
 #include "config.h"
 
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "dfu-cipher-xtea.h"
 #include "dfu-error.h"
 
 #define XTEA_DELTA		0x9e3779b9
 #define XTEA_NUM_ROUNDS		32
+#define XTEA_BLOCK_SIZE		8
+#define XTEA_LANES		8	/* blocks per iteration */
+
+struct _DfuCipherXtea {
+	guint32			 rk0[XTEA_NUM_ROUNDS];	/* sum + key for v0 */
+	guint32			 rk1[XTEA_NUM_ROUNDS];	/* sum + key for v1 */
+};
 
 static gboolean
 dfu_tool_parse_xtea_key (const gchar *key, guint32 *keys, GError **error)
@@ -81,6 +91,212 @@ dfu_tool_parse_xtea_key (const gchar *key, guint32 *keys, GError **error)
 	return TRUE;
 }
 
+/**
+ * dfu_cipher_xtea_new: (skip)
+ * @key: a XTEA key
+ * @error: a #GError, or %NULL
+ *
+ * Creates a XTEA context, parsing the key and precomputing the
+ * per-round key schedule.
+ *
+ * Returns: a #DfuCipherXtea, or %NULL for error
+ **/
+DfuCipherXtea *
+dfu_cipher_xtea_new (const gchar *key, GError **error)
+{
+	DfuCipherXtea *ctx;
+	guint32 keys[4];
+	guint32 sum = 0;
+
+	if (!dfu_tool_parse_xtea_key (key, keys, error))
+		return NULL;
+	ctx = g_new0 (DfuCipherXtea, 1);
+	for (guint i = 0; i < XTEA_NUM_ROUNDS; i++) {
+		ctx->rk0[i] = sum + keys[sum & 3];
+		sum += XTEA_DELTA;
+		ctx->rk1[i] = sum + keys[(sum >> 11) & 3];
+	}
+	return ctx;
+}
+
+/**
+ * dfu_cipher_xtea_free: (skip)
+ * @ctx: a #DfuCipherXtea
+ *
+ * Frees a XTEA context.
+ **/
+void
+dfu_cipher_xtea_free (DfuCipherXtea *ctx)
+{
+	g_free (ctx);
+}
+
+#define XTEA_MIX(v)	((((v) << 4) ^ ((v) >> 5)) + (v))
+
+static inline void
+dfu_cipher_xtea_load (const guint8 *data, guint32 *v0, guint32 *v1)
+{
+	memcpy (v0, data, 4);
+	memcpy (v1, data + 4, 4);
+}
+
+static inline void
+dfu_cipher_xtea_store (guint8 *data, guint32 v0, guint32 v1)
+{
+	memcpy (data, &v0, 4);
+	memcpy (data + 4, &v1, 4);
+}
+
+#ifdef __SSE2__
+#define XTEA_MIX_SSE2(v)	_mm_add_epi32 (_mm_xor_si128 (_mm_slli_epi32 ((v), 4), \
+							      _mm_srli_epi32 ((v), 5)), (v))
+
+/* split four interleaved blocks into their v0 and v1 words */
+static inline void
+dfu_cipher_xtea_load_sse2 (const guint8 *data, __m128i *v0, __m128i *v1)
+{
+	__m128 a = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) data));
+	__m128 b = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) (data + 16)));
+	*v0 = _mm_castps_si128 (_mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0)));
+	*v1 = _mm_castps_si128 (_mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1)));
+}
+
+static inline void
+dfu_cipher_xtea_store_sse2 (guint8 *data, __m128i v0, __m128i v1)
+{
+	_mm_storeu_si128 ((__m128i *) data, _mm_unpacklo_epi32 (v0, v1));
+	_mm_storeu_si128 ((__m128i *) (data + 16), _mm_unpackhi_epi32 (v0, v1));
+}
+#endif
+
+/* ECB blocks are independent, so several are processed per round */
+static gsize
+dfu_cipher_xtea_encrypt_lanes (DfuCipherXtea *ctx, guint8 *data, gsize blocks)
+{
+	gsize j;
+	for (j = 0; j + XTEA_LANES <= blocks; j += XTEA_LANES) {
+		guint8 *buf = data + j * XTEA_BLOCK_SIZE;
+#ifdef __SSE2__
+		__m128i a0, a1, b0, b1;
+		dfu_cipher_xtea_load_sse2 (buf, &a0, &a1);
+		dfu_cipher_xtea_load_sse2 (buf + 32, &b0, &b1);
+		for (guint i = 0; i < XTEA_NUM_ROUNDS; i++) {
+			__m128i rk0 = _mm_set1_epi32 ((gint) ctx->rk0[i]);
+			__m128i rk1 = _mm_set1_epi32 ((gint) ctx->rk1[i]);
+			a0 = _mm_add_epi32 (a0, _mm_xor_si128 (XTEA_MIX_SSE2 (a1), rk0));
+			b0 = _mm_add_epi32 (b0, _mm_xor_si128 (XTEA_MIX_SSE2 (b1), rk0));
+			a1 = _mm_add_epi32 (a1, _mm_xor_si128 (XTEA_MIX_SSE2 (a0), rk1));
+			b1 = _mm_add_epi32 (b1, _mm_xor_si128 (XTEA_MIX_SSE2 (b0), rk1));
+		}
+		dfu_cipher_xtea_store_sse2 (buf, a0, a1);
+		dfu_cipher_xtea_store_sse2 (buf + 32, b0, b1);
+#else
+		guint32 v0[XTEA_LANES];
+		guint32 v1[XTEA_LANES];
+		for (guint k = 0; k < XTEA_LANES; k++)
+			dfu_cipher_xtea_load (buf + k * XTEA_BLOCK_SIZE, &v0[k], &v1[k]);
+		for (guint i = 0; i < XTEA_NUM_ROUNDS; i++) {
+			for (guint k = 0; k < XTEA_LANES; k++)
+				v0[k] += XTEA_MIX (v1[k]) ^ ctx->rk0[i];
+			for (guint k = 0; k < XTEA_LANES; k++)
+				v1[k] += XTEA_MIX (v0[k]) ^ ctx->rk1[i];
+		}
+		for (guint k = 0; k < XTEA_LANES; k++)
+			dfu_cipher_xtea_store (buf + k * XTEA_BLOCK_SIZE, v0[k], v1[k]);
+#endif
+	}
+	return j;
+}
+
+static gsize
+dfu_cipher_xtea_decrypt_lanes (DfuCipherXtea *ctx, guint8 *data, gsize blocks)
+{
+	gsize j;
+	for (j = 0; j + XTEA_LANES <= blocks; j += XTEA_LANES) {
+		guint8 *buf = data + j * XTEA_BLOCK_SIZE;
+#ifdef __SSE2__
+		__m128i a0, a1, b0, b1;
+		dfu_cipher_xtea_load_sse2 (buf, &a0, &a1);
+		dfu_cipher_xtea_load_sse2 (buf + 32, &b0, &b1);
+		for (guint i = XTEA_NUM_ROUNDS; i > 0; i--) {
+			__m128i rk0 = _mm_set1_epi32 ((gint) ctx->rk0[i - 1]);
+			__m128i rk1 = _mm_set1_epi32 ((gint) ctx->rk1[i - 1]);
+			a1 = _mm_sub_epi32 (a1, _mm_xor_si128 (XTEA_MIX_SSE2 (a0), rk1));
+			b1 = _mm_sub_epi32 (b1, _mm_xor_si128 (XTEA_MIX_SSE2 (b0), rk1));
+			a0 = _mm_sub_epi32 (a0, _mm_xor_si128 (XTEA_MIX_SSE2 (a1), rk0));
+			b0 = _mm_sub_epi32 (b0, _mm_xor_si128 (XTEA_MIX_SSE2 (b1), rk0));
+		}
+		dfu_cipher_xtea_store_sse2 (buf, a0, a1);
+		dfu_cipher_xtea_store_sse2 (buf + 32, b0, b1);
+#else
+		guint32 v0[XTEA_LANES];
+		guint32 v1[XTEA_LANES];
+		for (guint k = 0; k < XTEA_LANES; k++)
+			dfu_cipher_xtea_load (buf + k * XTEA_BLOCK_SIZE, &v0[k], &v1[k]);
+		for (guint i = XTEA_NUM_ROUNDS; i > 0; i--) {
+			for (guint k = 0; k < XTEA_LANES; k++)
+				v1[k] -= XTEA_MIX (v0[k]) ^ ctx->rk1[i - 1];
+			for (guint k = 0; k < XTEA_LANES; k++)
+				v0[k] -= XTEA_MIX (v1[k]) ^ ctx->rk0[i - 1];
+		}
+		for (guint k = 0; k < XTEA_LANES; k++)
+			dfu_cipher_xtea_store (buf + k * XTEA_BLOCK_SIZE, v0[k], v1[k]);
+#endif
+	}
+	return j;
+}
+
+/**
+ * dfu_cipher_xtea_encrypt: (skip)
+ * @ctx: a #DfuCipherXtea
+ * @data: data to encrypt in place
+ * @length: length of @data
+ *
+ * Encrypts a buffer using XTEA. Any trailing partial block is left as-is,
+ * so a large image can also be encrypted as a series of chunks as long as
+ * each chunk apart from the last is a multiple of 8 bytes.
+ **/
+void
+dfu_cipher_xtea_encrypt (DfuCipherXtea *ctx, guint8 *data, gsize length)
+{
+	gsize blocks = length / XTEA_BLOCK_SIZE;
+	for (gsize j = dfu_cipher_xtea_encrypt_lanes (ctx, data, blocks); j < blocks; j++) {
+		guint8 *buf = data + j * XTEA_BLOCK_SIZE;
+		guint32 v0, v1;
+		dfu_cipher_xtea_load (buf, &v0, &v1);
+		for (guint i = 0; i < XTEA_NUM_ROUNDS; i++) {
+			v0 += XTEA_MIX (v1) ^ ctx->rk0[i];
+			v1 += XTEA_MIX (v0) ^ ctx->rk1[i];
+		}
+		dfu_cipher_xtea_store (buf, v0, v1);
+	}
+}
+
+/**
+ * dfu_cipher_xtea_decrypt: (skip)
+ * @ctx: a #DfuCipherXtea
+ * @data: data to decrypt in place
+ * @length: length of @data
+ *
+ * Decrypts a buffer using XTEA, with the same chunking rules as
+ * dfu_cipher_xtea_encrypt().
+ **/
+void
+dfu_cipher_xtea_decrypt (DfuCipherXtea *ctx, guint8 *data, gsize length)
+{
+	gsize blocks = length / XTEA_BLOCK_SIZE;
+	for (gsize j = dfu_cipher_xtea_decrypt_lanes (ctx, data, blocks); j < blocks; j++) {
+		guint8 *buf = data + j * XTEA_BLOCK_SIZE;
+		guint32 v0, v1;
+		dfu_cipher_xtea_load (buf, &v0, &v1);
+		for (guint i = XTEA_NUM_ROUNDS; i > 0; i--) {
+			v1 -= XTEA_MIX (v0) ^ ctx->rk1[i - 1];
+			v0 -= XTEA_MIX (v1) ^ ctx->rk0[i - 1];
+		}
+		dfu_cipher_xtea_store (buf, v0, v1);
+	}
+}
+
 /**
  * dfu_cipher_decrypt_xtea: (skip)
  * @key: a XTEA key
@@ -98,28 +314,10 @@ dfu_cipher_decrypt_xtea (const gchar *key,
 			 guint32 length,
 			 GError **error)
 {
-	guint32 sum;
-	guint32 *tmp = (guint32 *) data;
-	guint32 v0;
-	guint32 v1;
-	guint8 i;
-	guint j;
-	guint32 keys[4];
-
-	if (!dfu_tool_parse_xtea_key (key, keys, error))
+	g_autoptr(DfuCipherXtea) ctx = dfu_cipher_xtea_new (key, error);
+	if (ctx == NULL)
 		return FALSE;
-	for (j = 0; j < length / 4; j += 2) {
-		v0 = tmp[j];
-		v1 = tmp[j+1];
-		sum = XTEA_DELTA * XTEA_NUM_ROUNDS;
-		for (i = 0; i < XTEA_NUM_ROUNDS; i++) {
-			v1 -= (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + keys[(sum >> 11) & 3]);
-			sum -= XTEA_DELTA;
-			v0 -= (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + keys[sum & 3]);
-		}
-		tmp[j] = v0;
-		tmp[j+1] = v1;
-	}
+	dfu_cipher_xtea_decrypt (ctx, data, length);
 	return TRUE;
 }
 
@@ -140,27 +338,9 @@ dfu_cipher_encrypt_xtea (const gchar *key,
 			 guint32 length,
 			 GError **error)
 {
-	guint32 sum;
-	guint32 *tmp = (guint32 *) data;
-	guint32 v0;
-	guint32 v1;
-	guint8 i;
-	guint j;
-	guint32 keys[4];
-
-	if (!dfu_tool_parse_xtea_key (key, keys, error))
+	g_autoptr(DfuCipherXtea) ctx = dfu_cipher_xtea_new (key, error);
+	if (ctx == NULL)
 		return FALSE;
-	for (j = 0; j < length / 4; j += 2) {
-		sum = 0;
-		v0 = tmp[j];
-		v1 = tmp[j+1];
-		for (i = 0; i < XTEA_NUM_ROUNDS; i++) {
-			v0 += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + keys[sum & 3]);
-			sum += XTEA_DELTA;
-			v1 += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + keys[(sum >> 11) & 3]);
-		}
-		tmp[j] = v0;
-		tmp[j+1] = v1;
-	}
+	dfu_cipher_xtea_encrypt (ctx, data, length);
 	return TRUE;
 }
@@ -27,6 +27,20 @@
 
 G_BEGIN_DECLS
 
+typedef struct _DfuCipherXtea DfuCipherXtea;
+
+DfuCipherXtea		*dfu_cipher_xtea_new		(const gchar	*key,
+							 GError		**error);
+void			 dfu_cipher_xtea_free		(DfuCipherXtea	*ctx);
+void			 dfu_cipher_xtea_encrypt	(DfuCipherXtea	*ctx,
+							 guint8		*data,
+							 gsize		 length);
+void			 dfu_cipher_xtea_decrypt	(DfuCipherXtea	*ctx,
+							 guint8		*data,
+							 gsize		 length);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(DfuCipherXtea, dfu_cipher_xtea_free)
+
 gboolean		 dfu_cipher_encrypt_xtea	(const gchar	*key,
 							 guint8		*data,
 							 guint32	 length,
@@ -0,0 +1,118 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#ifdef __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#endif
+
+#include "dfu-crc32.h"
+
+#define DFU_CRC32_POLYNOMIAL		0xedb88320
+
+#ifndef __ARM_FEATURE_CRC32
+static guint32 _crctbl[8][256];
+
+static void
+dfu_crc32_ensure_table (void)
+{
+	static gsize initialized = 0;
+
+	if (!g_once_init_enter (&initialized))
+		return;
+
+	/* the usual byte-at-a-time table */
+	for (guint i = 0; i < 256; i++) {
+		guint32 crc = i;
+		for (guint j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ DFU_CRC32_POLYNOMIAL : crc >> 1;
+		_crctbl[0][i] = crc;
+	}
+
+	/* each further table advances the CRC by one more zero byte */
+	for (guint i = 0; i < 256; i++) {
+		for (guint j = 1; j < 8; j++) {
+			guint32 crc = _crctbl[j - 1][i];
+			_crctbl[j][i] = (crc >> 8) ^ _crctbl[0][crc & 0xff];
+		}
+	}
+	g_once_init_leave (&initialized, 1);
+}
+#endif
+
+/**
+ * dfu_crc32_update: (skip)
+ * @crc: the current CRC, typically 0xffffffff for new data
+ * @data: data to checksum
+ * @length: size of @data
+ *
+ * Updates a reflected CRC-32 (polynomial 0x04c11db7) with @data. No final
+ * inversion is done, which is what the DFU suffix uses.
+ *
+ * The CRC instructions are used when building for ARMv8 with them enabled,
+ * otherwise the data is processed eight bytes at a time using
+ * slicing-by-8 tables.
+ *
+ * Returns: the updated CRC
+ *
+ * Since: 0.7.6
+ **/
+guint32
+dfu_crc32_update (guint32 crc, const guint8 *data, gsize length)
+{
+#ifdef __ARM_FEATURE_CRC32
+	while (length >= 8) {
+		guint64 tmp;
+		memcpy (&tmp, data, sizeof(tmp));
+		crc = __crc32d (crc, GUINT64_FROM_LE (tmp));
+		data += 8;
+		length -= 8;
+	}
+	while (length-- > 0)
+		crc = __crc32b (crc, *data++);
+#else
+	dfu_crc32_ensure_table ();
+	while (length >= 8) {
+		guint32 one;
+		guint32 two;
+		memcpy (&one, data, sizeof(one));
+		memcpy (&two, data + 4, sizeof(two));
+		one = GUINT32_FROM_LE (one) ^ crc;
+		two = GUINT32_FROM_LE (two);
+		crc = _crctbl[7][one & 0xff] ^
+		      _crctbl[6][(one >> 8) & 0xff] ^
+		      _crctbl[5][(one >> 16) & 0xff] ^
+		      _crctbl[4][one >> 24] ^
+		      _crctbl[3][two & 0xff] ^
+		      _crctbl[2][(two >> 8) & 0xff] ^
+		      _crctbl[1][(two >> 16) & 0xff] ^
+		      _crctbl[0][two >> 24];
+		data += 8;
+		length -= 8;
+	}
+	while (length-- > 0)
+		crc = _crctbl[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+#endif
+	return crc;
+}
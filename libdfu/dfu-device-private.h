@@ -40,6 +40,10 @@ void		 dfu_device_error_fixup			(DfuDevice	*device,
 							 GCancellable	*cancellable,
 							 GError		**error);
 guint		 dfu_device_get_download_timeout	(DfuDevice	*device);
+gboolean	 dfu_device_refresh_from_data		(DfuDevice	*device,
+							 const guint8	*buf,
+							 gsize		 buf_len,
+							 GError		**error);
 gchar		*dfu_device_get_quirks_as_string	(DfuDevice	*device);
 gboolean	 dfu_device_set_new_usb_dev		(DfuDevice	*device,
 							 GUsbDevice	*dev,
@@ -46,6 +46,13 @@
 
 static void dfu_device_finalize			 (GObject *object);
 
+typedef struct {
+	GMainLoop	*loop;
+	GUsbDevice	*dev;
+	GError		*error;
+	guint		 timeout;
+} DfuDeviceReplugHelper;
+
 typedef struct {
 	DfuDeviceAttributes	 attributes;
 	DfuDeviceQuirks		 quirks;
@@ -70,6 +77,7 @@ typedef struct {
 	guint8			 iface_number;
 	guint			 dnload_timeout;
 	guint			 timeout_ms;
+	DfuDeviceReplugHelper	*replug_helper;		/* if waiting */
 } DfuDevicePrivate;
 
 enum {
@@ -989,6 +997,54 @@ dfu_device_ensure_interface (DfuDevice *device,
 	return TRUE;
 }
 
+/**
+ * dfu_device_refresh_from_data:
+ * @device: a #DfuDevice
+ * @buf: the DFU_GETSTATUS response
+ * @buf_len: the size of @buf
+ * @error: a #GError, or %NULL
+ *
+ * Updates the cached device state, status and poll timeout from a
+ * DFU_GETSTATUS response that has already been read from the device.
+ *
+ * Return value: %TRUE for success
+ *
+ * Since: 0.7.6
+ **/
+gboolean
+dfu_device_refresh_from_data (DfuDevice *device,
+			      const guint8 *buf,
+			      gsize buf_len,
+			      GError **error)
+{
+	DfuDevicePrivate *priv = GET_PRIVATE (device);
+
+	if (buf_len != 6) {
+		g_set_error (error,
+			     DFU_ERROR,
+			     DFU_ERROR_INTERNAL,
+			     "cannot get device status, invalid size: %04x",
+			     (guint) buf_len);
+		return FALSE;
+	}
+
+	/* status or state changed */
+	dfu_device_set_status (device, buf[0]);
+	dfu_device_set_state (device, buf[4]);
+	if (dfu_device_has_quirk (device, DFU_DEVICE_QUIRK_IGNORE_POLLTIMEOUT)) {
+		priv->dnload_timeout = 5;
+	} else {
+		priv->dnload_timeout = buf[1] +
+					(((guint32) buf[2]) << 8) +
+					(((guint32) buf[3]) << 16);
+	}
+	g_debug ("refreshed status=%s and state=%s (dnload=%u)",
+		 dfu_status_to_string (priv->status),
+		 dfu_state_to_string (priv->state),
+		 priv->dnload_timeout);
+	return TRUE;
+}
+
 /**
  * dfu_device_refresh:
  * @device: a #DfuDevice
@@ -1053,29 +1109,7 @@ dfu_device_refresh (DfuDevice *device, GCancellable *cancellable, GError **error
 			     error_local->message);
 		return FALSE;
 	}
-	if (actual_length != 6) {
-		g_set_error (error,
-			     DFU_ERROR,
-			     DFU_ERROR_INTERNAL,
-			     "cannot get device status, invalid size: %04x",
-			     (guint) actual_length);
-	}
-
-	/* status or state changed */
-	dfu_device_set_status (device, buf[0]);
-	dfu_device_set_state (device, buf[4]);
-	if (dfu_device_has_quirk (device, DFU_DEVICE_QUIRK_IGNORE_POLLTIMEOUT)) {
-		priv->dnload_timeout = 5;
-	} else {
-		priv->dnload_timeout = buf[1] +
-					(((guint32) buf[2]) << 8) +
-					(((guint32) buf[3]) << 16);
-	}
-	g_debug ("refreshed status=%s and state=%s (dnload=%u)",
-		 dfu_status_to_string (priv->status),
-		 dfu_state_to_string (priv->state),
-		 priv->dnload_timeout);
-	return TRUE;
+	return dfu_device_refresh_from_data (device, buf, actual_length, error);
 }
 
 /**
@@ -1478,6 +1512,23 @@ dfu_device_close (DfuDevice *device, GError **error)
 	return TRUE;
 }
 
+/* called when the backing GUsbDevice changes */
+static void
+dfu_device_replug_helper_check (DfuDevice *device)
+{
+	DfuDevicePrivate *priv = GET_PRIVATE (device);
+	DfuDeviceReplugHelper *helper = priv->replug_helper;
+
+	if (helper == NULL || helper->dev == priv->dev)
+		return;
+	g_debug ("device changed GUsbDevice %p->%p", helper->dev, priv->dev);
+	g_set_object (&helper->dev, priv->dev);
+
+	/* success */
+	if (helper->dev != NULL)
+		g_main_loop_quit (helper->loop);
+}
+
 gboolean
 dfu_device_set_new_usb_dev (DfuDevice *device, GUsbDevice *dev,
 			    GCancellable *cancellable, GError **error)
@@ -1496,6 +1547,7 @@ dfu_device_set_new_usb_dev (DfuDevice *device, GUsbDevice *dev,
 		g_clear_object (&priv->dev);
 		g_ptr_array_set_size (priv->targets, 0);
 		priv->claimed_interface = FALSE;
+		dfu_device_replug_helper_check (device);
 		return TRUE;
 	}
 
@@ -1507,8 +1559,10 @@ dfu_device_set_new_usb_dev (DfuDevice *device, GUsbDevice *dev,
 		priv->open_new_dev = tmp;
 	}
 
-	/* set the new USB device */
+	/* set the new USB device; any replug wait finishes when control
+	 * returns to the main loop, i.e. after the device is reopened */
 	g_set_object (&priv->dev, dev);
+	dfu_device_replug_helper_check (device);
 
 	/* should be the same */
 	if (g_strcmp0 (priv->platform_id,
@@ -1548,66 +1602,34 @@ dfu_device_set_new_usb_dev (DfuDevice *device, GUsbDevice *dev,
 	return TRUE;
 }
 
-typedef struct {
-	DfuDevice	*device;
-	GError		**error;
-	GMainLoop	*loop;
-	GUsbDevice	*dev;
-	guint		 cnt;
-	guint		 timeout;
-} DfuDeviceReplugHelper;
-
-static void
-dfu_device_replug_helper_free (DfuDeviceReplugHelper *helper)
-{
-	if (helper->dev != NULL)
-		g_object_unref (helper->dev);
-	g_object_unref (helper->device);
-	g_main_loop_unref (helper->loop);
-	g_free (helper);
-}
-
 static gboolean
-dfu_device_replug_helper_cb (gpointer user_data)
+dfu_device_replug_helper_timeout_cb (gpointer user_data)
 {
 	DfuDeviceReplugHelper *helper = (DfuDeviceReplugHelper *) user_data;
-	DfuDevicePrivate *priv = GET_PRIVATE (helper->device);
-
-	/* did the backing GUsbDevice change */
-	if (helper->dev != priv->dev) {
-		g_debug ("device changed GUsbDevice %p->%p",
-			 helper->dev, priv->dev);
-		g_set_object (&helper->dev, priv->dev);
 
-		/* success */
-		if (helper->dev != NULL) {
-			g_main_loop_quit (helper->loop);
-			return FALSE;
-		}
-	}
-
-	/* set a limit */
-	if (helper->cnt++ * 100 > helper->timeout) {
-		g_debug ("gave up waiting for device replug");
-		if (helper->dev == NULL) {
-			g_set_error_literal (helper->error,
-					     DFU_ERROR,
-					     DFU_ERROR_INVALID_DEVICE,
-					     "target went away but did not come back");
-		} else {
-			g_set_error_literal (helper->error,
-					     DFU_ERROR,
-					     DFU_ERROR_INVALID_DEVICE,
-					     "target did not disconnect");
-		}
-		g_main_loop_quit (helper->loop);
-		return FALSE;
+	g_debug ("gave up waiting for device replug");
+	if (helper->dev == NULL) {
+		g_set_error_literal (&helper->error,
+				     DFU_ERROR,
+				     DFU_ERROR_INVALID_DEVICE,
+				     "target went away but did not come back");
+	} else {
+		g_set_error_literal (&helper->error,
+				     DFU_ERROR,
+				     DFU_ERROR_INVALID_DEVICE,
+				     "target did not disconnect");
 	}
+	helper->timeout = 0;
+	g_main_loop_quit (helper->loop);
+	return FALSE;
+}
 
-	/* continue waiting */
-	g_debug ("waiting for device replug for %ums -- state is %s",
-		 helper->cnt * 100, dfu_state_to_string (priv->state));
-	return TRUE;
+static void
+dfu_device_replug_helper_cancelled_cb (GCancellable *cancellable,
+				       gpointer user_data)
+{
+	DfuDeviceReplugHelper *helper = (DfuDeviceReplugHelper *) user_data;
+	g_main_loop_quit (helper->loop);
 }
 
 /**
@@ -1629,23 +1651,46 @@ dfu_device_wait_for_replug (DfuDevice *device, guint timeout,
 			    GCancellable *cancellable, GError **error)
 {
 	DfuDevicePrivate *priv = GET_PRIVATE (device);
-	DfuDeviceReplugHelper *helper;
-	GError *error_tmp = NULL;
-	const guint replug_poll = 100; /* ms */
-
-	/* wait for replug */
-	helper = g_new0 (DfuDeviceReplugHelper, 1);
-	helper->loop = g_main_loop_new (NULL, FALSE);
-	helper->device = g_object_ref (device);
-	helper->dev = g_object_ref (priv->dev);
-	helper->error = &error_tmp;
-	helper->timeout = timeout;
-	g_timeout_add_full (G_PRIORITY_DEFAULT, replug_poll,
-			    dfu_device_replug_helper_cb, helper,
-			    (GDestroyNotify) dfu_device_replug_helper_free);
-	g_main_loop_run (helper->loop);
-	if (error_tmp != NULL) {
-		g_propagate_error (error, error_tmp);
+	DfuDeviceReplugHelper helper = { NULL };
+	gulong cancellable_id = 0;
+
+	g_return_val_if_fail (DFU_IS_DEVICE (device), FALSE);
+	g_return_val_if_fail (priv->replug_helper == NULL, FALSE);
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		return FALSE;
+
+	/* wait for the DfuContext to set a new GUsbDevice, or the deadline */
+	helper.loop = g_main_loop_new (NULL, FALSE);
+	if (priv->dev != NULL)
+		helper.dev = g_object_ref (priv->dev);
+	helper.timeout = g_timeout_add (timeout,
+					dfu_device_replug_helper_timeout_cb,
+					&helper);
+	if (cancellable != NULL) {
+		cancellable_id = g_cancellable_connect (cancellable,
+							G_CALLBACK (dfu_device_replug_helper_cancelled_cb),
+							&helper, NULL);
+	}
+	g_debug ("waiting up to %ums for device replug -- state is %s",
+		 timeout, dfu_state_to_string (priv->state));
+	priv->replug_helper = &helper;
+	g_main_loop_run (helper.loop);
+	priv->replug_helper = NULL;
+
+	/* clean up */
+	if (cancellable_id != 0)
+		g_cancellable_disconnect (cancellable, cancellable_id);
+	if (helper.timeout != 0)
+		g_source_remove (helper.timeout);
+	if (helper.dev != NULL)
+		g_object_unref (helper.dev);
+	g_main_loop_unref (helper.loop);
+	if (helper.error == NULL &&
+	    g_cancellable_set_error_if_cancelled (cancellable, &helper.error))
+		g_debug ("cancelled waiting for device replug");
+	if (helper.error != NULL) {
+		g_propagate_error (error, helper.error);
 		return FALSE;
 	}
 
@@ -2108,6 +2153,8 @@ dfu_device_download (DfuDevice *device,
 			flags_local = DFU_TARGET_TRANSFER_FLAG_VERIFY;
 		if (dfu_firmware_get_format (firmware) == DFU_FIRMWARE_FORMAT_RAW)
 			flags_local |= DFU_TARGET_TRANSFER_FLAG_ADDR_HEURISTIC;
+		if (flags & DFU_TARGET_TRANSFER_FLAG_INCREMENTAL)
+			flags_local |= DFU_TARGET_TRANSFER_FLAG_INCREMENTAL;
 		id1 = g_signal_connect (target_tmp, "percentage-changed",
 					G_CALLBACK (dfu_device_percentage_cb), device);
 		id2 = g_signal_connect (target_tmp, "action-changed",
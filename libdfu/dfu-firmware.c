@@ -41,10 +41,7 @@
 #include "dfu-common.h"
 #include "dfu-error.h"
 #include "dfu-firmware-private.h"
-#include "dfu-format-elf.h"
-#include "dfu-format-dfu.h"
-#include "dfu-format-ihex.h"
-#include "dfu-format-raw.h"
+#include "dfu-format.h"
 #include "dfu-image.h"
 
 static void dfu_firmware_finalize			 (GObject *object);
@@ -404,42 +401,43 @@ dfu_firmware_parse_altos_vid_pid (DfuFirmware *firmware)
 	if (addr32 == 0x0)
 		return;
 
-	/* search each element */
+	/* search each element, as the symbol may not be in the first */
 	for (guint i = 0; i < priv->images->len; i++) {
 		DfuImage *image = g_ptr_array_index (priv->images, i);
-		DfuElement *element;
-		GBytes *bytes_tmp;
-		const guint8 *data;
-		gsize length;
-		guint32 element_address;
-		guint16 vid, pid, release;
-
-		/* get element data */
-		element = dfu_image_get_element_default (image);
-		if (element == NULL)
-			continue;
-
-		/* check address is in this element */
-		element_address = dfu_element_get_address (element);
-		if (element_address > addr32)
-			continue;
-		bytes_tmp = dfu_element_get_contents (element);
-		if (bytes_tmp == NULL)
-			continue;
-
-		/* check this element is big enough */
-		data = g_bytes_get_data (bytes_tmp, &length);
-		if (addr32 - element_address > length)
-			continue;
-
-		/* read the USB descriptor */
-		addr32 -= element_address;
-		memcpy (&vid, &data[addr32 + 8], 2);
-		memcpy (&pid, &data[addr32 + 10], 2);
-		memcpy (&release, &data[addr32 + 12], 2);
-		dfu_firmware_set_vid (firmware, GUINT32_FROM_LE (vid));
-		dfu_firmware_set_pid (firmware, GUINT32_FROM_LE (pid));
-		dfu_firmware_set_release (firmware, GUINT32_FROM_LE (release));
+		GPtrArray *elements = dfu_image_get_elements (image);
+
+		for (guint j = 0; j < elements->len; j++) {
+			DfuElement *element = g_ptr_array_index (elements, j);
+			GBytes *bytes_tmp;
+			const guint8 *data;
+			gsize length;
+			guint32 element_address;
+			guint32 offset;
+			guint16 vid, pid, release;
+
+			/* check address is in this element */
+			element_address = dfu_element_get_address (element);
+			if (element_address > addr32)
+				continue;
+			bytes_tmp = dfu_element_get_contents (element);
+			if (bytes_tmp == NULL)
+				continue;
+
+			/* check this element is big enough */
+			data = g_bytes_get_data (bytes_tmp, &length);
+			offset = addr32 - element_address;
+			if ((gsize) offset + 14 > length)
+				continue;
+
+			/* read the USB descriptor */
+			memcpy (&vid, &data[offset + 8], 2);
+			memcpy (&pid, &data[offset + 10], 2);
+			memcpy (&release, &data[offset + 12], 2);
+			dfu_firmware_set_vid (firmware, GUINT32_FROM_LE (vid));
+			dfu_firmware_set_pid (firmware, GUINT32_FROM_LE (pid));
+			dfu_firmware_set_release (firmware, GUINT32_FROM_LE (release));
+			return;
+		}
 	}
 }
 
@@ -461,6 +459,7 @@ dfu_firmware_parse_data (DfuFirmware *firmware, GBytes *bytes,
 			 DfuFirmwareParseFlags flags, GError **error)
 {
 	DfuFirmwarePrivate *priv = GET_PRIVATE (firmware);
+	const DfuFormat *format;
 
 	g_return_val_if_fail (DFU_IS_FIRMWARE (firmware), FALSE);
 	g_return_val_if_fail (bytes != NULL, FALSE);
@@ -472,35 +471,22 @@ dfu_firmware_parse_data (DfuFirmware *firmware, GBytes *bytes,
 	priv->release = 0xffff;
 
 	/* try to get format if not already set */
-	if (priv->format == DFU_FIRMWARE_FORMAT_UNKNOWN)
-		priv->format = dfu_firmware_detect_ihex (bytes);
-	if (priv->format == DFU_FIRMWARE_FORMAT_UNKNOWN)
-		priv->format = dfu_firmware_detect_dfu (bytes);
-	if (priv->format == DFU_FIRMWARE_FORMAT_UNKNOWN)
-		priv->format = dfu_firmware_detect_elf (bytes);
-	if (priv->format == DFU_FIRMWARE_FORMAT_UNKNOWN)
-		priv->format = dfu_firmware_detect_raw (bytes);
-
-	/* handled easily */
-	switch (priv->format) {
-	case DFU_FIRMWARE_FORMAT_INTEL_HEX:
-		if (!dfu_firmware_from_ihex (firmware, bytes, flags, error))
-			return FALSE;
-		break;
-	case DFU_FIRMWARE_FORMAT_ELF:
-		if (!dfu_firmware_from_elf (firmware, bytes, flags, error))
-			return FALSE;
-		break;
-	case DFU_FIRMWARE_FORMAT_DFU:
-	case DFU_FIRMWARE_FORMAT_DFUSE:
-		if (!dfu_firmware_from_dfu (firmware, bytes, flags, error))
-			return FALSE;
-		break;
-	default:
-		if (!dfu_firmware_from_raw (firmware, bytes, flags, error))
-			return FALSE;
-		break;
+	if (priv->format == DFU_FIRMWARE_FORMAT_UNKNOWN) {
+		format = dfu_format_detect (bytes);
+	} else {
+		format = dfu_format_get_by_kind (priv->format);
+	}
+	if (format == NULL || format->parse == NULL) {
+		g_set_error (error,
+			     DFU_ERROR,
+			     DFU_ERROR_INTERNAL,
+			     "invalid format for parse (0x%04x)",
+			     priv->format);
+		return FALSE;
 	}
+	priv->format = format->format;
+	if (!format->parse (firmware, bytes, flags, error))
+		return FALSE;
 
 	/* get the VID/PID for altos devices */
 	dfu_firmware_parse_altos_vid_pid (firmware);
@@ -531,6 +517,7 @@ dfu_firmware_parse_file (DfuFirmware *firmware, GFile *file,
 	gchar *contents = NULL;
 	gsize length = 0;
 	g_autofree gchar *basename = NULL;
+	g_autofree gchar *filename = NULL;
 	g_autoptr(GBytes) bytes = NULL;
 
 	g_return_val_if_fail (DFU_IS_FIRMWARE (firmware), FALSE);
@@ -542,10 +529,22 @@ dfu_firmware_parse_file (DfuFirmware *firmware, GFile *file,
 	if (g_str_has_suffix (basename, ".xdfu"))
 		priv->cipher_kind = DFU_CIPHER_KIND_XTEA;
 
-	if (!g_file_load_contents (file, cancellable, &contents,
-				   &length, NULL, error))
-		return FALSE;
-	bytes = g_bytes_new_take (contents, length);
+	/* map local files so that element contents can reference the file
+	 * data directly; the mapping is read-only, so anything that changes
+	 * the contents has to copy them first */
+	filename = g_file_get_path (file);
+	if (filename != NULL) {
+		g_autoptr(GMappedFile) mapped_file = NULL;
+		mapped_file = g_mapped_file_new (filename, FALSE, error);
+		if (mapped_file == NULL)
+			return FALSE;
+		bytes = g_mapped_file_get_bytes (mapped_file);
+	} else {
+		if (!g_file_load_contents (file, cancellable, &contents,
+					   &length, NULL, error))
+			return FALSE;
+		bytes = g_bytes_new_take (contents, length);
+	}
 	return dfu_firmware_parse_data (firmware, bytes, flags, error);
 }
 
@@ -634,6 +633,7 @@ GBytes *
 dfu_firmware_write_data (DfuFirmware *firmware, GError **error)
 {
 	DfuFirmwarePrivate *priv = GET_PRIVATE (firmware);
+	const DfuFormat *format;
 
 	g_return_val_if_fail (DFU_IS_FIRMWARE (firmware), NULL);
 	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
@@ -658,22 +658,10 @@ dfu_firmware_write_data (DfuFirmware *firmware, GError **error)
 		return NULL;
 	}
 
-	/* raw */
-	if (priv->format == DFU_FIRMWARE_FORMAT_RAW)
-		return dfu_firmware_to_raw (firmware, error);
-
-	/* DFU or DfuSe*/
-	if (priv->format == DFU_FIRMWARE_FORMAT_DFU ||
-	    priv->format == DFU_FIRMWARE_FORMAT_DFUSE)
-		return dfu_firmware_to_dfu (firmware, error);
-
-	/* Intel HEX */
-	if (priv->format == DFU_FIRMWARE_FORMAT_INTEL_HEX)
-		return dfu_firmware_to_ihex (firmware, error);
-
-	/* ELF */
-	if (priv->format == DFU_FIRMWARE_FORMAT_ELF)
-		return dfu_firmware_to_elf (firmware, error);
+	/* any registered format that can be written */
+	format = dfu_format_get_by_kind (priv->format);
+	if (format != NULL && format->write != NULL)
+		return format->write (firmware, error);
 
 	/* invalid */
 	g_set_error (error,
@@ -36,6 +36,7 @@ typedef struct __attribute__((packed)) {
 
 /**
  * dfu_element_from_dfuse: (skip)
+ * @bytes: the buffer containing @data
  * @data: data buffer
  * @length: length of @data we can access
  * @consumed: (out): the number of bytes we consued
@@ -46,13 +47,15 @@ typedef struct __attribute__((packed)) {
  * Returns: a #DfuElement, or %NULL for error
  **/
 static DfuElement *
-dfu_element_from_dfuse (const guint8 *data,
+dfu_element_from_dfuse (GBytes *bytes,
+			const guint8 *data,
 			guint32 length,
 			guint32 *consumed,
 			GError **error)
 {
 	DfuElement *element = NULL;
 	DfuSeElementPrefix *el = (DfuSeElementPrefix *) data;
+	gsize offset;
 	guint32 size;
 	g_autoptr(GBytes) contents = NULL;
 
@@ -83,7 +86,10 @@ dfu_element_from_dfuse (const guint8 *data,
 	/* create new element */
 	element = dfu_element_new ();
 	dfu_element_set_address (element, GUINT32_FROM_LE (el->address));
-	contents = g_bytes_new (data + sizeof(DfuSeElementPrefix), size);
+	offset = (gsize) (data - (const guint8 *) g_bytes_get_data (bytes, NULL));
+	contents = g_bytes_new_from_bytes (bytes,
+					   offset + sizeof(DfuSeElementPrefix),
+					   size);
 	dfu_element_set_contents (element, contents);
 
 	/* return size */
@@ -131,6 +137,7 @@ typedef struct __attribute__((packed)) {
 
 /**
  * dfu_image_from_dfuse: (skip)
+ * @bytes: the buffer containing @data
  * @data: data buffer
  * @length: length of @data we can access
  * @consumed: (out): the number of bytes we consued
@@ -141,7 +148,8 @@ typedef struct __attribute__((packed)) {
  * Returns: a #DfuImage, or %NULL for error
  **/
 static DfuImage *
-dfu_image_from_dfuse (const guint8 *data,
+dfu_image_from_dfuse (GBytes *bytes,
+		      const guint8 *data,
 		      guint32 length,
 		      guint32 *consumed,
 		      GError **error)
@@ -186,7 +194,7 @@ dfu_image_from_dfuse (const guint8 *data,
 	for (j = 0; j < elements; j++) {
 		guint32 consumed_local;
 		g_autoptr(DfuElement) element = NULL;
-		element = dfu_element_from_dfuse (data + offset, length,
+		element = dfu_element_from_dfuse (bytes, data + offset, length,
 						  &consumed_local, error);
 		if (element == NULL)
 			return NULL;
@@ -390,7 +398,7 @@ dfu_firmware_from_dfuse (DfuFirmware *firmware,
 	for (i = 0; i < prefix->targets; i++) {
 		guint consumed;
 		g_autoptr(DfuImage) image = NULL;
-		image = dfu_image_from_dfuse (data + offset, (guint32) len,
+		image = dfu_image_from_dfuse (bytes, data + offset, (guint32) len,
 					      &consumed, error);
 		if (image == NULL)
 			return FALSE;
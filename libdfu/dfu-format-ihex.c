@@ -50,22 +50,44 @@ dfu_firmware_detect_ihex (GBytes *bytes)
 	return DFU_FIRMWARE_FORMAT_INTEL_HEX;
 }
 
-static guint8
-dfu_firmware_ihex_parse_uint8 (const gchar *data, guint pos)
+/* value of each hex digit plus one, so that zero is not a valid digit */
+static const guint8 _hex_to_nibble[256] = {
+	['0'] = 0x01, ['1'] = 0x02, ['2'] = 0x03, ['3'] = 0x04,
+	['4'] = 0x05, ['5'] = 0x06, ['6'] = 0x07, ['7'] = 0x08,
+	['8'] = 0x09, ['9'] = 0x0a, ['A'] = 0x0b, ['B'] = 0x0c,
+	['C'] = 0x0d, ['D'] = 0x0e, ['E'] = 0x0f, ['F'] = 0x10,
+	['a'] = 0x0b, ['b'] = 0x0c, ['c'] = 0x0d, ['d'] = 0x0e,
+	['e'] = 0x0f, ['f'] = 0x10,
+};
+static const gchar _nibble_to_hex[] = "0123456789ABCDEF";
+
+/* decodes @len bytes of hex into @buf, also returning the sum of the bytes */
+static gboolean
+dfu_firmware_ihex_decode (const gchar *data,
+			  guint8 *buf,
+			  guint len,
+			  guint8 *checksum,
+			  GError **error)
 {
-	gchar buffer[3];
-	memcpy (buffer, data + pos, 2);
-	buffer[2] = '\0';
-	return (guint8) g_ascii_strtoull (buffer, NULL, 16);
-}
+	guint8 sum = 0;
 
-static guint16
-dfu_firmware_ihex_parse_uint16 (const gchar *data, guint pos)
-{
-	gchar buffer[5];
-	memcpy (buffer, data + pos, 4);
-	buffer[4] = '\0';
-	return (guint16) g_ascii_strtoull (buffer, NULL, 16);
+	for (guint i = 0; i < len; i++) {
+		guint8 hi = _hex_to_nibble[(guint8) data[i * 2]];
+		guint8 lo = _hex_to_nibble[(guint8) data[i * 2 + 1]];
+		if (hi == 0 || lo == 0) {
+			g_set_error (error,
+				     DFU_ERROR,
+				     DFU_ERROR_INVALID_FILE,
+				     "invalid hex digit in '%c%c'",
+				     data[i * 2], data[i * 2 + 1]);
+			return FALSE;
+		}
+		buf[i] = (guint8) (((hi - 1) << 4) | (lo - 1));
+		sum += buf[i];
+	}
+	if (checksum != NULL)
+		*checksum = sum;
+	return TRUE;
 }
 
 #define	DFU_INHX32_RECORD_TYPE_DATA		0x00
@@ -73,6 +95,9 @@ dfu_firmware_ihex_parse_uint16 (const gchar *data, guint pos)
 #define	DFU_INHX32_RECORD_TYPE_EXTENDED		0x04
 #define	DFU_INHX32_RECORD_TYPE_SYMTAB		0xfe
 
+/* holes larger than this are not filled with zeros */
+#define	DFU_IHEX_HOLE_SIZE_MAX			0x400
+
 static gboolean
 dfu_firmware_ihex_symbol_name_valid (const GString *symbol_name)
 {
@@ -107,17 +132,15 @@ dfu_firmware_from_ihex (DfuFirmware *firmware,
 	guint32 addr32_last = 0;
 	guint32 element_address = 0;
 	guint8 checksum;
-	guint8 data_tmp;
 	guint8 len_tmp;
+	guint8 record[4 + 255 + 1];
 	guint8 type;
 	guint end;
-	guint i;
-	guint j;
 	guint offset = 0;
 	g_autoptr(DfuElement) element = NULL;
 	g_autoptr(DfuImage) image = NULL;
+	g_autoptr(GByteArray) buf = NULL;
 	g_autoptr(GBytes) contents = NULL;
-	g_autoptr(GString) string = NULL;
 
 	g_return_val_if_fail (bytes != NULL, FALSE);
 
@@ -126,9 +149,12 @@ dfu_firmware_from_ihex (DfuFirmware *firmware,
 	dfu_image_set_name (image, "ihex");
 	element = dfu_element_new ();
 
-	/* parse records */
+	/* each data byte takes at least two chars of input, so this is only
+	 * exceeded when there are holes to fill */
 	in_buffer = g_bytes_get_data (bytes, &len_in);
-	string = g_string_new ("");
+	buf = g_byte_array_sized_new (len_in / 2);
+
+	/* parse records */
 	while (offset < len_in) {
 
 		/* check starting token */
@@ -151,14 +177,14 @@ dfu_firmware_from_ihex (DfuFirmware *firmware,
 			return FALSE;
 		}
 
-		/* length, 16-bit address, type */
-		len_tmp = dfu_firmware_ihex_parse_uint8 (in_buffer, offset+1);
-		addr_low = dfu_firmware_ihex_parse_uint16 (in_buffer, offset+3);
-		type = dfu_firmware_ihex_parse_uint8 (in_buffer, offset+7);
+		/* length */
+		if (!dfu_firmware_ihex_decode (in_buffer + offset + 1,
+					       &len_tmp, 1, NULL, error))
+			return FALSE;
 
 		/* position of checksum */
 		end = offset + 9 + len_tmp * 2;
-		if (end > (guint) len_in) {
+		if (end + 2 > (guint) len_in) {
 			g_set_error (error,
 				     DFU_ERROR,
 				     DFU_ERROR_INVALID_FILE,
@@ -167,21 +193,22 @@ dfu_firmware_from_ihex (DfuFirmware *firmware,
 			return FALSE;
 		}
 
-		/* verify checksum */
-		if ((flags & DFU_FIRMWARE_PARSE_FLAG_NO_CRC_TEST) == 0) {
-			checksum = 0;
-			for (i = offset + 1; i < end + 2; i += 2) {
-				data_tmp = dfu_firmware_ihex_parse_uint8 (in_buffer, i);
-				checksum += data_tmp;
-			}
-			if (checksum != 0)  {
-				g_set_error_literal (error,
-						     DFU_ERROR,
-						     DFU_ERROR_INVALID_FILE,
-						     "invalid record checksum");
-				return FALSE;
-			}
+		/* decode the whole record once: length, 16-bit address, type,
+		 * data and checksum, summing the bytes as we go */
+		if (!dfu_firmware_ihex_decode (in_buffer + offset + 1,
+					       record, 4 + len_tmp + 1,
+					       &checksum, error))
+			return FALSE;
+		if ((flags & DFU_FIRMWARE_PARSE_FLAG_NO_CRC_TEST) == 0 &&
+		    checksum != 0)  {
+			g_set_error_literal (error,
+					     DFU_ERROR,
+					     DFU_ERROR_INVALID_FILE,
+					     "invalid record checksum");
+			return FALSE;
 		}
+		addr_low = ((guint16) record[1] << 8) | record[2];
+		type = record[3];
 
 		/* process different record types */
 		switch (type) {
@@ -207,26 +234,40 @@ dfu_firmware_from_ihex (DfuFirmware *firmware,
 					     (guint) addr32_last);
 				return FALSE;
 			}
+			if (len_tmp == 0)
+				break;
 
-			/* parse bytes from line */
+			/* large holes start a new element rather than being
+			 * filled, so widely separated regions stay sparse */
 			g_debug ("writing data 0x%08x", (guint32) addr32);
-			for (i = offset + 9; i < end; i += 2) {
-				/* any holes in the hex record */
-				guint32 len_hole = addr32 - addr32_last;
-				if (addr32_last > 0x0 && len_hole > 1) {
-					for (j = 1; j < len_hole; j++) {
-						g_debug ("filling address 0x%08x",
-							 addr32_last + j);
-						/* although 0xff might be clearer,
-						 * we can't write 0xffff to pic14 */
-						g_string_append_c (string, 0x00);
-					}
-				}
-				/* write into buf */
-				data_tmp = dfu_firmware_ihex_parse_uint8 (in_buffer, i);
-				g_string_append_c (string, (gchar) data_tmp);
-				addr32_last = addr32++;
+			if (addr32_last > 0x0 &&
+			    addr32 - addr32_last > DFU_IHEX_HOLE_SIZE_MAX) {
+				g_autoptr(GBytes) contents_tmp = NULL;
+				g_debug ("new element at 0x%08x", addr32);
+				if (dfu_image_get_elements (image)->len == 0)
+					dfu_element_set_address (element, element_address);
+				contents_tmp = g_byte_array_free_to_bytes (g_steal_pointer (&buf));
+				dfu_element_set_contents (element, contents_tmp);
+				dfu_image_add_element (image, element);
+				g_object_unref (element);
+				element = dfu_element_new ();
+				dfu_element_set_address (element, addr32);
+				buf = g_byte_array_sized_new ((len_in - offset) / 2);
+			} else if (addr32_last > 0x0 && addr32 - addr32_last > 1) {
+				guint32 len_hole = addr32 - addr32_last - 1;
+				guint len_old = buf->len;
+				g_debug ("filling 0x%08x to 0x%08x",
+					 addr32_last + 1, addr32 - 1);
+				/* although 0xff might be clearer,
+				 * we can't write 0xffff to pic14 */
+				g_byte_array_set_size (buf, len_old + len_hole);
+				memset (buf->data + len_old, 0x00, len_hole);
 			}
+
+			/* write into buf */
+			g_byte_array_append (buf, record + 4, len_tmp);
+			addr32_last = addr32 + len_tmp - 1;
+			addr32 += len_tmp;
 			break;
 		case DFU_INHX32_RECORD_TYPE_EOF:
 			if (got_eof) {
@@ -240,16 +281,13 @@ dfu_firmware_from_ihex (DfuFirmware *firmware,
 			got_eof = TRUE;
 			break;
 		case DFU_INHX32_RECORD_TYPE_EXTENDED:
-			addr_high = dfu_firmware_ihex_parse_uint16 (in_buffer, offset+9);
+			addr_high = ((guint16) record[4] << 8) | record[5];
 			addr32 = ((guint32) addr_high << 16) + addr_low;
 			break;
 		case DFU_INHX32_RECORD_TYPE_SYMTAB:
 		{
-			g_autoptr(GString) str = g_string_new ("");
-			for (i = offset + 9; i < end; i += 2) {
-				guint8 tmp_c = dfu_firmware_ihex_parse_uint8 (in_buffer, i);
-				g_string_append_c (str, tmp_c);
-			}
+			g_autoptr(GString) str = NULL;
+			str = g_string_new_len ((const gchar *) record + 4, len_tmp);
 			addr32 = ((guint32) addr_high << 16) + addr_low;
 			if (addr32 != 0x0 && dfu_firmware_ihex_symbol_name_valid (str)) {
 				g_debug ("symtab 0x%08x: %s", addr32, str->str);
@@ -289,16 +327,27 @@ dfu_firmware_from_ihex (DfuFirmware *firmware,
 		return FALSE;
 	}
 
-	/* add single image */
-	contents = g_bytes_new (string->str, string->len);
+	/* add single image, with an element for each populated region */
+	contents = g_byte_array_free_to_bytes (g_steal_pointer (&buf));
 	dfu_element_set_contents (element, contents);
-	dfu_element_set_address (element, element_address);
+	if (dfu_image_get_elements (image)->len == 0)
+		dfu_element_set_address (element, element_address);
 	dfu_image_add_element (image, element);
 	dfu_firmware_add_image (firmware, image);
 	dfu_firmware_set_format (firmware, DFU_FIRMWARE_FORMAT_INTEL_HEX);
 	return TRUE;
 }
 
+static gchar *
+dfu_firmware_ihex_encode (gchar *dst, const guint8 *data, gsize len)
+{
+	for (gsize i = 0; i < len; i++) {
+		*dst++ = _nibble_to_hex[data[i] >> 4];
+		*dst++ = _nibble_to_hex[data[i] & 0x0f];
+	}
+	return dst;
+}
+
 static void
 dfu_firmware_to_ihex_bytes (GString *str, guint8 record_type,
 			    guint32 address, GBytes *contents)
@@ -307,24 +356,30 @@ dfu_firmware_to_ihex_bytes (GString *str, guint8 record_type,
 	const guint chunk_size = 16;
 	gsize len;
 
-	/* get number of chunks */
+	/* each record is at most 12 + 2 * chunk_size chars */
 	data = g_bytes_get_data (contents, &len);
 	for (gsize i = 0; i < len; i += chunk_size) {
+		gchar line[12 + 2 * 16];
+		gchar *dst = line;
 		guint8 checksum = 0;
+		guint8 hdr[4];
 
 		/* length, 16-bit address, type */
 		gsize chunk_len = MIN (len - i, 16);
-		g_string_append_printf (str, ":%02X%04X%02X",
-					(guint) chunk_len,
-					(guint) (address + i),
-					(guint) record_type);
-		for (gsize j = 0; j < chunk_len; j++)
-			g_string_append_printf (str, "%02X", data[i+j]);
+		hdr[0] = (guint8) chunk_len;
+		hdr[1] = (guint8) ((address + i) >> 8);
+		hdr[2] = (guint8) (address + i);
+		hdr[3] = record_type;
+		*dst++ = ':';
+		dst = dfu_firmware_ihex_encode (dst, hdr, sizeof(hdr));
+		dst = dfu_firmware_ihex_encode (dst, data + i, chunk_len);
 
 		/* add checksum */
-		for (gsize j = 0; j < (chunk_len * 2) + 8; j++)
-			checksum += (guint8) str->str[str->len - (j + 1)];
-		g_string_append_printf (str, "%02X\n", checksum);
+		for (gchar *tmp = line + 1; tmp < dst; tmp++)
+			checksum += (guint8) *tmp;
+		dst = dfu_firmware_ihex_encode (dst, &checksum, 1);
+		*dst++ = '\n';
+		g_string_append_len (str, line, dst - line);
 	}
 }
 
@@ -356,11 +411,14 @@ dfu_firmware_to_ihex (DfuFirmware *firmware, GError **error)
 	GPtrArray *elements;
 	guint i;
 	guint j;
+	guint32 size_fw;
 	g_autoptr(GPtrArray) symbols = NULL;
 	g_autoptr(GString) str = NULL;
 
-	/* write all the element data */
-	str = g_string_new ("");
+	/* write all the element data; the total size is known in advance
+	 * apart from the EOF and symbol records */
+	size_fw = dfu_firmware_get_size (firmware);
+	str = g_string_sized_new (size_fw * 2 + (size_fw / 16 + 1) * 12 + 12);
 	images = dfu_firmware_get_images (firmware);
 	for (i = 0; i < images->len; i++) {
 		image = g_ptr_array_index (images, i);
@@ -81,9 +81,8 @@ dfu_firmware_from_raw (DfuFirmware *firmware,
 GBytes *
 dfu_firmware_to_raw (DfuFirmware *firmware, GError **error)
 {
-	DfuElement *element;
 	DfuImage *image;
-	GBytes *contents;
+	g_autoptr(DfuElement) element = NULL;
 
 	image = dfu_firmware_get_image_default (firmware);
 	if (image == NULL) {
@@ -93,14 +92,10 @@ dfu_firmware_to_raw (DfuFirmware *firmware, GError **error)
 				     "no firmware image data to write");
 		return NULL;
 	}
-	element = dfu_image_get_element (image, 0);
-	if (element == NULL) {
-		g_set_error_literal (error,
-				     DFU_ERROR,
-				     DFU_ERROR_NOT_FOUND,
-				     "no firmware element data to write");
+
+	/* raw files have no addresses, so fill any gaps */
+	element = dfu_image_flatten (image, error);
+	if (element == NULL)
 		return NULL;
-	}
-	contents = dfu_element_get_contents (element);
-	return g_bytes_ref (contents);
+	return g_bytes_ref (dfu_element_get_contents (element));
 }
@@ -0,0 +1,197 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "dfu-format.h"
+#include "dfu-format-dfu.h"
+#include "dfu-format-elf.h"
+#include "dfu-format-ihex.h"
+#include "dfu-format-raw.h"
+
+static GMutex		 formats_mutex;
+static GPtrArray	*formats = NULL;	/* of DfuFormat, by priority */
+
+static const DfuFormat formats_builtin[] = {
+	{ DFU_FIRMWARE_FORMAT_INTEL_HEX, ":", 1, 12, NULL, 100,
+	  dfu_firmware_from_ihex, dfu_firmware_to_ihex },
+	{ DFU_FIRMWARE_FORMAT_DFU, NULL, 0, 16, dfu_firmware_detect_dfu, 90,
+	  dfu_firmware_from_dfu, dfu_firmware_to_dfu },
+	{ DFU_FIRMWARE_FORMAT_DFUSE, NULL, 0, 0, NULL, 90,
+	  dfu_firmware_from_dfu, dfu_firmware_to_dfu },
+	{ DFU_FIRMWARE_FORMAT_ELF, NULL, 0, 16, dfu_firmware_detect_elf, 80,
+	  dfu_firmware_from_elf, dfu_firmware_to_elf },
+	{ DFU_FIRMWARE_FORMAT_RAW, NULL, 0, 0, NULL, 0,
+	  dfu_firmware_from_raw, dfu_firmware_to_raw },
+};
+
+static gint
+dfu_format_sort_cb (gconstpointer a, gconstpointer b)
+{
+	const DfuFormat *format1 = *((const DfuFormat **) a);
+	const DfuFormat *format2 = *((const DfuFormat **) b);
+	if (format1->priority > format2->priority)
+		return -1;
+	if (format1->priority < format2->priority)
+		return 1;
+	return 0;
+}
+
+static void
+dfu_format_ensure_builtin_locked (void)
+{
+	if (formats != NULL)
+		return;
+	formats = g_ptr_array_new ();
+	for (guint i = 0; i < G_N_ELEMENTS (formats_builtin); i++)
+		g_ptr_array_add (formats, (gpointer) &formats_builtin[i]);
+	g_ptr_array_sort (formats, dfu_format_sort_cb);
+}
+
+/**
+ * dfu_format_register: (skip)
+ * @format: a #DfuFormat, which must remain valid
+ *
+ * Adds a firmware format to the registry. Any existing entry for the same
+ * #DfuFirmwareFormat is replaced.
+ *
+ * Since: 0.7.6
+ **/
+void
+dfu_format_register (const DfuFormat *format)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&formats_mutex);
+	dfu_format_ensure_builtin_locked ();
+	for (guint i = 0; i < formats->len; i++) {
+		const DfuFormat *tmp = g_ptr_array_index (formats, i);
+		if (tmp->format == format->format) {
+			g_ptr_array_remove_index (formats, i);
+			break;
+		}
+	}
+	g_ptr_array_add (formats, (gpointer) format);
+	g_ptr_array_sort (formats, dfu_format_sort_cb);
+}
+
+/**
+ * dfu_format_get_all: (skip)
+ *
+ * Gets all the registered firmware formats.
+ *
+ * Return value: (transfer container) (element-type DfuFormat): formats,
+ * highest priority first
+ *
+ * Since: 0.7.6
+ **/
+GPtrArray *
+dfu_format_get_all (void)
+{
+	GPtrArray *array = g_ptr_array_new ();
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&formats_mutex);
+	dfu_format_ensure_builtin_locked ();
+	for (guint i = 0; i < formats->len; i++)
+		g_ptr_array_add (array, g_ptr_array_index (formats, i));
+	return array;
+}
+
+/**
+ * dfu_format_get_by_kind: (skip)
+ * @format: a #DfuFirmwareFormat, e.g. %DFU_FIRMWARE_FORMAT_DFUSE
+ *
+ * Gets a registered firmware format.
+ *
+ * Return value: a #DfuFormat, or %NULL if not registered
+ *
+ * Since: 0.7.6
+ **/
+const DfuFormat *
+dfu_format_get_by_kind (DfuFirmwareFormat format)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&formats_mutex);
+	dfu_format_ensure_builtin_locked ();
+	for (guint i = 0; i < formats->len; i++) {
+		const DfuFormat *tmp = g_ptr_array_index (formats, i);
+		if (tmp->format == format)
+			return tmp;
+	}
+	return NULL;
+}
+
+/**
+ * dfu_format_detect: (skip)
+ * @bytes: data to parse
+ *
+ * Works out the firmware format in one pass over the registry, highest
+ * priority first. Only the magic at the start of the data and any probe
+ * functions, which typically look at a footer, are used.
+ *
+ * Return value: a #DfuFormat, or %NULL if nothing matched
+ *
+ * Since: 0.7.6
+ **/
+const DfuFormat *
+dfu_format_detect (GBytes *bytes)
+{
+	const guint8 *data;
+	gsize len;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&formats_mutex);
+
+	dfu_format_ensure_builtin_locked ();
+	data = g_bytes_get_data (bytes, &len);
+	for (guint i = 0; i < formats->len; i++) {
+		const DfuFormat *tmp = g_ptr_array_index (formats, i);
+		DfuFirmwareFormat format_probe;
+
+		if (len < tmp->size_min)
+			continue;
+
+		/* magic */
+		if (tmp->magic != NULL) {
+			if (len < tmp->magic_len)
+				continue;
+			if (memcmp (data, tmp->magic, tmp->magic_len) == 0)
+				return tmp;
+			continue;
+		}
+
+		/* probe, which may return a related format */
+		if (tmp->probe != NULL) {
+			format_probe = tmp->probe (bytes);
+			if (format_probe == DFU_FIRMWARE_FORMAT_UNKNOWN)
+				continue;
+			if (format_probe == tmp->format)
+				return tmp;
+			for (guint j = 0; j < formats->len; j++) {
+				const DfuFormat *tmp2 = g_ptr_array_index (formats, j);
+				if (tmp2->format == format_probe)
+					return tmp2;
+			}
+			continue;
+		}
+
+		/* fallback */
+		if (tmp->priority == 0)
+			return tmp;
+	}
+	return NULL;
+}
@@ -0,0 +1,58 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __DFU_FORMAT_H
+#define __DFU_FORMAT_H
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "dfu-firmware.h"
+
+G_BEGIN_DECLS
+
+typedef DfuFirmwareFormat	(*DfuFormatProbeFunc)	(GBytes		*bytes);
+typedef gboolean		(*DfuFormatParseFunc)	(DfuFirmware	*firmware,
+							 GBytes		*bytes,
+							 DfuFirmwareParseFlags flags,
+							 GError		**error);
+typedef GBytes			*(*DfuFormatWriteFunc)	(DfuFirmware	*firmware,
+							 GError		**error);
+
+typedef struct {
+	DfuFirmwareFormat	 format;
+	const gchar		*magic;		/* at the start of the data */
+	gsize			 magic_len;
+	gsize			 size_min;
+	DfuFormatProbeFunc	 probe;		/* e.g. for a footer */
+	guint			 priority;	/* highest is tried first */
+	DfuFormatParseFunc	 parse;
+	DfuFormatWriteFunc	 write;
+} DfuFormat;
+
+void			 dfu_format_register		(const DfuFormat *format);
+GPtrArray		*dfu_format_get_all		(void);
+const DfuFormat		*dfu_format_get_by_kind		(DfuFirmwareFormat format);
+const DfuFormat		*dfu_format_detect		(GBytes		*bytes);
+
+G_END_DECLS
+
+#endif /* __DFU_FORMAT_H */
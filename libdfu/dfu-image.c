@@ -215,6 +215,103 @@ dfu_image_get_size (DfuImage *image)
 	return length;
 }
 
+static gint
+dfu_image_element_sort_cb (gconstpointer a, gconstpointer b)
+{
+	DfuElement *element1 = *((DfuElement **) a);
+	DfuElement *element2 = *((DfuElement **) b);
+	guint32 addr1 = dfu_element_get_address (element1);
+	guint32 addr2 = dfu_element_get_address (element2);
+	if (addr1 < addr2)
+		return -1;
+	if (addr1 > addr2)
+		return 1;
+	return 0;
+}
+
+/**
+ * dfu_image_flatten:
+ * @image: a #DfuImage
+ * @error: a #GError, or %NULL
+ *
+ * Joins all the elements of a sparse image into one contiguous element,
+ * starting at the lowest element address. Any gaps between the elements
+ * are filled with 0x00.
+ *
+ * This should only be used when the consumer cannot handle addresses,
+ * for instance when writing a raw file, as the gaps may be very large.
+ *
+ * Return value: (transfer full): a new #DfuElement, or %NULL for error
+ *
+ * Since: 0.7.6
+ **/
+DfuElement *
+dfu_image_flatten (DfuImage *image, GError **error)
+{
+	DfuImagePrivate *priv = GET_PRIVATE (image);
+	DfuElement *element;
+	guint32 addr_base;
+	guint32 addr_end = 0;
+	g_autoptr(GByteArray) buf = NULL;
+	g_autoptr(GBytes) contents = NULL;
+	g_autoptr(GPtrArray) elements = NULL;
+
+	g_return_val_if_fail (DFU_IS_IMAGE (image), NULL);
+
+	/* nothing to do */
+	if (priv->elements->len == 0) {
+		g_set_error_literal (error,
+				     DFU_ERROR,
+				     DFU_ERROR_NOT_FOUND,
+				     "no image elements");
+		return NULL;
+	}
+	if (priv->elements->len == 1)
+		return g_object_ref (g_ptr_array_index (priv->elements, 0));
+
+	/* work out the total size */
+	elements = g_ptr_array_new ();
+	for (guint i = 0; i < priv->elements->len; i++)
+		g_ptr_array_add (elements, g_ptr_array_index (priv->elements, i));
+	g_ptr_array_sort (elements, dfu_image_element_sort_cb);
+	element = g_ptr_array_index (elements, 0);
+	addr_base = dfu_element_get_address (element);
+	for (guint i = 0; i < elements->len; i++) {
+		GBytes *bytes;
+		guint32 addr;
+		element = g_ptr_array_index (elements, i);
+		bytes = dfu_element_get_contents (element);
+		addr = dfu_element_get_address (element);
+		if (addr < addr_end) {
+			g_set_error (error,
+				     DFU_ERROR,
+				     DFU_ERROR_INVALID_FILE,
+				     "element at 0x%x overlaps previous element ending at 0x%x",
+				     addr, addr_end);
+			return NULL;
+		}
+		addr_end = addr + (guint32) g_bytes_get_size (bytes);
+	}
+
+	/* copy each element into place */
+	buf = g_byte_array_sized_new (addr_end - addr_base);
+	g_byte_array_set_size (buf, addr_end - addr_base);
+	memset (buf->data, 0x00, buf->len);
+	for (guint i = 0; i < elements->len; i++) {
+		GBytes *bytes;
+		element = g_ptr_array_index (elements, i);
+		bytes = dfu_element_get_contents (element);
+		memcpy (buf->data + dfu_element_get_address (element) - addr_base,
+			g_bytes_get_data (bytes, NULL),
+			g_bytes_get_size (bytes));
+	}
+	contents = g_byte_array_free_to_bytes (g_steal_pointer (&buf));
+	element = dfu_element_new ();
+	dfu_element_set_address (element, addr_base);
+	dfu_element_set_contents (element, contents);
+	return element;
+}
+
 /**
  * dfu_image_add_element:
  * @image: a #DfuImage
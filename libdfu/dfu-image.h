@@ -57,6 +57,8 @@ DfuElement	*dfu_image_get_element_default	(DfuImage	*image);
 guint8		 dfu_image_get_alt_setting	(DfuImage	*image);
 const gchar	*dfu_image_get_name		(DfuImage	*image);
 guint32		 dfu_image_get_size		(DfuImage	*image);
+DfuElement	*dfu_image_flatten		(DfuImage	*image,
+						 GError		**error);
 
 void		 dfu_image_add_element		(DfuImage	*image,
 						 DfuElement	*element);
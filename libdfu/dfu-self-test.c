@@ -26,11 +26,14 @@
 #include <string.h>
 #include <fnmatch.h>
 
+#include "dfu-cipher-xtea.h"
 #include "dfu-common.h"
 #include "dfu-context.h"
+#include "dfu-crc32.h"
 #include "dfu-device.h"
 #include "dfu-error.h"
 #include "dfu-firmware.h"
+#include "dfu-format.h"
 #include "dfu-sector-private.h"
 #include "dfu-target-private.h"
 
@@ -103,6 +106,98 @@ _g_bytes_compare_verbose (GBytes *bytes1, GBytes *bytes2)
 	return NULL;
 }
 
+static guint32
+dfu_test_crc32_bitwise (guint32 crc, const guint8 *data, gsize length)
+{
+	for (gsize i = 0; i < length; i++) {
+		crc ^= data[i];
+		for (guint j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+	}
+	return crc;
+}
+
+static void
+dfu_cipher_xtea_func (void)
+{
+	const gchar *key = "0123456789abcdef0123456789abcdef";
+	guint8 buf[203];
+	guint8 buf_chunked[sizeof(buf)];
+	guint8 buf_orig[sizeof(buf)];
+	g_autoptr(DfuCipherXtea) ctx = NULL;
+	g_autoptr(GError) error = NULL;
+
+	for (guint i = 0; i < sizeof(buf); i++)
+		buf_orig[i] = (guint8) (i * 7);
+	memcpy (buf, buf_orig, sizeof(buf));
+	memcpy (buf_chunked, buf_orig, sizeof(buf));
+
+	/* whole buffer, leaving the partial block alone */
+	g_assert (dfu_cipher_encrypt_xtea (key, buf, sizeof(buf), &error));
+	g_assert_no_error (error);
+	g_assert (memcmp (buf, buf_orig, 8) != 0);
+	g_assert (memcmp (buf + 200, buf_orig + 200, 3) == 0);
+
+	/* the same in chunks */
+	ctx = dfu_cipher_xtea_new (key, &error);
+	g_assert_no_error (error);
+	g_assert (ctx != NULL);
+	dfu_cipher_xtea_encrypt (ctx, buf_chunked, 64);
+	dfu_cipher_xtea_encrypt (ctx, buf_chunked + 64, 8);
+	dfu_cipher_xtea_encrypt (ctx, buf_chunked + 72, sizeof(buf) - 72);
+	g_assert (memcmp (buf, buf_chunked, sizeof(buf)) == 0);
+
+	/* round trip */
+	dfu_cipher_xtea_decrypt (ctx, buf, sizeof(buf));
+	g_assert (memcmp (buf, buf_orig, sizeof(buf)) == 0);
+
+	/* invalid key */
+	g_assert (dfu_cipher_xtea_new ("0123456789abcdef0123456789abcdef0", NULL) == NULL);
+}
+
+static void
+dfu_crc32_func (void)
+{
+	guint8 buf[1024];
+	guint32 crc;
+
+	/* check value for CRC-32, without the final inversion */
+	crc = dfu_crc32_update (0xffffffff, (const guint8 *) "123456789", 9);
+	g_assert_cmpint (crc, ==, 0x340bc6d9);
+
+	/* every alignment and tail length */
+	for (guint i = 0; i < sizeof(buf); i++)
+		buf[i] = (guint8) g_test_rand_int ();
+	for (guint offset = 0; offset < 8; offset++) {
+		for (guint length = 0; length < 64; length++) {
+			g_assert_cmpint (dfu_crc32_update (0xffffffff, buf + offset, length), ==,
+					 dfu_test_crc32_bitwise (0xffffffff, buf + offset, length));
+		}
+	}
+
+	/* can be done in parts */
+	crc = dfu_crc32_update (0xffffffff, buf, 100);
+	crc = dfu_crc32_update (crc, buf + 100, sizeof(buf) - 100);
+	g_assert_cmpint (crc, ==, dfu_test_crc32_bitwise (0xffffffff, buf, sizeof(buf)));
+
+	/* only with -m perf */
+	if (g_test_perf ()) {
+		const gsize size = 16 * 1024 * 1024;
+		gdouble elapsed;
+		g_autofree guint8 *data = g_malloc0 (size);
+		g_test_timer_start ();
+		crc = dfu_crc32_update (0xffffffff, data, size);
+		elapsed = g_test_timer_elapsed ();
+		g_test_minimized_result (elapsed, "CRC32 of 16MiB: %.1f MiB/s (%08x)",
+					 16.f / elapsed, crc);
+		g_test_timer_start ();
+		crc = dfu_test_crc32_bitwise (0xffffffff, data, size);
+		elapsed = g_test_timer_elapsed ();
+		g_test_minimized_result (elapsed, "bitwise CRC32 of 16MiB: %.1f MiB/s (%08x)",
+					 16.f / elapsed, crc);
+	}
+}
+
 static void
 dfu_firmware_xdfu_func (void)
 {
@@ -144,6 +239,50 @@ dfu_self_test_get_bytes_for_file (GFile *file, GError **error)
 	return g_bytes_new_take (contents, length);
 }
 
+static void
+dfu_format_detect_func (void)
+{
+	const DfuFormat *format;
+	const guint8 elf[16] = { 0x7f, 'E', 'L', 'F', 0x01 };
+	const gchar *ihex = ":0100000000FF\n:00000001FF\n";
+	guint8 dfu[32] = { 0x00 };
+	g_autoptr(GBytes) bytes_dfu = NULL;
+	g_autoptr(GBytes) bytes_elf = NULL;
+	g_autoptr(GBytes) bytes_ihex = NULL;
+	g_autoptr(GBytes) bytes_raw = NULL;
+	g_autoptr(GPtrArray) formats = NULL;
+
+	/* highest priority first */
+	formats = dfu_format_get_all ();
+	g_assert_cmpint (formats->len, >=, 5);
+	format = g_ptr_array_index (formats, 0);
+	g_assert_cmpint (format->format, ==, DFU_FIRMWARE_FORMAT_INTEL_HEX);
+
+	/* magic */
+	bytes_ihex = g_bytes_new_static (ihex, strlen (ihex));
+	format = dfu_format_detect (bytes_ihex);
+	g_assert (format != NULL);
+	g_assert_cmpint (format->format, ==, DFU_FIRMWARE_FORMAT_INTEL_HEX);
+	bytes_elf = g_bytes_new_static (elf, sizeof (elf));
+	format = dfu_format_detect (bytes_elf);
+	g_assert (format != NULL);
+	g_assert_cmpint (format->format, ==, DFU_FIRMWARE_FORMAT_ELF);
+
+	/* footer, which can promote to DfuSe */
+	memcpy (dfu + sizeof(dfu) - 10, "\x1a\x01UFD", 5);
+	bytes_dfu = g_bytes_new_static (dfu, sizeof (dfu));
+	format = dfu_format_detect (bytes_dfu);
+	g_assert (format != NULL);
+	g_assert_cmpint (format->format, ==, DFU_FIRMWARE_FORMAT_DFUSE);
+
+	/* fallback */
+	bytes_raw = g_bytes_new_static (dfu, 8);
+	format = dfu_format_detect (bytes_raw);
+	g_assert (format != NULL);
+	g_assert_cmpint (format->format, ==, DFU_FIRMWARE_FORMAT_RAW);
+	g_assert (dfu_format_get_by_kind (DFU_FIRMWARE_FORMAT_DFUSE) != NULL);
+}
+
 static void
 dfu_firmware_raw_func (void)
 {
@@ -473,6 +612,55 @@ dfu_firmware_intel_hex_func (void)
 	g_assert_cmpstr (_g_bytes_compare_verbose (data_bin, data_bin2), ==, NULL);
 }
 
+static void
+dfu_firmware_intel_hex_sparse_func (void)
+{
+	DfuElement *element;
+	DfuImage *image;
+	const guint8 *data;
+	gboolean ret;
+	gsize len;
+	const gchar *hex =
+		":020000040800F2\n"
+		":0400000001020304F2\n"
+		":02F80000AABBA1\n"
+		":00000001FF\n";
+	g_autoptr(DfuFirmware) firmware = NULL;
+	g_autoptr(GBytes) data_bin = NULL;
+	g_autoptr(GBytes) data_hex = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* widely separated regions are not joined */
+	data_hex = g_bytes_new_static (hex, strlen (hex));
+	firmware = dfu_firmware_new ();
+	ret = dfu_firmware_parse_data (firmware, data_hex,
+				       DFU_FIRMWARE_PARSE_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (dfu_firmware_get_size (firmware), ==, 6);
+	image = dfu_firmware_get_image_default (firmware);
+	g_assert (image != NULL);
+	g_assert_cmpint (dfu_image_get_elements (image)->len, ==, 2);
+	element = dfu_image_get_element (image, 0);
+	g_assert_cmpint (dfu_element_get_address (element), ==, 0x08000000);
+	g_assert_cmpint (g_bytes_get_size (dfu_element_get_contents (element)), ==, 4);
+	element = dfu_image_get_element (image, 1);
+	g_assert_cmpint (dfu_element_get_address (element), ==, 0x0800f800);
+	g_assert_cmpint (g_bytes_get_size (dfu_element_get_contents (element)), ==, 2);
+
+	/* raw files have the gap filled */
+	dfu_firmware_set_format (firmware, DFU_FIRMWARE_FORMAT_RAW);
+	data_bin = dfu_firmware_write_data (firmware, &error);
+	g_assert_no_error (error);
+	g_assert (data_bin != NULL);
+	data = g_bytes_get_data (data_bin, &len);
+	g_assert_cmpint (len, ==, 0xf802);
+	g_assert_cmpint (data[3], ==, 0x04);
+	g_assert_cmpint (data[4], ==, 0x00);
+	g_assert_cmpint (data[0xf800], ==, 0xaa);
+	g_assert_cmpint (data[0xf801], ==, 0xbb);
+}
+
 static void
 dfu_device_func (void)
 {
@@ -775,13 +963,17 @@ main (int argc, char **argv)
 
 	/* tests go here */
 	g_test_add_func ("/libdfu/enums", dfu_enums_func);
+	g_test_add_func ("/libdfu/crc32", dfu_crc32_func);
+	g_test_add_func ("/libdfu/cipher{xtea}", dfu_cipher_xtea_func);
 	g_test_add_func ("/libdfu/target(DfuSe}", dfu_target_dfuse_func);
+	g_test_add_func ("/libdfu/format{detect}", dfu_format_detect_func);
 	g_test_add_func ("/libdfu/firmware{raw}", dfu_firmware_raw_func);
 	g_test_add_func ("/libdfu/firmware{dfu}", dfu_firmware_dfu_func);
 	g_test_add_func ("/libdfu/firmware{dfuse}", dfu_firmware_dfuse_func);
 	g_test_add_func ("/libdfu/firmware{xdfu}", dfu_firmware_xdfu_func);
 	g_test_add_func ("/libdfu/firmware{metadata}", dfu_firmware_metadata_func);
 	g_test_add_func ("/libdfu/firmware{intel-hex}", dfu_firmware_intel_hex_func);
+	g_test_add_func ("/libdfu/firmware{intel-hex-sparse}", dfu_firmware_intel_hex_sparse_func);
 	g_test_add_func ("/libdfu/firmware{elf}", dfu_firmware_elf_func);
 	g_test_add_func ("/libdfu/device", dfu_device_func);
 	g_test_add_func ("/libdfu/colorhug+", dfu_colorhug_plus_func);
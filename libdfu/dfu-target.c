@@ -693,8 +693,9 @@ dfu_target_download_chunk (DfuTarget *target, guint8 index, GBytes *bytes,
 	if (!dfu_device_refresh (priv->device, cancellable, error))
 		return FALSE;
 
-	/* give the target a chance to update */
-	g_usleep (dfu_device_get_download_timeout (priv->device) * 1000);
+	/* give the target a chance to update, using bwPollTimeout */
+	if (dfu_device_get_state (priv->device) == DFU_STATE_DFU_DNBUSY)
+		g_usleep (dfu_device_get_download_timeout (priv->device) * 1000);
 
 	g_assert (actual_length == g_bytes_get_size (bytes));
 	return TRUE;
@@ -892,17 +893,18 @@ dfu_target_read_unprotect (DfuTarget *target,
 
 #endif
 
-GBytes *
-dfu_target_upload_chunk (DfuTarget *target, guint8 index,
-			 GCancellable *cancellable, GError **error)
+static gboolean
+dfu_target_upload_chunk_into (DfuTarget *target,
+			      guint8 index,
+			      guint8 *buf,
+			      gsize buf_sz,
+			      gsize *actual_length,
+			      GCancellable *cancellable,
+			      GError **error)
 {
 	DfuTargetPrivate *priv = GET_PRIVATE (target);
 	g_autoptr(GError) error_local = NULL;
-	guint8 *buf;
-	gsize actual_length;
-	guint16 transfer_size = dfu_device_get_transfer_size (priv->device);
 
-	buf = g_new0 (guint8, transfer_size);
 	if (!g_usb_device_control_transfer (dfu_device_get_usb_dev (priv->device),
 					    G_USB_DEVICE_DIRECTION_DEVICE_TO_HOST,
 					    G_USB_DEVICE_REQUEST_TYPE_CLASS,
@@ -910,8 +912,8 @@ dfu_target_upload_chunk (DfuTarget *target, guint8 index,
 					    DFU_REQUEST_UPLOAD,
 					    index,
 					    dfu_device_get_interface (priv->device),
-					    buf, (gsize) transfer_size,
-					    &actual_length,
+					    buf, buf_sz,
+					    actual_length,
 					    dfu_device_get_timeout (priv->device),
 					    cancellable,
 					    &error_local)) {
@@ -922,12 +924,69 @@ dfu_target_upload_chunk (DfuTarget *target, guint8 index,
 			     DFU_ERROR_NOT_SUPPORTED,
 			     "cannot upload data: %s",
 			     error_local->message);
-		return NULL;
+		return FALSE;
 	}
+	return TRUE;
+}
 
+GBytes *
+dfu_target_upload_chunk (DfuTarget *target, guint8 index,
+			 GCancellable *cancellable, GError **error)
+{
+	DfuTargetPrivate *priv = GET_PRIVATE (target);
+	guint8 *buf;
+	gsize actual_length = 0;
+	guint16 transfer_size = dfu_device_get_transfer_size (priv->device);
+
+	buf = g_new0 (guint8, transfer_size);
+	if (!dfu_target_upload_chunk_into (target, index,
+					   buf, (gsize) transfer_size,
+					   &actual_length,
+					   cancellable, error)) {
+		g_free (buf);
+		return NULL;
+	}
 	return g_bytes_new_take (buf, actual_length);
 }
 
+/* preallocate enough for the whole element plus one chunk of overrun
+ * so that reading the data does not need to reallocate */
+static GByteArray *
+dfu_target_upload_buffer_new (DfuTarget *target,
+			      gsize expected_size,
+			      gsize maximum_size)
+{
+	DfuTargetPrivate *priv = GET_PRIVATE (target);
+	gsize reserved_size = expected_size > 0 ? expected_size : maximum_size;
+	reserved_size += dfu_device_get_transfer_size (priv->device);
+	return g_byte_array_sized_new ((guint) reserved_size);
+}
+
+/* reads the next chunk directly onto the end of @buf, which is grown
+ * geometrically by GByteArray if the initial size was too small */
+static gboolean
+dfu_target_upload_chunk_append (DfuTarget *target,
+				guint8 index,
+				GByteArray *buf,
+				gsize *chunk_size,
+				GCancellable *cancellable,
+				GError **error)
+{
+	DfuTargetPrivate *priv = GET_PRIVATE (target);
+	guint offset = buf->len;
+	guint16 transfer_size = dfu_device_get_transfer_size (priv->device);
+
+	g_byte_array_set_size (buf, offset + transfer_size);
+	if (!dfu_target_upload_chunk_into (target, index,
+					   buf->data + offset,
+					   (gsize) transfer_size,
+					   chunk_size,
+					   cancellable, error))
+		return FALSE;
+	g_byte_array_set_size (buf, offset + (guint) *chunk_size);
+	return TRUE;
+}
+
 static void
 dfu_target_set_action (DfuTarget *target, DfuAction action)
 {
@@ -975,35 +1034,6 @@ dfu_target_set_percentage (DfuTarget *target, guint value, guint total)
 	dfu_target_set_percentage_raw (target, percentage);
 }
 
-static GBytes *
-_g_bytes_array_join (GPtrArray *chunks)
-{
-	gsize total_size = 0;
-	guint32 offset = 0;
-	guint8 *buffer;
-	guint i;
-
-	/* get the size of all the chunks */
-	for (i = 0; i < chunks->len; i++) {
-		GBytes *chunk_tmp = g_ptr_array_index (chunks, i);
-		total_size += g_bytes_get_size (chunk_tmp);
-	}
-
-	/* copy them into a buffer */
-	buffer = g_malloc0 (total_size);
-	for (i = 0; i < chunks->len; i++) {
-		const guint8 *chunk_data;
-		gsize chunk_size = 0;
-		GBytes *chunk_tmp = g_ptr_array_index (chunks, i);
-		chunk_data = g_bytes_get_data (chunk_tmp, &chunk_size);
-		if (chunk_size == 0)
-			continue;
-		memcpy (buffer + offset, chunk_data, chunk_size);
-		offset += chunk_size;
-	}
-	return g_bytes_new_take (buffer, total_size);
-}
-
 static DfuElement *
 dfu_target_upload_element_dfuse (DfuTarget *target,
 				 guint32 address,
@@ -1015,15 +1045,13 @@ dfu_target_upload_element_dfuse (DfuTarget *target,
 	DfuTargetPrivate *priv = GET_PRIVATE (target);
 	DfuSector *sector;
 	DfuElement *element = NULL;
-	GBytes *chunk_tmp;
 	guint32 offset = address;
 	guint percentage_size = expected_size > 0 ? expected_size : maximum_size;
 	gsize total_size = 0;
 	guint16 transfer_size = dfu_device_get_transfer_size (priv->device);
 	guint idx;
+	g_autoptr(GByteArray) buf = NULL;
 	g_autoptr(GBytes) contents = NULL;
-	g_autoptr(GBytes) contents_truncated = NULL;
-	g_autoptr(GPtrArray) chunks = NULL;
 
 	/* for DfuSe devices we need to handle the address manually */
 	sector = dfu_target_get_sector_for_addr (target, offset);
@@ -1063,24 +1091,23 @@ dfu_target_upload_element_dfuse (DfuTarget *target,
 		return NULL;
 
 	/* get all the chunks from the hardware */
-	chunks = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+	buf = dfu_target_upload_buffer_new (target, expected_size, maximum_size);
 	for (idx = 0; idx < G_MAXUINT16; idx++) {
-		guint32 chunk_size;
+		gsize chunk_size = 0;
 
 		/* read chunk of data -- ST uses wBlockNum=0 for DfuSe commands
 		 * and wBlockNum=1 is reserved */
-		chunk_tmp = dfu_target_upload_chunk (target,
+		if (!dfu_target_upload_chunk_append (target,
 						     (guint8) (idx + 2),
+						     buf,
+						     &chunk_size,
 						     cancellable,
-						     error);
-		if (chunk_tmp == NULL)
+						     error))
 			return NULL;
 
-		/* add to array */
-		chunk_size = (guint32) g_bytes_get_size (chunk_tmp);
-		g_debug ("got #%04x chunk @0x%x of size %" G_GUINT32_FORMAT,
+		/* keep a sum of all the chunks */
+		g_debug ("got #%04x chunk @0x%x of size %" G_GSIZE_FORMAT,
 			 idx, offset, chunk_size);
-		g_ptr_array_add (chunks, chunk_tmp);
 		total_size += chunk_size;
 		offset += chunk_size;
 
@@ -1120,14 +1147,12 @@ dfu_target_upload_element_dfuse (DfuTarget *target,
 	dfu_target_set_percentage_raw (target, 100);
 	dfu_target_set_action (target, DFU_ACTION_IDLE);
 
-	/* create new image */
-	contents = _g_bytes_array_join (chunks);
+	/* create new image, dropping any data we read past the end */
 	if (expected_size > 0)
-		contents_truncated = g_bytes_new_from_bytes (contents, 0, expected_size);
-	else
-		contents_truncated = g_bytes_ref (contents);
+		g_byte_array_set_size (buf, (guint) expected_size);
+	contents = g_byte_array_free_to_bytes (g_steal_pointer (&buf));
 	element = dfu_element_new ();
-	dfu_element_set_contents (element, contents_truncated);
+	dfu_element_set_contents (element, contents);
 	dfu_element_set_address (element, address);
 	return element;
 }
@@ -1142,40 +1167,34 @@ dfu_target_upload_element_dfu (DfuTarget *target,
 {
 	DfuTargetPrivate *priv = GET_PRIVATE (target);
 	DfuElement *element = NULL;
-	GBytes *chunk_tmp;
-	guint32 offset = 0;
 	guint percentage_size = expected_size > 0 ? expected_size : maximum_size;
 	gsize total_size = 0;
 	guint16 transfer_size = dfu_device_get_transfer_size (priv->device);
 	guint idx;
+	g_autoptr(GByteArray) buf = NULL;
 	g_autoptr(GBytes) contents = NULL;
-	g_autoptr(GPtrArray) chunks = NULL;
 
 	/* update UI */
 	dfu_target_set_action (target, DFU_ACTION_READ);
 
 	/* get all the chunks from the hardware */
-	chunks = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+	buf = dfu_target_upload_buffer_new (target, expected_size, maximum_size);
 	for (idx = 0; idx < G_MAXUINT16; idx++) {
-		guint32 chunk_size;
+		gsize chunk_size = 0;
 
 		/* read chunk of data */
-		chunk_tmp = dfu_target_upload_chunk (target,
+		if (!dfu_target_upload_chunk_append (target,
 						     (guint8) idx,
+						     buf,
+						     &chunk_size,
 						     cancellable,
-						     error);
-		if (chunk_tmp == NULL)
+						     error))
 			return NULL;
 
 		/* keep a sum of all the chunks */
-		chunk_size = (guint32) g_bytes_get_size (chunk_tmp);
 		total_size += chunk_size;
-		offset += chunk_size;
-
-		/* add to array */
-		g_debug ("got #%04x chunk of size %" G_GUINT32_FORMAT,
+		g_debug ("got #%04x chunk of size %" G_GSIZE_FORMAT,
 			 idx, chunk_size);
-		g_ptr_array_add (chunks, chunk_tmp);
 
 		/* update UI */
 		if (chunk_size > 0)
@@ -1204,7 +1223,7 @@ dfu_target_upload_element_dfu (DfuTarget *target,
 	dfu_target_set_action (target, DFU_ACTION_IDLE);
 
 	/* create new image */
-	contents = _g_bytes_array_join (chunks);
+	contents = g_byte_array_free_to_bytes (g_steal_pointer (&buf));
 	element = dfu_element_new ();
 	dfu_element_set_contents (element, contents);
 	return element;
@@ -1392,6 +1411,211 @@ _g_bytes_compare_verbose (GBytes *bytes1, GBytes *bytes2)
 	return NULL;
 }
 
+typedef struct {
+	DfuTarget	*target;
+	GBytes		*bytes;
+	GBytes		*chunk;			/* in flight */
+	GCancellable	*cancellable;
+	GMainContext	*context;
+	GMainLoop	*loop;
+	GError		*error;
+	guint8		 status[6];
+	guint		 idx;
+	guint		 nr_chunks;
+	guint16		 transfer_size;
+} DfuTargetDownloadHelper;
+
+static void dfu_target_download_helper_write (DfuTargetDownloadHelper *helper);
+static void dfu_target_download_helper_get_status (DfuTargetDownloadHelper *helper);
+
+static void
+dfu_target_download_helper_done (DfuTargetDownloadHelper *helper, GError *error)
+{
+	if (error != NULL)
+		g_propagate_error (&helper->error, error);
+	g_main_loop_quit (helper->loop);
+}
+
+static gboolean
+dfu_target_download_helper_poll_cb (gpointer user_data)
+{
+	DfuTargetDownloadHelper *helper = (DfuTargetDownloadHelper *) user_data;
+	GError *error = NULL;
+
+	if (g_cancellable_set_error_if_cancelled (helper->cancellable, &error)) {
+		dfu_target_download_helper_done (helper, error);
+		return FALSE;
+	}
+	dfu_target_download_helper_get_status (helper);
+	return FALSE;
+}
+
+static void
+dfu_target_download_helper_status_cb (GObject *source,
+				      GAsyncResult *res,
+				      gpointer user_data)
+{
+	DfuTargetDownloadHelper *helper = (DfuTargetDownloadHelper *) user_data;
+	DfuTargetPrivate *priv = GET_PRIVATE (helper->target);
+	GError *error = NULL;
+	gssize actual_length;
+
+	actual_length = g_usb_device_control_transfer_finish (G_USB_DEVICE (source),
+							      res, &error);
+	if (actual_length < 0) {
+		GError *error_tmp = NULL;
+		g_set_error (&error_tmp,
+			     DFU_ERROR,
+			     DFU_ERROR_NOT_SUPPORTED,
+			     "cannot get device state: %s",
+			     error->message);
+		g_error_free (error);
+		dfu_target_download_helper_done (helper, error_tmp);
+		return;
+	}
+	if (!dfu_device_refresh_from_data (priv->device,
+					   helper->status,
+					   (gsize) actual_length,
+					   &error)) {
+		dfu_target_download_helper_done (helper, error);
+		return;
+	}
+
+	/* still busy, so wait for bwPollTimeout before asking again */
+	switch (dfu_device_get_state (priv->device)) {
+	case DFU_STATE_DFU_DNBUSY:
+	{
+		GSource *source_poll;
+		source_poll = g_timeout_source_new (dfu_device_get_download_timeout (priv->device));
+		g_source_set_callback (source_poll,
+				       dfu_target_download_helper_poll_cb,
+				       helper, NULL);
+		g_source_attach (source_poll, helper->context);
+		g_source_unref (source_poll);
+		return;
+	}
+	case DFU_STATE_DFU_ERROR:
+		g_set_error_literal (&error,
+				     DFU_ERROR,
+				     DFU_ERROR_NOT_SUPPORTED,
+				     dfu_target_status_to_error_msg (dfu_device_get_status (priv->device)));
+		dfu_target_download_helper_done (helper, error);
+		return;
+	default:
+		break;
+	}
+
+	/* update UI */
+	dfu_target_set_percentage (helper->target,
+				   helper->idx * helper->transfer_size,
+				   g_bytes_get_size (helper->bytes));
+
+	/* the chunk has been accepted, so send the next one straight away */
+	helper->idx++;
+	dfu_target_download_helper_write (helper);
+}
+
+static void
+dfu_target_download_helper_get_status (DfuTargetDownloadHelper *helper)
+{
+	DfuTargetPrivate *priv = GET_PRIVATE (helper->target);
+	g_usb_device_control_transfer_async (dfu_device_get_usb_dev (priv->device),
+					     G_USB_DEVICE_DIRECTION_DEVICE_TO_HOST,
+					     G_USB_DEVICE_REQUEST_TYPE_CLASS,
+					     G_USB_DEVICE_RECIPIENT_INTERFACE,
+					     DFU_REQUEST_GETSTATUS,
+					     0,
+					     dfu_device_get_interface (priv->device),
+					     helper->status,
+					     sizeof(helper->status),
+					     dfu_device_get_timeout (priv->device),
+					     helper->cancellable,
+					     dfu_target_download_helper_status_cb,
+					     helper);
+}
+
+static void
+dfu_target_download_helper_write_cb (GObject *source,
+				     GAsyncResult *res,
+				     gpointer user_data)
+{
+	DfuTargetDownloadHelper *helper = (DfuTargetDownloadHelper *) user_data;
+	DfuTargetPrivate *priv = GET_PRIVATE (helper->target);
+	GError *error = NULL;
+	GError *error_tmp = NULL;
+	gssize actual_length;
+
+	actual_length = g_usb_device_control_transfer_finish (G_USB_DEVICE (source),
+							      res, &error);
+	if (actual_length < 0) {
+		/* refresh the error code */
+		dfu_device_error_fixup (priv->device, helper->cancellable, &error);
+		g_set_error (&error_tmp,
+			     DFU_ERROR,
+			     DFU_ERROR_NOT_SUPPORTED,
+			     "cannot download data: %s",
+			     error->message);
+		g_error_free (error);
+		dfu_target_download_helper_done (helper, error_tmp);
+		return;
+	}
+	if ((gsize) actual_length != g_bytes_get_size (helper->chunk)) {
+		g_set_error (&error_tmp,
+			     DFU_ERROR,
+			     DFU_ERROR_INTERNAL,
+			     "only wrote %" G_GSSIZE_FORMAT " of %" G_GSIZE_FORMAT,
+			     actual_length,
+			     g_bytes_get_size (helper->chunk));
+		dfu_target_download_helper_done (helper, error_tmp);
+		return;
+	}
+
+	/* the action only occurs when we do GetStatus */
+	dfu_target_download_helper_get_status (helper);
+}
+
+static void
+dfu_target_download_helper_write (DfuTargetDownloadHelper *helper)
+{
+	DfuTargetPrivate *priv = GET_PRIVATE (helper->target);
+	gsize length;
+	guint32 offset;
+
+	/* we wrote the final zero-sized chunk for EOF */
+	if (helper->idx > helper->nr_chunks) {
+		dfu_target_download_helper_done (helper, NULL);
+		return;
+	}
+
+	/* caclulate the offset into the element data */
+	offset = helper->idx * helper->transfer_size;
+	if (helper->chunk != NULL)
+		g_bytes_unref (helper->chunk);
+	if (helper->idx < helper->nr_chunks) {
+		length = g_bytes_get_size (helper->bytes) - offset;
+		if (length > helper->transfer_size)
+			length = helper->transfer_size;
+		helper->chunk = g_bytes_new_from_bytes (helper->bytes, offset, length);
+	} else {
+		helper->chunk = g_bytes_new (NULL, 0);
+	}
+	g_debug ("writing #%04x chunk of size %" G_GSIZE_FORMAT,
+		 helper->idx, g_bytes_get_size (helper->chunk));
+	g_usb_device_control_transfer_async (dfu_device_get_usb_dev (priv->device),
+					     G_USB_DEVICE_DIRECTION_HOST_TO_DEVICE,
+					     G_USB_DEVICE_REQUEST_TYPE_CLASS,
+					     G_USB_DEVICE_RECIPIENT_INTERFACE,
+					     DFU_REQUEST_DNLOAD,
+					     (guint8) helper->idx,
+					     dfu_device_get_interface (priv->device),
+					     (guint8 *) g_bytes_get_data (helper->chunk, NULL),
+					     g_bytes_get_size (helper->chunk),
+					     dfu_device_get_timeout (priv->device),
+					     helper->cancellable,
+					     dfu_target_download_helper_write_cb,
+					     helper);
+}
+
 static gboolean
 dfu_target_download_element_dfu (DfuTarget *target,
 				 DfuElement *element,
@@ -1400,11 +1624,10 @@ dfu_target_download_element_dfu (DfuTarget *target,
 				 GError **error)
 {
 	DfuTargetPrivate *priv = GET_PRIVATE (target);
+	DfuTargetDownloadHelper helper;
 	GBytes *bytes;
-	guint i;
 	guint nr_chunks;
 	guint16 transfer_size = dfu_device_get_transfer_size (priv->device);
-	g_autoptr(GError) error_local = NULL;
 
 	/* round up as we have to transfer incomplete blocks */
 	bytes = dfu_element_get_contents (element);
@@ -1417,35 +1640,32 @@ dfu_target_download_element_dfu (DfuTarget *target,
 				     "zero-length firmware");
 		return FALSE;
 	}
-	dfu_target_set_action (target, DFU_ACTION_WRITE);
-	for (i = 0; i < nr_chunks + 1; i++) {
-		gsize length;
-		guint32 offset;
-		g_autoptr(GBytes) bytes_tmp = NULL;
-
-		/* caclulate the offset into the element data */
-		offset = i * transfer_size;
 
-		/* we have to write one final zero-sized chunk for EOF */
-		if (i < nr_chunks) {
-			length = g_bytes_get_size (bytes) - offset;
-			if (length > transfer_size)
-				length = transfer_size;
-			bytes_tmp = g_bytes_new_from_bytes (bytes, offset, length);
-		} else {
-			bytes_tmp = g_bytes_new (NULL, 0);
-		}
-		g_debug ("writing #%04x chunk of size %" G_GSIZE_FORMAT,
-			 i, g_bytes_get_size (bytes_tmp));
-		if (!dfu_target_download_chunk (target,
-						(guint8) i,
-						bytes_tmp,
-						cancellable,
-						error))
-			return FALSE;
-
-		/* update UI */
-		dfu_target_set_percentage (target, offset, g_bytes_get_size (bytes));
+	/* the DNLOAD, GETSTATUS and bwPollTimeout cycle for each chunk is
+	 * driven from the transfer completions rather than blocking, so
+	 * the next chunk is sent as soon as the device reports it is no
+	 * longer busy; the private context stops other sources from being
+	 * dispatched while the transfer is in progress */
+	memset (&helper, 0, sizeof(helper));
+	helper.target = target;
+	helper.bytes = bytes;
+	helper.cancellable = cancellable;
+	helper.nr_chunks = nr_chunks;
+	helper.transfer_size = transfer_size;
+	helper.context = g_main_context_new ();
+	helper.loop = g_main_loop_new (helper.context, FALSE);
+	dfu_target_set_action (target, DFU_ACTION_WRITE);
+	g_main_context_push_thread_default (helper.context);
+	dfu_target_download_helper_write (&helper);
+	g_main_loop_run (helper.loop);
+	g_main_context_pop_thread_default (helper.context);
+	g_main_loop_unref (helper.loop);
+	g_main_context_unref (helper.context);
+	if (helper.chunk != NULL)
+		g_bytes_unref (helper.chunk);
+	if (helper.error != NULL) {
+		g_propagate_error (error, helper.error);
+		return FALSE;
 	}
 
 	/* done */
@@ -1456,6 +1676,103 @@ dfu_target_download_element_dfu (DfuTarget *target,
 	return TRUE;
 }
 
+static gboolean
+dfu_target_sector_is_unchanged (DfuTarget *target,
+				DfuSector *sector,
+				DfuElement *element,
+				gboolean *unchanged,
+				GCancellable *cancellable,
+				GError **error)
+{
+	GBytes *bytes = dfu_element_get_contents (element);
+	guint32 addr_start;
+	guint32 addr_end;
+	guint32 element_start = dfu_element_get_address (element);
+	g_autoptr(DfuElement) element_dev = NULL;
+	g_autoptr(GBytes) bytes_new = NULL;
+
+	/* we cannot tell, so assume it needs writing */
+	*unchanged = FALSE;
+	if (!dfu_sector_has_cap (sector, DFU_SECTOR_CAP_READABLE))
+		return TRUE;
+
+	/* only the part of the sector covered by the element matters */
+	addr_start = MAX (dfu_sector_get_address (sector), element_start);
+	addr_end = MIN (dfu_sector_get_address (sector) + dfu_sector_get_size (sector),
+			element_start + (guint32) g_bytes_get_size (bytes));
+	if (addr_end <= addr_start)
+		return TRUE;
+
+	/* read back what is currently on the device */
+	element_dev = dfu_target_upload_element_dfuse (target,
+						       addr_start,
+						       addr_end - addr_start,
+						       addr_end - addr_start,
+						       cancellable,
+						       error);
+	if (element_dev == NULL)
+		return FALSE;
+	bytes_new = g_bytes_new_from_bytes (bytes,
+					    addr_start - element_start,
+					    addr_end - addr_start);
+	*unchanged = g_bytes_equal (bytes_new, dfu_element_get_contents (element_dev));
+	return TRUE;
+}
+
+/* writes a chunk at an explicit address, restarting the block number */
+static gboolean
+dfu_target_download_chunk_at_address (DfuTarget *target,
+				      guint32 address,
+				      GBytes *bytes,
+				      GCancellable *cancellable,
+				      GError **error)
+{
+	g_debug ("writing 0x%" G_GSIZE_FORMAT " bytes at 0x%04x",
+		 g_bytes_get_size (bytes), (guint) address);
+	if (!dfu_target_set_address (target, address, cancellable, error))
+		return FALSE;
+	if (!dfu_target_download_chunk (target, 2, bytes, cancellable, error))
+		return FALSE;
+	return dfu_target_check_status (target, cancellable, error);
+}
+
+/* only writes the parts of a chunk that are in sectors that were erased */
+static gboolean
+dfu_target_download_chunk_clipped (DfuTarget *target,
+				   GHashTable *sectors_unchanged,
+				   guint32 offset_dev,
+				   GBytes *bytes,
+				   GCancellable *cancellable,
+				   GError **error)
+{
+	guint32 addr = offset_dev;
+	guint32 addr_end = offset_dev + (guint32) g_bytes_get_size (bytes);
+
+	while (addr < addr_end) {
+		DfuSector *sector = dfu_target_get_sector_for_addr (target, addr);
+		guint32 sector_end = addr_end;
+		if (sector != NULL) {
+			sector_end = MIN (dfu_sector_get_address (sector) +
+					  dfu_sector_get_size (sector), addr_end);
+		}
+		if (sector == NULL ||
+		    !g_hash_table_contains (sectors_unchanged, sector)) {
+			g_autoptr(GBytes) bytes_tmp = NULL;
+			bytes_tmp = g_bytes_new_from_bytes (bytes,
+							    addr - offset_dev,
+							    sector_end - addr);
+			if (!dfu_target_download_chunk_at_address (target,
+								   addr,
+								   bytes_tmp,
+								   cancellable,
+								   error))
+				return FALSE;
+		}
+		addr = sector_end;
+	}
+	return TRUE;
+}
+
 static gboolean
 dfu_target_download_element_dfuse (DfuTarget *target,
 				   DfuElement *element,
@@ -1467,12 +1784,14 @@ dfu_target_download_element_dfuse (DfuTarget *target,
 	DfuSector *sector;
 	GBytes *bytes;
 	guint i;
+	guint chunk_base = 0;
 	guint nr_chunks;
 	guint zone_last = G_MAXUINT;
 	guint16 transfer_size = dfu_device_get_transfer_size (priv->device);
 	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GPtrArray) sectors_array = NULL;
 	g_autoptr(GHashTable) sectors_hash = NULL;
+	g_autoptr(GHashTable) sectors_unchanged = NULL;
 
 	/* round up as we have to transfer incomplete blocks */
 	bytes = dfu_element_get_contents (element);
@@ -1491,39 +1810,72 @@ dfu_target_download_element_dfuse (DfuTarget *target,
 	sectors_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
 	for (i = 0; i < nr_chunks; i++) {
 		guint32 offset_dev;
+		guint32 offsets_dev[2];
 
 		/* for DfuSe devices we need to handle the erase and setting
-		 * the sectory address manually */
+		 * the sectory address manually; the chunk may also end in
+		 * the next sector */
 		offset_dev = dfu_element_get_address (element) + (i * transfer_size);
-		sector = dfu_target_get_sector_for_addr (target, offset_dev);
-		if (sector == NULL) {
-			g_set_error (error,
-				     DFU_ERROR,
-				     DFU_ERROR_INVALID_DEVICE,
-				     "no memory sector at 0x%04x",
-				     (guint) offset_dev);
-			return FALSE;
-		}
-		if (!dfu_sector_has_cap (sector, DFU_SECTOR_CAP_WRITEABLE)) {
-			g_set_error (error,
-				     DFU_ERROR,
-				     DFU_ERROR_INVALID_DEVICE,
-				     "memory sector at 0x%04x is not writable",
-				     (guint) offset_dev);
-			return FALSE;
+		offsets_dev[0] = offset_dev;
+		offsets_dev[1] = dfu_element_get_address (element) +
+				 MIN ((i + 1) * transfer_size, (guint) g_bytes_get_size (bytes)) - 1;
+		for (guint j = 0; j < 2; j++) {
+			sector = dfu_target_get_sector_for_addr (target, offsets_dev[j]);
+			if (sector == NULL) {
+				g_set_error (error,
+					     DFU_ERROR,
+					     DFU_ERROR_INVALID_DEVICE,
+					     "no memory sector at 0x%04x",
+					     (guint) offsets_dev[j]);
+				return FALSE;
+			}
+			if (!dfu_sector_has_cap (sector, DFU_SECTOR_CAP_WRITEABLE)) {
+				g_set_error (error,
+					     DFU_ERROR,
+					     DFU_ERROR_INVALID_DEVICE,
+					     "memory sector at 0x%04x is not writable",
+					     (guint) offsets_dev[j]);
+				return FALSE;
+			}
+
+			/* if it's erasable and not yet blanked */
+			if (dfu_sector_has_cap (sector, DFU_SECTOR_CAP_ERASEABLE) &&
+			    g_hash_table_lookup (sectors_hash, sector) == NULL) {
+				g_hash_table_insert (sectors_hash,
+						     sector,
+						     GINT_TO_POINTER (1));
+				g_ptr_array_add (sectors_array, sector);
+				g_debug ("marking sector 0x%04x-%04x to be erased",
+					 dfu_sector_get_address (sector),
+					 dfu_sector_get_address (sector) + dfu_sector_get_size (sector));
+			}
 		}
+	}
 
-		/* if it's erasable and not yet blanked */
-		if (dfu_sector_has_cap (sector, DFU_SECTOR_CAP_ERASEABLE) &&
-		    g_hash_table_lookup (sectors_hash, sector) == NULL) {
-			g_hash_table_insert (sectors_hash,
-					     sector,
-					     GINT_TO_POINTER (1));
-			g_ptr_array_add (sectors_array, sector);
-			g_debug ("marking sector 0x%04x-%04x to be erased",
+	/* optionally read back the sectors and skip the ones that match */
+	sectors_unchanged = g_hash_table_new (g_direct_hash, g_direct_equal);
+	if (flags & DFU_TARGET_TRANSFER_FLAG_INCREMENTAL) {
+		for (i = 0; i < sectors_array->len; ) {
+			gboolean unchanged = FALSE;
+			sector = g_ptr_array_index (sectors_array, i);
+			if (!dfu_target_sector_is_unchanged (target,
+							     sector,
+							     element,
+							     &unchanged,
+							     cancellable,
+							     error))
+				return FALSE;
+			if (!unchanged) {
+				i++;
+				continue;
+			}
+			g_debug ("sector 0x%04x-%04x is unchanged",
 				 dfu_sector_get_address (sector),
 				 dfu_sector_get_address (sector) + dfu_sector_get_size (sector));
+			g_hash_table_add (sectors_unchanged, sector);
+			g_ptr_array_remove_index (sectors_array, i);
 		}
+		dfu_target_set_action (target, DFU_ACTION_IDLE);
 	}
 
 	/* 2nd pass: actually erase sectors */
@@ -1554,11 +1906,40 @@ dfu_target_download_element_dfuse (DfuTarget *target,
 		offset = i * transfer_size;
 		offset_dev = dfu_element_get_address (element) + offset;
 
+		/* we have to write one final zero-sized chunk for EOF */
+		length = g_bytes_get_size (bytes) - offset;
+		if (length > transfer_size)
+			length = transfer_size;
+
 		/* for DfuSe devices we need to set the address manually */
 		sector = dfu_target_get_sector_for_addr (target, offset_dev);
 		g_assert (sector != NULL);
 
-		/* manually set the sector address */
+		/* the chunk spans more than one sector and some were not
+		 * erased, so only write the parts in the erased sectors */
+		if (g_hash_table_size (sectors_unchanged) > 0 && length > 0 &&
+		    sector != dfu_target_get_sector_for_addr (target, offset_dev + length - 1)) {
+			bytes_tmp = g_bytes_new_from_bytes (bytes, offset, length);
+			if (!dfu_target_download_chunk_clipped (target,
+								sectors_unchanged,
+								offset_dev,
+								bytes_tmp,
+								cancellable,
+								error))
+				return FALSE;
+			zone_last = G_MAXUINT;
+			dfu_target_set_percentage (target, offset, g_bytes_get_size (bytes));
+			continue;
+		}
+
+		/* the whole chunk is already on the device */
+		if (g_hash_table_contains (sectors_unchanged, sector)) {
+			zone_last = G_MAXUINT;
+			continue;
+		}
+
+		/* manually set the sector address, which also resets the
+		 * block number the device uses to work out the offset */
 		if (dfu_sector_get_zone (sector) != zone_last) {
 			g_debug ("setting address to 0x%04x",
 				 (guint) offset_dev);
@@ -1568,19 +1949,15 @@ dfu_target_download_element_dfuse (DfuTarget *target,
 						     error))
 				return FALSE;
 			zone_last = dfu_sector_get_zone (sector);
+			chunk_base = i;
 		}
-
-		/* we have to write one final zero-sized chunk for EOF */
-		length = g_bytes_get_size (bytes) - offset;
-		if (length > transfer_size)
-			length = transfer_size;
 		bytes_tmp = g_bytes_new_from_bytes (bytes, offset, length);
 		g_debug ("writing sector at 0x%04x (0x%" G_GSIZE_FORMAT ")",
 			 offset_dev,
 			 g_bytes_get_size (bytes_tmp));
 		/* ST uses wBlockNum=0 for DfuSe commands and wBlockNum=1 is reserved */
 		if (!dfu_target_download_chunk (target,
-						(guint8) (i + 2),
+						(guint8) (i - chunk_base + 2),
 						bytes_tmp,
 						cancellable,
 						error))
@@ -1660,6 +2037,82 @@ dfu_target_download_element (DfuTarget *target,
 	return TRUE;
 }
 
+static gint
+dfu_target_element_sort_cb (gconstpointer a, gconstpointer b)
+{
+	DfuElement *element1 = *((DfuElement **) a);
+	DfuElement *element2 = *((DfuElement **) b);
+	guint32 addr1 = dfu_element_get_address (element1);
+	guint32 addr2 = dfu_element_get_address (element2);
+	if (addr1 < addr2)
+		return -1;
+	if (addr1 > addr2)
+		return 1;
+	return 0;
+}
+
+static gboolean
+dfu_target_add_element_group (GPtrArray *array, DfuImage *group, GError **error)
+{
+	DfuElement *element = dfu_image_flatten (group, error);
+	if (element == NULL)
+		return FALSE;
+	g_ptr_array_add (array, element);
+	return TRUE;
+}
+
+/* gets the populated ranges of a sparse image; each sector is erased just
+ * once, so elements that share a sector are joined to avoid losing data */
+static GPtrArray *
+dfu_target_get_download_elements (DfuTarget *target,
+				  DfuImage *image,
+				  GError **error)
+{
+	DfuTargetPrivate *priv = GET_PRIVATE (target);
+	DfuSector *sector_last = NULL;
+	GPtrArray *elements = dfu_image_get_elements (image);
+	g_autoptr(DfuImage) group = NULL;
+	g_autoptr(GPtrArray) array = NULL;
+	g_autoptr(GPtrArray) sorted = NULL;
+
+	/* plain DFU has no addresses, so the gaps have to be sent */
+	array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	if (!dfu_device_has_dfuse_support (priv->device)) {
+		group = g_object_ref (image);
+		if (!dfu_target_add_element_group (array, group, error))
+			return NULL;
+		return g_steal_pointer (&array);
+	}
+
+	/* DfuSe */
+	sorted = g_ptr_array_new ();
+	for (guint i = 0; i < elements->len; i++)
+		g_ptr_array_add (sorted, g_ptr_array_index (elements, i));
+	g_ptr_array_sort (sorted, dfu_target_element_sort_cb);
+	for (guint i = 0; i < sorted->len; i++) {
+		DfuElement *element = g_ptr_array_index (sorted, i);
+		DfuSector *sector;
+		guint32 addr = dfu_element_get_address (element);
+		gsize sz = g_bytes_get_size (dfu_element_get_contents (element));
+
+		sector = dfu_target_get_sector_for_addr (target, addr);
+		if (group != NULL && (sector == NULL || sector != sector_last)) {
+			if (!dfu_target_add_element_group (array, group, error))
+				return NULL;
+			g_clear_object (&group);
+		}
+		if (group == NULL)
+			group = dfu_image_new ();
+		dfu_image_add_element (group, element);
+		sector_last = dfu_target_get_sector_for_addr (target, addr + MAX (sz, 1) - 1);
+	}
+	if (group != NULL) {
+		if (!dfu_target_add_element_group (array, group, error))
+			return NULL;
+	}
+	return g_steal_pointer (&array);
+}
+
 /**
  * dfu_target_download:
  * @target: a #DfuTarget
@@ -1686,6 +2139,7 @@ dfu_target_download (DfuTarget *target, DfuImage *image,
 	GPtrArray *elements;
 	gboolean ret;
 	guint i;
+	g_autoptr(GPtrArray) elements_download = NULL;
 
 	g_return_val_if_fail (DFU_IS_TARGET (target), FALSE);
 	g_return_val_if_fail (DFU_IS_IMAGE (image), FALSE);
@@ -1704,6 +2158,16 @@ dfu_target_download (DfuTarget *target, DfuImage *image,
 		return FALSE;
 	}
 
+	/* only DfuSe devices have sectors that can be skipped */
+	if (flags & DFU_TARGET_TRANSFER_FLAG_INCREMENTAL &&
+	    !dfu_device_has_dfuse_support (priv->device)) {
+		g_set_error_literal (error,
+				     DFU_ERROR,
+				     DFU_ERROR_NOT_SUPPORTED,
+				     "incremental downloads need a DfuSe device");
+		return FALSE;
+	}
+
 	/* use correct alt */
 	if (!dfu_target_use_alt_setting (target, error))
 		return FALSE;
@@ -1717,24 +2181,30 @@ dfu_target_download (DfuTarget *target, DfuImage *image,
 				     "no image elements");
 		return FALSE;
 	}
-	for (i = 0; i < elements->len; i++) {
-		element = dfu_image_get_element (image, (guint8) i);
+
+	/* auto-detect missing firmware address -- this assumes
+	 * that the first target is the main program memory and that
+	 * there is only one element in the firmware file */
+	element = dfu_image_get_element_default (image);
+	if (flags & DFU_TARGET_TRANSFER_FLAG_ADDR_HEURISTIC &&
+	    dfu_element_get_address (element) == 0x0 &&
+	    elements->len == 1 &&
+	    priv->sectors->len > 0) {
+		DfuSector *sector = g_ptr_array_index (priv->sectors, 0);
+		g_debug ("fixing up firmware address from 0x0 to 0x%x",
+			 dfu_sector_get_address (sector));
+		dfu_element_set_address (element, dfu_sector_get_address (sector));
+	}
+
+	/* only the populated ranges of a sparse image */
+	elements_download = dfu_target_get_download_elements (target, image, error);
+	if (elements_download == NULL)
+		return FALSE;
+	for (i = 0; i < elements_download->len; i++) {
+		element = g_ptr_array_index (elements_download, i);
 		g_debug ("downloading element at 0x%04x",
 			 dfu_element_get_address (element));
 
-		/* auto-detect missing firmware address -- this assumes
-		 * that the first target is the main program memory and that
-		 * there is only one element in the firmware file */
-		if (flags & DFU_TARGET_TRANSFER_FLAG_ADDR_HEURISTIC &&
-		    dfu_element_get_address (element) == 0x0 &&
-		    elements->len == 1 &&
-		    priv->sectors->len > 0) {
-			DfuSector *sector = g_ptr_array_index (priv->sectors, 0);
-			g_debug ("fixing up firmware address from 0x0 to 0x%x",
-				 dfu_sector_get_address (sector));
-			dfu_element_set_address (element, dfu_sector_get_address (sector));
-		}
-
 		/* download to device */
 		ret = dfu_target_download_element (target,
 						   element,
@@ -64,6 +64,7 @@ struct _DfuTargetClass
  * @DFU_TARGET_TRANSFER_FLAG_WILDCARD_PID:	Allow downloading images with wildcard PIDs
  * @DFU_TARGET_TRANSFER_FLAG_ANY_CIPHER:	Allow any cipher kinds to be downloaded
  * @DFU_TARGET_TRANSFER_FLAG_ADDR_HEURISTIC:	Automatically detect the address to use
+ * @DFU_TARGET_TRANSFER_FLAG_INCREMENTAL:	Only erase and write sectors that have changed
  *
  * The optional flags used for transfering firmware.
  **/
@@ -77,6 +78,7 @@ typedef enum {
 	DFU_TARGET_TRANSFER_FLAG_WILDCARD_PID	= (1 << 5),
 	DFU_TARGET_TRANSFER_FLAG_ANY_CIPHER	= (1 << 6),
 	DFU_TARGET_TRANSFER_FLAG_ADDR_HEURISTIC	= (1 << 7),
+	DFU_TARGET_TRANSFER_FLAG_INCREMENTAL	= (1 << 8),	/* Since: 0.7.6 */
 	/*< private >*/
 	DFU_TARGET_TRANSFER_FLAG_LAST
 } DfuTargetTransferFlags;
@@ -23,6 +23,7 @@
 
 #include <dfu.h>
 #include <libintl.h>
+#include <glob.h>
 #include <locale.h>
 #include <stdlib.h>
 #include <glib/gi18n.h>
@@ -32,14 +33,17 @@
 #include "dfu-cipher-devo.h"
 #include "dfu-cipher-xtea.h"
 #include "dfu-device-private.h"
+#include "dfu-format.h"
 #include "dfu-progress-bar.h"
 
 typedef struct {
 	GCancellable		*cancellable;
 	GPtrArray		*cmd_array;
 	gboolean		 force;
+	gboolean		 incremental;
 	gchar			*device_vid_pid;
 	guint16			 transfer_size;
+	gint			 jobs;
 	DfuProgressBar		*progress_bar;
 } DfuToolPrivate;
 
@@ -555,9 +559,15 @@ dfu_tool_replace_data (DfuToolPrivate *priv, gchar **values, GError **error)
 		for (j = 0; j < elements->len; j++) {
 			DfuElement *element = g_ptr_array_index (elements, j);
 			GBytes *contents = dfu_element_get_contents (element);
+			g_autoptr(GBytes) contents_new = NULL;
 			if (contents == NULL)
 				continue;
-			cnt += dfu_tool_bytes_replace (contents, data_search, data_replace);
+
+			/* the contents may be a read-only mapping of the file */
+			contents_new = g_bytes_new (g_bytes_get_data (contents, NULL),
+						    g_bytes_get_size (contents));
+			cnt += dfu_tool_bytes_replace (contents_new, data_search, data_replace);
+			dfu_element_set_contents (element, contents_new);
 		}
 	}
 
@@ -1396,14 +1406,11 @@ dfu_tool_watch_cancelled_cb (GCancellable *cancellable, gpointer user_data)
 	g_main_loop_quit (loop);
 }
 
-static guint8 *
-dfu_tool_get_firmware_contents_default (DfuFirmware *firmware,
-					gsize *length,
-					GError **error)
+static GPtrArray *
+dfu_tool_get_firmware_elements_default (DfuFirmware *firmware, GError **error)
 {
-	DfuElement *element;
 	DfuImage *image;
-	GBytes *contents;
+	GPtrArray *elements;
 
 	image = dfu_firmware_get_image_default (firmware);
 	if (image == NULL) {
@@ -1413,14 +1420,27 @@ dfu_tool_get_firmware_contents_default (DfuFirmware *firmware,
 				     "No default image");
 		return NULL;
 	}
-	element = dfu_image_get_element (image, 0);
-	if (element == NULL) {
+	elements = dfu_image_get_elements (image);
+	if (elements->len == 0) {
 		g_set_error_literal (error,
 				     DFU_ERROR,
 				     DFU_ERROR_INTERNAL,
 				     "No default element");
 		return NULL;
 	}
+	return elements;
+}
+
+static guint8 *
+dfu_tool_get_element_contents_writable (DfuElement *element,
+					gsize *length,
+					GError **error)
+{
+	GBytes *contents;
+	const guint8 *data;
+	guint8 *buf;
+	g_autoptr(GBytes) contents_new = NULL;
+
 	contents = dfu_element_get_contents (element);
 	if (contents == NULL) {
 		g_set_error_literal (error,
@@ -1429,14 +1449,20 @@ dfu_tool_get_firmware_contents_default (DfuFirmware *firmware,
 				     "No image contents");
 		return NULL;
 	}
-	return (guint8 *) g_bytes_get_data (contents, length);
+
+	/* the contents may be a read-only mapping of the file */
+	data = g_bytes_get_data (contents, length);
+	buf = g_malloc (*length);
+	memcpy (buf, data, *length);
+	contents_new = g_bytes_new_take (buf, *length);
+	dfu_element_set_contents (element, contents_new);
+	return buf;
 }
 
 static gboolean
 dfu_tool_encrypt (DfuToolPrivate *priv, gchar **values, GError **error)
 {
-	gsize len;
-	guint8 *data;
+	GPtrArray *elements;
 	g_autoptr(DfuFirmware) firmware = NULL;
 	g_autoptr(GFile) file_in = NULL;
 	g_autoptr(GFile) file_out = NULL;
@@ -1480,21 +1506,12 @@ dfu_tool_encrypt (DfuToolPrivate *priv, gchar **values, GError **error)
 		return FALSE;
 	}
 
-	/* get data */
-	data = dfu_tool_get_firmware_contents_default (firmware, &len, error);
-	if (data == NULL)
-		return FALSE;
-
 	/* check type */
 	if (g_strcmp0 (values[2], "xtea") == 0) {
-		if (!dfu_cipher_encrypt_xtea (values[3], data, (guint32) len, error))
-			return FALSE;
 		dfu_firmware_set_metadata (firmware,
 					   DFU_METADATA_KEY_CIPHER_KIND,
 					   "XTEA");
 	} else if (g_strcmp0 (values[2], "devo") == 0) {
-		if (!dfu_cipher_encrypt_devo (values[3], data, (guint32) len, error))
-			return FALSE;
 		dfu_firmware_set_metadata (firmware,
 					   DFU_METADATA_KEY_CIPHER_KIND,
 					   "DEVO");
@@ -1507,6 +1524,27 @@ dfu_tool_encrypt (DfuToolPrivate *priv, gchar **values, GError **error)
 		return FALSE;
 	}
 
+	/* encrypt each element, so no region is left in plaintext */
+	elements = dfu_tool_get_firmware_elements_default (firmware, error);
+	if (elements == NULL)
+		return FALSE;
+	for (guint i = 0; i < elements->len; i++) {
+		DfuElement *element = g_ptr_array_index (elements, i);
+		gsize len;
+		guint8 *data;
+
+		data = dfu_tool_get_element_contents_writable (element, &len, error);
+		if (data == NULL)
+			return FALSE;
+		if (g_strcmp0 (values[2], "xtea") == 0) {
+			if (!dfu_cipher_encrypt_xtea (values[3], data, (guint32) len, error))
+				return FALSE;
+		} else {
+			if (!dfu_cipher_encrypt_devo (values[3], data, (guint32) len, error))
+				return FALSE;
+		}
+	}
+
 	/* write out new file */
 	file_out = g_file_new_for_path (values[1]);
 	g_debug ("wrote %s", values[1]);
@@ -1519,8 +1557,7 @@ dfu_tool_encrypt (DfuToolPrivate *priv, gchar **values, GError **error)
 static gboolean
 dfu_tool_decrypt (DfuToolPrivate *priv, gchar **values, GError **error)
 {
-	gsize len;
-	guint8 *data;
+	GPtrArray *elements;
 	g_autoptr(DfuFirmware) firmware = NULL;
 	g_autoptr(GFile) file_in = NULL;
 	g_autoptr(GFile) file_out = NULL;
@@ -1564,23 +1601,9 @@ dfu_tool_decrypt (DfuToolPrivate *priv, gchar **values, GError **error)
 		return FALSE;
 	}
 
-	/* get data */
-	data = dfu_tool_get_firmware_contents_default (firmware, &len, error);
-	if (data == NULL)
-		return FALSE;
-
 	/* check type */
-	if (g_strcmp0 (values[2], "xtea") == 0) {
-		if (!dfu_cipher_decrypt_xtea (values[3], data, (guint32) len, error))
-			return FALSE;
-		dfu_firmware_remove_metadata (firmware,
-					      DFU_METADATA_KEY_CIPHER_KIND);
-	} else if (g_strcmp0 (values[2], "devo") == 0) {
-		if (!dfu_cipher_decrypt_devo (values[3], data, (guint32) len, error))
-			return FALSE;
-		dfu_firmware_remove_metadata (firmware,
-					      DFU_METADATA_KEY_CIPHER_KIND);
-	} else {
+	if (g_strcmp0 (values[2], "xtea") != 0 &&
+	    g_strcmp0 (values[2], "devo") != 0) {
 		g_set_error (error,
 			     DFU_ERROR,
 			     DFU_ERROR_INTERNAL,
@@ -1589,6 +1612,28 @@ dfu_tool_decrypt (DfuToolPrivate *priv, gchar **values, GError **error)
 		return FALSE;
 	}
 
+	/* decrypt each element */
+	elements = dfu_tool_get_firmware_elements_default (firmware, error);
+	if (elements == NULL)
+		return FALSE;
+	for (guint i = 0; i < elements->len; i++) {
+		DfuElement *element = g_ptr_array_index (elements, i);
+		gsize len;
+		guint8 *data;
+
+		data = dfu_tool_get_element_contents_writable (element, &len, error);
+		if (data == NULL)
+			return FALSE;
+		if (g_strcmp0 (values[2], "xtea") == 0) {
+			if (!dfu_cipher_decrypt_xtea (values[3], data, (guint32) len, error))
+				return FALSE;
+		} else {
+			if (!dfu_cipher_decrypt_devo (values[3], data, (guint32) len, error))
+				return FALSE;
+		}
+	}
+	dfu_firmware_remove_metadata (firmware, DFU_METADATA_KEY_CIPHER_KIND);
+
 	/* write out new file */
 	file_out = g_file_new_for_path (values[1]);
 	g_debug ("wrote %s", values[1]);
@@ -1598,6 +1643,212 @@ dfu_tool_decrypt (DfuToolPrivate *priv, gchar **values, GError **error)
 					error);
 }
 
+/* commands that only operate on files, and so are safe to run in parallel */
+static const gchar * const dfu_tool_batch_commands[] = {
+	"convert",
+	"decrypt",
+	"encrypt",
+	"set-product",
+	"set-release",
+	"set-vendor",
+	NULL };
+
+typedef struct {
+	DfuToolPrivate	*priv;
+	FuUtilPrivateCb	 callback;
+	gchar		**argv;		/* command, then values */
+	gint64		 elapsed;	/* us */
+	GError		*error;
+} DfuToolBatchTask;
+
+static void
+dfu_tool_batch_task_free (DfuToolBatchTask *task)
+{
+	g_strfreev (task->argv);
+	if (task->error != NULL)
+		g_error_free (task->error);
+	g_free (task);
+}
+
+static void
+dfu_tool_batch_task_run_cb (gpointer data, gpointer user_data)
+{
+	DfuToolBatchTask *task = (DfuToolBatchTask *) data;
+	gint64 start = g_get_monotonic_time ();
+	task->callback (task->priv, task->argv + 1, &task->error);
+	task->elapsed = g_get_monotonic_time () - start;
+}
+
+static FuUtilPrivateCb
+dfu_tool_batch_get_callback (DfuToolPrivate *priv, const gchar *command)
+{
+	if (!g_strv_contains (dfu_tool_batch_commands, command))
+		return NULL;
+	for (guint i = 0; i < priv->cmd_array->len; i++) {
+		FuUtilItem *item = g_ptr_array_index (priv->cmd_array, i);
+		if (g_strcmp0 (item->name, command) == 0)
+			return item->callback;
+	}
+	return NULL;
+}
+
+static gboolean
+dfu_tool_batch_add_line (DfuToolPrivate *priv,
+			 GPtrArray *tasks,
+			 const gchar *line,
+			 GError **error)
+{
+	FuUtilPrivateCb callback;
+	gint argc = 0;
+	guint glob_idx = 0;
+	glob_t globbuf;
+	g_auto(GStrv) argv = NULL;
+
+	if (!g_shell_parse_argv (line, &argc, &argv, error))
+		return FALSE;
+	callback = dfu_tool_batch_get_callback (priv, argv[0]);
+	if (callback == NULL) {
+		g_set_error (error,
+			     DFU_ERROR,
+			     DFU_ERROR_NOT_SUPPORTED,
+			     "command '%s' cannot be used in a batch",
+			     argv[0]);
+		return FALSE;
+	}
+
+	/* only the first argument with a wildcard is expanded */
+	for (guint i = 1; argv[i] != NULL; i++) {
+		if (strpbrk (argv[i], "*?[") != NULL) {
+			glob_idx = i;
+			break;
+		}
+	}
+	if (glob_idx == 0) {
+		DfuToolBatchTask *task = g_new0 (DfuToolBatchTask, 1);
+		task->priv = priv;
+		task->callback = callback;
+		task->argv = g_steal_pointer (&argv);
+		g_ptr_array_add (tasks, task);
+		return TRUE;
+	}
+
+	/* add a task for each matching file, replacing {} in the other
+	 * arguments with the basename of the match */
+	if (glob (argv[glob_idx], 0, NULL, &globbuf) != 0) {
+		g_set_error (error,
+			     DFU_ERROR,
+			     DFU_ERROR_NOT_FOUND,
+			     "no files matched '%s'",
+			     argv[glob_idx]);
+		return FALSE;
+	}
+	for (gsize j = 0; j < globbuf.gl_pathc; j++) {
+		DfuToolBatchTask *task = g_new0 (DfuToolBatchTask, 1);
+		g_autofree gchar *basename = g_path_get_basename (globbuf.gl_pathv[j]);
+		task->priv = priv;
+		task->callback = callback;
+		task->argv = g_new0 (gchar *, argc + 1);
+		for (guint i = 0; argv[i] != NULL; i++) {
+			g_auto(GStrv) split = NULL;
+			if (i == glob_idx) {
+				task->argv[i] = g_strdup (globbuf.gl_pathv[j]);
+				continue;
+			}
+			split = g_strsplit (argv[i], "{}", -1);
+			task->argv[i] = g_strjoinv (basename, split);
+		}
+		g_ptr_array_add (tasks, task);
+	}
+	globfree (&globbuf);
+	return TRUE;
+}
+
+static gboolean
+dfu_tool_batch (DfuToolPrivate *priv, gchar **values, GError **error)
+{
+	GThreadPool *pool;
+	gint64 start;
+	guint failed = 0;
+	guint jobs;
+	g_autoptr(GPtrArray) tasks = NULL;
+
+	/* check args */
+	if (g_strv_length (values) < 1) {
+		g_set_error_literal (error,
+				     DFU_ERROR,
+				     DFU_ERROR_INTERNAL,
+				     "Invalid arguments, expected MANIFEST"
+				     " -- e.g. `batch.txt`");
+		return FALSE;
+	}
+
+	/* parse each manifest */
+	tasks = g_ptr_array_new_with_free_func ((GDestroyNotify) dfu_tool_batch_task_free);
+	for (guint i = 0; values[i] != NULL; i++) {
+		g_autofree gchar *data = NULL;
+		g_auto(GStrv) lines = NULL;
+		if (!g_file_get_contents (values[i], &data, NULL, error))
+			return FALSE;
+		lines = g_strsplit (data, "\n", -1);
+		for (guint j = 0; lines[j] != NULL; j++) {
+			g_autoptr(GError) error_local = NULL;
+			g_strstrip (lines[j]);
+			if (lines[j][0] == '\0' || lines[j][0] == '#')
+				continue;
+			if (!dfu_tool_batch_add_line (priv, tasks,
+						      lines[j], &error_local)) {
+				g_set_error (error,
+					     DFU_ERROR,
+					     DFU_ERROR_INVALID_FILE,
+					     "%s:%u: %s",
+					     values[i], j + 1,
+					     error_local->message);
+				return FALSE;
+			}
+		}
+	}
+
+	/* run each task on a worker thread */
+	jobs = priv->jobs > 0 ? (guint) priv->jobs : g_get_num_processors ();
+	start = g_get_monotonic_time ();
+	pool = g_thread_pool_new (dfu_tool_batch_task_run_cb, NULL,
+				  (gint) jobs, FALSE, error);
+	if (pool == NULL)
+		return FALSE;
+	for (guint i = 0; i < tasks->len; i++) {
+		if (!g_thread_pool_push (pool, g_ptr_array_index (tasks, i), error)) {
+			g_thread_pool_free (pool, TRUE, TRUE);
+			return FALSE;
+		}
+	}
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	/* print a tab-separated summary in manifest order */
+	g_print ("# status\tmsecs\tcommand\terror\n");
+	for (guint i = 0; i < tasks->len; i++) {
+		DfuToolBatchTask *task = g_ptr_array_index (tasks, i);
+		g_autofree gchar *cmd = g_strjoinv (" ", task->argv);
+		g_print ("%s\t%" G_GINT64_FORMAT "\t%s\t%s\n",
+			 task->error == NULL ? "ok" : "failed",
+			 task->elapsed / 1000, cmd,
+			 task->error == NULL ? "" : task->error->message);
+		if (task->error != NULL)
+			failed++;
+	}
+	g_print ("# %u tasks, %u failed, %u jobs, %" G_GINT64_FORMAT " msecs\n",
+		 tasks->len, failed, jobs,
+		 (g_get_monotonic_time () - start) / 1000);
+	if (failed > 0) {
+		g_set_error (error,
+			     DFU_ERROR,
+			     DFU_ERROR_INTERNAL,
+			     "%u of %u batch tasks failed",
+			     failed, tasks->len);
+		return FALSE;
+	}
+	return TRUE;
+}
+
 static gboolean
 dfu_tool_watch (DfuToolPrivate *priv, gchar **values, GError **error)
 {
@@ -1675,6 +1926,34 @@ dfu_tool_dump (DfuToolPrivate *priv, gchar **values, GError **error)
 	return TRUE;
 }
 
+static gboolean
+dfu_tool_formats (DfuToolPrivate *priv, gchar **values, GError **error)
+{
+	g_autoptr(GPtrArray) formats = dfu_format_get_all ();
+
+	for (guint i = 0; i < formats->len; i++) {
+		const DfuFormat *format = g_ptr_array_index (formats, i);
+		g_autofree gchar *tmp = NULL;
+
+		dfu_tool_print_indent ("Format",
+				       dfu_firmware_format_to_string (format->format),
+				       0);
+		tmp = g_strdup_printf ("%u", format->priority);
+		dfu_tool_print_indent ("Priority", tmp, 1);
+		if (format->magic != NULL) {
+			g_autoptr(GString) str = g_string_new (NULL);
+			for (gsize j = 0; j < format->magic_len; j++)
+				g_string_append_printf (str, "%02x", (guint8) format->magic[j]);
+			dfu_tool_print_indent ("Magic", str->str, 1);
+		}
+		if (format->probe != NULL)
+			dfu_tool_print_indent ("Probe", "yes", 1);
+		dfu_tool_print_indent ("Read", format->parse != NULL ? "yes" : "no", 1);
+		dfu_tool_print_indent ("Write", format->write != NULL ? "yes" : "no", 1);
+	}
+	return TRUE;
+}
+
 static gboolean
 dfu_tool_write_alt (DfuToolPrivate *priv, gchar **values, GError **error)
 {
@@ -1803,6 +2082,10 @@ dfu_tool_write_alt (DfuToolPrivate *priv, gchar **values, GError **error)
 		flags |= DFU_TARGET_TRANSFER_FLAG_ANY_CIPHER;
 	}
 
+	/* only write sectors that have changed */
+	if (priv->incremental)
+		flags |= DFU_TARGET_TRANSFER_FLAG_INCREMENTAL;
+
 	/* transfer */
 	if (!dfu_target_download (target,
 				  image,
@@ -1871,6 +2154,10 @@ dfu_tool_write (DfuToolPrivate *priv, gchar **values, GError **error)
 		flags |= DFU_TARGET_TRANSFER_FLAG_ANY_CIPHER;
 	}
 
+	/* only write sectors that have changed */
+	if (priv->incremental)
+		flags |= DFU_TARGET_TRANSFER_FLAG_INCREMENTAL;
+
 	/* transfer */
 	g_signal_connect (device, "action-changed",
 			  G_CALLBACK (fu_tool_action_changed_cb), priv);
@@ -2099,6 +2386,10 @@ main (int argc, char *argv[])
 			"Specify the number of bytes per USB transfer", "BYTES" },
 		{ "force", '\0', 0, G_OPTION_ARG_NONE, &priv->force,
 			"Force the action ignoring all warnings", NULL },
+		{ "incremental", '\0', 0, G_OPTION_ARG_NONE, &priv->incremental,
+			"Only erase and write sectors that have changed", NULL },
+		{ "jobs", 'j', 0, G_OPTION_ARG_INT, &priv->jobs,
+			"Number of batch tasks to run in parallel", "JOBS" },
 		{ NULL}
 	};
 
@@ -2212,6 +2503,18 @@ main (int argc, char *argv[])
 		     /* TRANSLATORS: command description */
 		     _("Dump details about a firmware file"),
 		     dfu_tool_dump);
+	dfu_tool_add (priv->cmd_array,
+		     "batch",
+		     NULL,
+		     /* TRANSLATORS: command description */
+		     _("Run the operations listed in a manifest in parallel"),
+		     dfu_tool_batch);
+	dfu_tool_add (priv->cmd_array,
+		     "formats",
+		     NULL,
+		     /* TRANSLATORS: command description */
+		     _("List the supported firmware formats"),
+		     dfu_tool_formats);
 	dfu_tool_add (priv->cmd_array,
 		     "watch",
 		     NULL,
@@ -67,6 +67,7 @@ typedef struct {
 	gchar				*update_vendor;
 	gchar				*update_version;
 	guint64				 update_size;
+	guint				 serial;
 } FwupdResultPrivate;
 
 enum {
@@ -115,6 +116,7 @@ fwupd_result_set_unique_id (FwupdResult *result, const gchar *unique_id)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->unique_id);
 	priv->unique_id = g_strdup (unique_id);
 }
@@ -151,10 +153,30 @@ fwupd_result_set_device_id (FwupdResult *result, const gchar *device_id)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->device_id);
 	priv->device_id = g_strdup (device_id);
 }
 
+/**
+ * fwupd_result_get_serial:
+ * @result: A #FwupdResult
+ *
+ * Gets a number that changes every time a property of the result is set.
+ * This allows callers to cache the serialized form of the result.
+ *
+ * Returns: integer
+ *
+ * Since: 0.7.6
+ **/
+guint
+fwupd_result_get_serial (FwupdResult *result)
+{
+	FwupdResultPrivate *priv = GET_PRIVATE (result);
+	g_return_val_if_fail (FWUPD_IS_RESULT (result), 0);
+	return priv->serial;
+}
+
 /**
  * fwupd_result_get_guids:
  * @result: A #FwupdResult
@@ -214,6 +236,7 @@ fwupd_result_add_guid (FwupdResult *result, const gchar *guid)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	if (fwupd_result_has_guid (result, guid))
 		return;
 	g_ptr_array_add (priv->guids, g_strdup (guid));
@@ -306,6 +329,7 @@ fwupd_result_set_device_name (FwupdResult *result, const gchar *device_name)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->device_name);
 	priv->device_name = g_strdup (device_name);
 }
@@ -342,6 +366,7 @@ fwupd_result_set_device_vendor (FwupdResult *result, const gchar *device_vendor)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->device_vendor);
 	priv->device_vendor = g_strdup (device_vendor);
 }
@@ -378,6 +403,7 @@ fwupd_result_set_device_description (FwupdResult *result, const gchar *device_de
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->device_description);
 	priv->device_description = g_strdup (device_description);
 }
@@ -414,6 +440,7 @@ fwupd_result_set_device_version (FwupdResult *result, const gchar *device_versio
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->device_version);
 	priv->device_version = g_strdup (device_version);
 }
@@ -468,6 +495,7 @@ fwupd_result_set_device_version_lowest (FwupdResult *result, const gchar *device
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->device_version_lowest);
 	priv->device_version_lowest = g_strdup (device_version_lowest);
 }
@@ -504,6 +532,7 @@ fwupd_result_set_device_flashes_left (FwupdResult *result, guint32 flashes_left)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->device_flashes_left = flashes_left;
 }
 
@@ -521,6 +550,7 @@ fwupd_result_set_update_version (FwupdResult *result, const gchar *update_versio
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_version);
 	priv->update_version = g_strdup (update_version);
 }
@@ -557,6 +587,7 @@ fwupd_result_set_update_filename (FwupdResult *result, const gchar *update_filen
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_filename);
 	priv->update_filename = g_strdup (update_filename);
 }
@@ -593,6 +624,7 @@ fwupd_result_set_update_state (FwupdResult *result, FwupdUpdateState update_stat
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->update_state = update_state;
 }
 
@@ -628,6 +660,7 @@ fwupd_result_set_update_checksum (FwupdResult *result, const gchar *update_check
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_checksum);
 	priv->update_checksum = g_strdup (update_checksum);
 }
@@ -664,6 +697,7 @@ fwupd_result_set_update_checksum_kind (FwupdResult *result, GChecksumType checku
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->update_checksum_kind = checkum_kind;
 }
 
@@ -699,6 +733,7 @@ fwupd_result_set_update_uri (FwupdResult *result, const gchar *update_uri)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_uri);
 	priv->update_uri = g_strdup (update_uri);
 }
@@ -735,6 +770,7 @@ fwupd_result_set_update_homepage (FwupdResult *result, const gchar *update_homep
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_homepage);
 	priv->update_homepage = g_strdup (update_homepage);
 }
@@ -771,6 +807,7 @@ fwupd_result_set_update_description (FwupdResult *result, const gchar *update_de
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_description);
 	priv->update_description = g_strdup (update_description);
 }
@@ -807,6 +844,7 @@ fwupd_result_set_update_id (FwupdResult *result, const gchar *update_id)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_id);
 	priv->update_id = g_strdup (update_id);
 }
@@ -843,6 +881,7 @@ fwupd_result_set_update_size (FwupdResult *result, guint64 update_size)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->update_size = update_size;
 }
 
@@ -878,6 +917,7 @@ fwupd_result_set_device_checksum (FwupdResult *result, const gchar *device_check
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->device_checksum);
 	priv->device_checksum = g_strdup (device_checksum);
 }
@@ -914,6 +954,7 @@ fwupd_result_set_device_checksum_kind (FwupdResult *result, GChecksumType checku
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->device_checksum_kind = checkum_kind;
 }
 
@@ -949,6 +990,7 @@ fwupd_result_set_update_summary (FwupdResult *result, const gchar *update_summar
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_summary);
 	priv->update_summary = g_strdup (update_summary);
 }
@@ -985,6 +1027,7 @@ fwupd_result_set_device_provider (FwupdResult *result, const gchar *device_provi
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->device_provider);
 	priv->device_provider = g_strdup (device_provider);
 }
@@ -1021,6 +1064,7 @@ fwupd_result_set_update_error (FwupdResult *result, const gchar *update_error)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_error);
 	priv->update_error = g_strdup (update_error);
 }
@@ -1057,6 +1101,7 @@ fwupd_result_set_update_trust_flags (FwupdResult *result, FwupdTrustFlags trust_
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->update_trust_flags = trust_flags;
 }
 
@@ -1092,6 +1137,7 @@ fwupd_result_set_update_vendor (FwupdResult *result, const gchar *update_vendor)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_vendor);
 	priv->update_vendor = g_strdup (update_vendor);
 }
@@ -1128,6 +1174,7 @@ fwupd_result_set_update_license (FwupdResult *result, const gchar *update_licens
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_license);
 	priv->update_license = g_strdup (update_license);
 }
@@ -1164,6 +1211,7 @@ fwupd_result_set_update_name (FwupdResult *result, const gchar *update_name)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	g_free (priv->update_name);
 	priv->update_name = g_strdup (update_name);
 }
@@ -1200,6 +1248,7 @@ fwupd_result_set_device_flags (FwupdResult *result, guint64 device_flags)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->device_flags = device_flags;
 }
 
@@ -1217,6 +1266,7 @@ fwupd_result_add_device_flag (FwupdResult *result, FwupdDeviceFlags flag)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->device_flags |= flag;
 }
 
@@ -1234,6 +1284,7 @@ fwupd_result_remove_device_flag (FwupdResult *result, FwupdDeviceFlags flag)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->device_flags &= ~flag;
 }
 
@@ -1289,6 +1340,7 @@ fwupd_result_set_device_created (FwupdResult *result, guint64 device_created)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->device_created = device_created;
 }
 
@@ -1324,6 +1376,7 @@ fwupd_result_set_device_modified (FwupdResult *result, guint64 device_modified)
 {
 	FwupdResultPrivate *priv = GET_PRIVATE (result);
 	g_return_if_fail (FWUPD_IS_RESULT (result));
+	priv->serial++;
 	priv->device_modified = device_modified;
 }
 
@@ -1866,16 +1919,13 @@ fwupd_result_set_property (GObject *object, guint prop_id,
 			   const GValue *value, GParamSpec *pspec)
 {
 	FwupdResult *result = FWUPD_RESULT (object);
-	FwupdResultPrivate *priv = GET_PRIVATE (result);
 
 	switch (prop_id) {
 	case PROP_DEVICE_ID:
-		g_free (priv->device_id);
-		priv->device_id = g_strdup (g_value_get_string (value));
+		fwupd_result_set_device_id (result, g_value_get_string (value));
 		break;
 	case PROP_UNIQUE_ID:
-		g_free (priv->unique_id);
-		priv->unique_id = g_strdup (g_value_get_string (value));
+		fwupd_result_set_unique_id (result, g_value_get_string (value));
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
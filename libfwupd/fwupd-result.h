@@ -46,6 +46,7 @@ struct _FwupdResultClass
 
 FwupdResult	*fwupd_result_new			(void);
 FwupdResult	*fwupd_result_new_from_data		(GVariant	*data);
+guint		 fwupd_result_get_serial		(FwupdResult	*result);
 
 /* matches */
 void		 fwupd_result_add_guid			(FwupdResult	*result,
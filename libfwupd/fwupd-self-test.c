@@ -97,6 +97,7 @@ static void
 fwupd_result_func (void)
 {
 	gboolean ret;
+	guint serial;
 	g_autofree gchar *str = NULL;
 	g_autoptr(FwupdResult) result = NULL;
 	g_autoptr(GError) error = NULL;
@@ -129,6 +130,14 @@ fwupd_result_func (void)
 	g_assert (fwupd_result_has_guid (result, "00000000-0000-0000-0000-000000000000"));
 	g_assert (!fwupd_result_has_guid (result, "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx"));
 
+	/* check the serial changes when a property is set */
+	serial = fwupd_result_get_serial (result);
+	g_assert_cmpint (serial, >, 0);
+	g_assert_cmpint (fwupd_result_get_serial (result), ==, serial);
+	fwupd_result_set_update_state (result, FWUPD_UPDATE_STATE_PENDING);
+	g_assert_cmpint (fwupd_result_get_serial (result), !=, serial);
+	fwupd_result_set_update_state (result, FWUPD_UPDATE_STATE_UNKNOWN);
+
 	ret = as_test_compare_lines (str,
 		"ColorHug2\n"
 		"  Guid:                 2082b5e0-7a64-478a-b1b2-e3404fab6dad\n"
@@ -0,0 +1,362 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <fwupd.h>
+#include <appstream-glib.h>
+#include <archive_entry.h>
+#include <archive.h>
+
+#include "fu-cab.h"
+
+static struct archive *
+fu_cab_open (GBytes *blob_cab, GError **error)
+{
+	struct archive *arch;
+	int r;
+
+	arch = archive_read_new ();
+	archive_read_support_format_cab (arch);
+	r = archive_read_open_memory (arch,
+				      (void *) g_bytes_get_data (blob_cab, NULL),
+				      (size_t) g_bytes_get_size (blob_cab));
+	if (r != ARCHIVE_OK) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "Cannot open: %s",
+			     archive_error_string (arch));
+		archive_read_free (arch);
+		return NULL;
+	}
+	return arch;
+}
+
+static void
+fu_cab_close (struct archive *arch)
+{
+	archive_read_close (arch);
+	archive_read_free (arch);
+}
+
+/* reads just the current entry into a buffer of exactly the right size,
+ * which is declared in the archive and so cannot be trusted */
+static GBytes *
+fu_cab_read_entry (struct archive *arch,
+		   struct archive_entry *entry,
+		   guint64 size_max,
+		   GError **error)
+{
+	gint64 size = archive_entry_size (entry);
+	gsize offset = 0;
+	g_autofree guint8 *buf = NULL;
+
+	if (size < 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "Invalid size for %s",
+			     archive_entry_pathname (entry));
+		return NULL;
+	}
+	if ((guint64) size > size_max) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "%s is too large, maximum is %" G_GUINT64_FORMAT " bytes",
+			     archive_entry_pathname (entry), size_max);
+		return NULL;
+	}
+	buf = g_try_malloc ((gsize) size + 1);
+	if (buf == NULL) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "Cannot allocate %" G_GINT64_FORMAT " bytes for %s",
+			     size, archive_entry_pathname (entry));
+		return NULL;
+	}
+	while (offset < (gsize) size) {
+		la_ssize_t r;
+		r = archive_read_data (arch, buf + offset, (gsize) size - offset);
+		if (r < 0) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "Cannot extract %s: %s",
+				     archive_entry_pathname (entry),
+				     archive_error_string (arch));
+			return NULL;
+		}
+		if (r == 0)
+			break;
+		offset += (gsize) r;
+	}
+	if (offset != (gsize) size) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "Truncated %s, got %" G_GSIZE_FORMAT " of %" G_GINT64_FORMAT,
+			     archive_entry_pathname (entry), offset, size);
+		return NULL;
+	}
+
+	/* NUL terminate for the XML parser, but do not count it */
+	buf[size] = '\0';
+	return g_bytes_new_take (g_steal_pointer (&buf), (gsize) size);
+}
+
+static gboolean
+fu_cab_is_payload (const gchar *fn)
+{
+	if (g_str_has_suffix (fn, ".metainfo.xml"))
+		return FALSE;
+	if (g_str_has_suffix (fn, ".asc"))
+		return FALSE;
+	if (g_str_has_suffix (fn, ".cat"))
+		return FALSE;
+	if (g_str_has_suffix (fn, ".inf"))
+		return FALSE;
+	return TRUE;
+}
+
+static gboolean
+fu_cab_fixup_release (AsRelease *rel,
+		      const gchar *checksum_cab,
+		      GHashTable *payloads,
+		      GError **error)
+{
+	AsChecksum *csum;
+	const gchar *fn;
+	gpointer size;
+
+	/* the container checksum is the whole cab file */
+	if (as_release_get_checksum_by_target (rel, AS_CHECKSUM_TARGET_CONTAINER) == NULL) {
+		g_autoptr(AsChecksum) csum_new = as_checksum_new ();
+		as_checksum_set_kind (csum_new, G_CHECKSUM_SHA1);
+		as_checksum_set_target (csum_new, AS_CHECKSUM_TARGET_CONTAINER);
+		as_checksum_set_value (csum_new, checksum_cab);
+		as_release_add_checksum (rel, csum_new);
+	}
+
+	/* no explicit filename, so use the only payload in the archive */
+	csum = as_release_get_checksum_by_target (rel, AS_CHECKSUM_TARGET_CONTENT);
+	if (csum == NULL && g_hash_table_size (payloads) == 1) {
+		g_autoptr(GList) keys = g_hash_table_get_keys (payloads);
+		g_autoptr(AsChecksum) csum_new = as_checksum_new ();
+		as_checksum_set_kind (csum_new, G_CHECKSUM_SHA1);
+		as_checksum_set_target (csum_new, AS_CHECKSUM_TARGET_CONTENT);
+		as_checksum_set_filename (csum_new, keys->data);
+		as_release_add_checksum (rel, csum_new);
+		csum = csum_new;
+	}
+	if (csum == NULL) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "no firmware specified for release %s",
+			     as_release_get_version (rel));
+		return FALSE;
+	}
+
+	/* the payload has to exist in the archive */
+	fn = as_checksum_get_filename (csum);
+	if (fn == NULL || !g_hash_table_lookup_extended (payloads, fn, NULL, &size)) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "no %s found in archive",
+			     fn != NULL ? fn : "firmware");
+		return FALSE;
+	}
+
+	/* we know the size without decompressing the payload */
+	if (as_release_get_size (rel, AS_SIZE_KIND_INSTALLED) == 0) {
+		as_release_set_size (rel, AS_SIZE_KIND_INSTALLED,
+				     (guint64) GPOINTER_TO_SIZE (size));
+	}
+	return TRUE;
+}
+
+/* adds the components without decompressing any of the firmware payloads */
+gboolean
+fu_cab_load_metadata (AsStore *store, GBytes *blob_cab, guint64 size_max, GError **error)
+{
+	GPtrArray *apps;
+	gboolean ret = TRUE;
+	struct archive *arch;
+	struct archive_entry *entry;
+	g_autofree gchar *checksum_cab = NULL;
+	g_autoptr(GHashTable) payloads = NULL;
+
+	g_return_val_if_fail (AS_IS_STORE (store), FALSE);
+	g_return_val_if_fail (blob_cab != NULL, FALSE);
+
+	arch = fu_cab_open (blob_cab, error);
+	if (arch == NULL)
+		return FALSE;
+	payloads = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (;;) {
+		const gchar *fn;
+		int r;
+		g_autoptr(AsApp) app = NULL;
+		g_autoptr(GBytes) blob = NULL;
+
+		r = archive_read_next_header (arch, &entry);
+		if (r == ARCHIVE_EOF)
+			break;
+		if (r == ARCHIVE_WARN) {
+			g_warning ("reading header: %s",
+				   archive_error_string (arch));
+		} else if (r != ARCHIVE_OK) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "Cannot read header: %s",
+				     archive_error_string (arch));
+			ret = FALSE;
+			goto out;
+		}
+		fn = archive_entry_pathname (entry);
+		if (fn == NULL)
+			continue;
+
+		/* only record the size of anything that is not metadata */
+		if (!g_str_has_suffix (fn, ".metainfo.xml")) {
+			if (fu_cab_is_payload (fn)) {
+				g_hash_table_insert (payloads, g_strdup (fn),
+						     GSIZE_TO_POINTER (archive_entry_size (entry)));
+			}
+			continue;
+		}
+
+		/* parse the component */
+		blob = fu_cab_read_entry (arch, entry, size_max, error);
+		if (blob == NULL) {
+			ret = FALSE;
+			goto out;
+		}
+		app = as_app_new ();
+		if (!as_app_parse_data (app, blob, AS_APP_PARSE_FLAG_NONE, error)) {
+			g_prefix_error (error, "%s could not be loaded: ", fn);
+			ret = FALSE;
+			goto out;
+		}
+		as_store_add_app (store, app);
+	}
+
+	/* nothing useful */
+	apps = as_store_get_apps (store);
+	if (apps->len == 0) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "archive contained no metainfo files");
+		ret = FALSE;
+		goto out;
+	}
+
+	/* add the things that are usually only known after extraction,
+	 * checking what as_store_from_bytes() would have checked */
+	checksum_cab = g_compute_checksum_for_bytes (G_CHECKSUM_SHA1, blob_cab);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		AsRelease *rel = as_app_get_release_default (app);
+		if (rel == NULL) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "%s has no releases in metainfo file",
+				     as_app_get_id (app));
+			ret = FALSE;
+			goto out;
+		}
+		if (!fu_cab_fixup_release (rel, checksum_cab, payloads, error)) {
+			ret = FALSE;
+			goto out;
+		}
+	}
+out:
+	fu_cab_close (arch);
+	return ret;
+}
+
+/* returns filename:GBytes for the files found, skipping everything else */
+GHashTable *
+fu_cab_extract_files (GBytes *blob_cab,
+		      const gchar * const *filenames,
+		      guint64 size_max,
+		      GError **error)
+{
+	GHashTable *files = NULL;
+	guint files_wanted;
+	struct archive *arch;
+	struct archive_entry *entry;
+	g_autoptr(GHashTable) files_tmp = NULL;
+
+	g_return_val_if_fail (blob_cab != NULL, NULL);
+	g_return_val_if_fail (filenames != NULL, NULL);
+
+	arch = fu_cab_open (blob_cab, error);
+	if (arch == NULL)
+		return NULL;
+	files_wanted = g_strv_length ((gchar **) filenames);
+	files_tmp = g_hash_table_new_full (g_str_hash, g_str_equal,
+					   g_free, (GDestroyNotify) g_bytes_unref);
+	while (g_hash_table_size (files_tmp) < files_wanted) {
+		const gchar *fn;
+		int r;
+		GBytes *blob;
+
+		r = archive_read_next_header (arch, &entry);
+		if (r == ARCHIVE_EOF)
+			break;
+		if (r == ARCHIVE_WARN) {
+			g_warning ("reading header: %s",
+				   archive_error_string (arch));
+		} else if (r != ARCHIVE_OK) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "Cannot read header: %s",
+				     archive_error_string (arch));
+			goto out;
+		}
+		fn = archive_entry_pathname (entry);
+		if (fn == NULL)
+			continue;
+		if (!g_strv_contains (filenames, fn))
+			continue;
+		if (g_hash_table_contains (files_tmp, fn))
+			continue;
+		blob = fu_cab_read_entry (arch, entry, size_max, error);
+		if (blob == NULL)
+			goto out;
+		g_hash_table_insert (files_tmp, g_strdup (fn), blob);
+	}
+
+	/* success */
+	files = g_steal_pointer (&files_tmp);
+out:
+	fu_cab_close (arch);
+	return files;
+}
@@ -0,0 +1,133 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <glib-object.h>
+#include <gusb.h>
+
+#include "fu-claims.h"
+
+static void fu_claims_finalize			 (GObject *object);
+
+typedef struct {
+	GPtrArray			*providers;	/* of FuProvider */
+	GHashTable			*claims;	/* platform_id : provider name */
+} FuClaimsPrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE (FuClaims, fu_claims, G_TYPE_OBJECT)
+#define GET_PRIVATE(o) (fu_claims_get_instance_private (o))
+
+void
+fu_claims_add_provider (FuClaims *claims, FuProvider *provider)
+{
+	FuClaimsPrivate *priv = GET_PRIVATE (claims);
+	FuProviderClass *klass = FU_PROVIDER_GET_CLASS (provider);
+
+	g_return_if_fail (FU_IS_CLAIMS (claims));
+	g_return_if_fail (FU_IS_PROVIDER (provider));
+
+	/* this provider never handles raw USB devices */
+	if (klass->claim_usb_device == NULL)
+		return;
+	g_ptr_array_add (priv->providers, g_object_ref (provider));
+}
+
+/* returns the name of the provider that handles this device, asking each
+ * provider in turn the first time the platform ID is seen */
+const gchar *
+fu_claims_lookup (FuClaims *claims, GUsbDevice *usb_device)
+{
+	FuClaimsPrivate *priv = GET_PRIVATE (claims);
+	const gchar *platform_id;
+	const gchar *name;
+
+	g_return_val_if_fail (FU_IS_CLAIMS (claims), NULL);
+	g_return_val_if_fail (G_USB_IS_DEVICE (usb_device), NULL);
+
+	/* already decided */
+	platform_id = g_usb_device_get_platform_id (usb_device);
+	if (g_hash_table_contains (priv->claims, platform_id))
+		return g_hash_table_lookup (priv->claims, platform_id);
+
+	/* first provider wins, which is the order they were added */
+	for (guint i = 0; i < priv->providers->len; i++) {
+		FuProvider *provider = g_ptr_array_index (priv->providers, i);
+		if (!fu_provider_claim_usb_device (provider, usb_device))
+			continue;
+		name = fu_provider_get_name (provider);
+		g_debug ("%s claimed by %s", platform_id, name);
+		g_hash_table_insert (priv->claims,
+				     g_strdup (platform_id),
+				     g_strdup (name));
+		return name;
+	}
+
+	/* remember that nobody wanted it */
+	g_hash_table_insert (priv->claims, g_strdup (platform_id), NULL);
+	return NULL;
+}
+
+void
+fu_claims_remove (FuClaims *claims, GUsbDevice *usb_device)
+{
+	FuClaimsPrivate *priv = GET_PRIVATE (claims);
+	g_return_if_fail (FU_IS_CLAIMS (claims));
+	g_return_if_fail (G_USB_IS_DEVICE (usb_device));
+	g_hash_table_remove (priv->claims,
+			     g_usb_device_get_platform_id (usb_device));
+}
+
+static void
+fu_claims_class_init (FuClaimsClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = fu_claims_finalize;
+}
+
+static void
+fu_claims_init (FuClaims *claims)
+{
+	FuClaimsPrivate *priv = GET_PRIVATE (claims);
+	priv->providers = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	priv->claims = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, g_free);
+}
+
+static void
+fu_claims_finalize (GObject *object)
+{
+	FuClaims *claims = FU_CLAIMS (object);
+	FuClaimsPrivate *priv = GET_PRIVATE (claims);
+
+	g_ptr_array_unref (priv->providers);
+	g_hash_table_unref (priv->claims);
+
+	G_OBJECT_CLASS (fu_claims_parent_class)->finalize (object);
+}
+
+FuClaims *
+fu_claims_new (void)
+{
+	FuClaims *claims;
+	claims = g_object_new (FU_TYPE_CLAIMS, NULL);
+	return FU_CLAIMS (claims);
+}
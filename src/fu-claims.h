@@ -0,0 +1,52 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __FU_CLAIMS_H
+#define __FU_CLAIMS_H
+
+#include <glib-object.h>
+#include <gusb.h>
+
+#include "fu-provider.h"
+
+G_BEGIN_DECLS
+
+#define FU_TYPE_CLAIMS (fu_claims_get_type ())
+G_DECLARE_DERIVABLE_TYPE (FuClaims, fu_claims, FU, CLAIMS, GObject)
+
+struct _FuClaimsClass
+{
+	GObjectClass		 parent_class;
+};
+
+FuClaims	*fu_claims_new				(void);
+
+void		 fu_claims_add_provider			(FuClaims	*claims,
+							 FuProvider	*provider);
+const gchar	*fu_claims_lookup			(FuClaims	*claims,
+							 GUsbDevice	*usb_device);
+void		 fu_claims_remove			(FuClaims	*claims,
+							 GUsbDevice	*usb_device);
+
+G_END_DECLS
+
+#endif /* __FU_CLAIMS_H */
+
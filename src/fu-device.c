@@ -105,6 +105,24 @@ fu_device_set_metadata (FuDevice *device, const gchar *key, const gchar *value)
 	g_hash_table_insert (priv->metadata, g_strdup (key), g_strdup (value));
 }
 
+/* copies all the metadata from @donor, replacing any keys already set */
+void
+fu_device_copy_metadata (FuDevice *device, FuDevice *donor)
+{
+	FuDevicePrivate *priv = GET_PRIVATE (device);
+	FuDevicePrivate *priv_donor = GET_PRIVATE (donor);
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_return_if_fail (FU_IS_DEVICE (device));
+	g_return_if_fail (FU_IS_DEVICE (donor));
+	g_hash_table_iter_init (&iter, priv_donor->metadata);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_hash_table_insert (priv->metadata,
+				     g_strdup (key), g_strdup (value));
+	}
+}
+
 void
 fu_device_set_name (FuDevice *device, const gchar *value)
 {
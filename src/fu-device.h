@@ -103,6 +103,8 @@ const gchar	*fu_device_get_metadata			(FuDevice	*device,
 void		 fu_device_set_metadata			(FuDevice	*device,
 							 const gchar	*key,
 							 const gchar	*value);
+void		 fu_device_copy_metadata		(FuDevice	*device,
+							 FuDevice	*donor);
 void		 fu_device_set_name			(FuDevice	*device,
 							 const gchar	*value);
 
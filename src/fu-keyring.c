@@ -21,6 +21,7 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <fwupd.h>
 #include <gpgme.h>
 
@@ -416,6 +417,137 @@ fu_keyring_verify_data (FuKeyring *keyring,
 	return TRUE;
 }
 
+typedef struct {
+	GInputStream		*stream;
+	GOutputStream		*stream_copy;
+	guint64			 size;
+	guint64			 size_max;
+	GError			*error;
+} FuKeyringStreamHelper;
+
+/* gpgme pulls the payload through this as it hashes it */
+static ssize_t
+fu_keyring_stream_read_cb (void *handle, void *buffer, size_t size)
+{
+	FuKeyringStreamHelper *helper = (FuKeyringStreamHelper *) handle;
+	gssize len;
+
+	if (helper->error != NULL) {
+		errno = EIO;
+		return -1;
+	}
+	len = g_input_stream_read (helper->stream, buffer, size,
+				   NULL, &helper->error);
+	if (len < 0) {
+		errno = EIO;
+		return -1;
+	}
+	helper->size += (guint64) len;
+	if (helper->size > helper->size_max) {
+		g_set_error (&helper->error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "payload is too large, maximum is %" G_GUINT64_FORMAT " bytes",
+			     helper->size_max);
+		errno = EIO;
+		return -1;
+	}
+	if (len > 0 && helper->stream_copy != NULL) {
+		if (!g_output_stream_write_all (helper->stream_copy, buffer,
+						(gsize) len, NULL,
+						NULL, &helper->error)) {
+			errno = EIO;
+			return -1;
+		}
+	}
+	return len;
+}
+
+/* verifies the payload without loading it all into memory, optionally
+ * copying everything that was verified into @payload_copy; reading stops
+ * with an error once more than @payload_size_max bytes have been read */
+gboolean
+fu_keyring_verify_stream (FuKeyring *keyring,
+			  GInputStream *payload,
+			  GOutputStream *payload_copy,
+			  GBytes *payload_signature,
+			  guint64 payload_size_max,
+			  GError **error)
+{
+	FuKeyringPrivate *priv = GET_PRIVATE (keyring);
+	FuKeyringStreamHelper helper = { payload, payload_copy, 0,
+					 payload_size_max, NULL };
+	gpgme_error_t rc;
+	gpgme_signature_t s;
+	gpgme_verify_result_t result;
+	struct gpgme_data_cbs cbs = { fu_keyring_stream_read_cb, NULL, NULL, NULL };
+	g_auto(gpgme_data_t) data = NULL;
+	g_auto(gpgme_data_t) sig = NULL;
+
+	g_return_val_if_fail (FU_IS_KEYRING (keyring), FALSE);
+	g_return_val_if_fail (G_IS_INPUT_STREAM (payload), FALSE);
+	g_return_val_if_fail (payload_signature != NULL, FALSE);
+
+	/* setup context */
+	if (!fu_keyring_setup (keyring, error))
+		return FALSE;
+
+	/* read the payload on demand */
+	rc = gpgme_data_new_from_cbs (&data, &cbs, &helper);
+	if (rc != GPG_ERR_NO_ERROR) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INTERNAL,
+			     "failed to load data: %s",
+			     gpgme_strerror (rc));
+		return FALSE;
+	}
+	rc = gpgme_data_new_from_mem (&sig,
+				      g_bytes_get_data (payload_signature, NULL),
+				      g_bytes_get_size (payload_signature), 0);
+	if (rc != GPG_ERR_NO_ERROR) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INTERNAL,
+			     "failed to load signature: %s",
+			      gpgme_strerror (rc));
+		return FALSE;
+	}
+
+	/* verify */
+	rc = gpgme_op_verify (priv->ctx, sig, data, NULL);
+	if (helper.error != NULL) {
+		g_propagate_error (error, helper.error);
+		return FALSE;
+	}
+	if (rc != GPG_ERR_NO_ERROR) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INTERNAL,
+			     "failed to verify data: %s",
+			     gpgme_strerror (rc));
+		return FALSE;
+	}
+
+	/* verify the result */
+	result = gpgme_op_verify_result (priv->ctx);
+	if (result == NULL) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "no result record from libgpgme");
+		return FALSE;
+	}
+
+	/* look at each signature */
+	for (s = result->signatures; s != NULL ; s = s->next ) {
+		g_debug ("returned signature fingerprint %s", s->fpr);
+		if (!fu_keyring_check_signature (s, error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
 static void
 fu_keyring_class_init (FuKeyringClass *klass)
 {
@@ -51,6 +51,12 @@ gboolean	 fu_keyring_verify_data			(FuKeyring	*keyring,
 							 GBytes		*payload,
 							 GBytes		*payload_signature,
 							 GError		**error);
+gboolean	 fu_keyring_verify_stream		(FuKeyring	*keyring,
+							 GInputStream	*payload,
+							 GOutputStream	*payload_copy,
+							 GBytes		*payload_signature,
+							 guint64	 payload_size_max,
+							 GError		**error);
 
 G_END_DECLS
 
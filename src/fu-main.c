@@ -27,14 +27,20 @@
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
 #include <gio/gunixinputstream.h>
+#include <gio/gunixoutputstream.h>
 #include <glib/gi18n.h>
+#include <errno.h>
 #include <locale.h>
 #include <polkit/polkit.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "fwupd-enums-private.h"
 
+#include "fu-cab.h"
+#include "fu-claims.h"
 #include "fu-debug.h"
 #include "fu-device.h"
 #include "fu-plugin.h"
@@ -48,6 +54,7 @@
 #include "fu-provider-usb.h"
 #include "fu-resources.h"
 #include "fu-quirks.h"
+#include "fu-store-cache.h"
 
 #ifdef HAVE_COLORHUG
   #include "fu-provider-chug.h"
@@ -64,7 +71,9 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC(PolkitAuthorizationResult, g_object_unref)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(PolkitSubject, g_object_unref)
 #endif
 
-#define FU_MAIN_FIRMWARE_SIZE_MAX	(32 * 1024 * 1024)	/* bytes */
+#define FU_MAIN_FIRMWARE_SIZE_MAX	256			/* MiB, unless set in fwupd.conf */
+#define FU_MAIN_METADATA_XML		"/var/cache/app-info/xmls/fwupd.xml"
+#define FU_MAIN_METADATA_SIZE_MAX	(64 * 1024 * 1024)	/* bytes */
 
 typedef struct {
 	GDBusConnection		*connection;
@@ -72,25 +81,51 @@ typedef struct {
 	GDBusProxy		*proxy_uid;
 	GDBusProxy		*proxy_upower;
 	GKeyFile		*config;
+	guint64			 firmware_size_max;	/* bytes */
 	GMainLoop		*loop;
 	GPtrArray		*devices;	/* of FuDeviceItem */
+	GHashTable		*devices_by_id;	/* of id : FuDeviceItem */
+	GHashTable		*devices_by_guid; /* of guid : GPtrArray of FuDeviceItem */
+	GVariant		*devices_variant; /* cached GetDevices reply */
 	GPtrArray		*providers;
+	GHashTable		*providers_by_name; /* of name : FuProvider */
 	PolkitAuthority		*authority;
 	FwupdStatus		 status;
 	guint			 percentage;
 	FuPending		*pending;
+	FuClaims		*claims;
 	AsProfile		*profile;
 	AsStore			*store;
+	GHashTable		*store_index;	/* of guid : FuMainStoreEntry */
+	gboolean		 store_index_dirty;
+	guint			 store_serial;
 	guint			 store_changed_id;
 	GHashTable		*plugins;	/* of name : FuPlugin */
+	GPtrArray		*update_lanes;	/* of FuMainUpdateLane, or NULL */
 } FuMainPrivate;
 
 typedef struct {
 	FuDevice		*device;
 	FuProvider		*provider;
+	guint			 store_serial;	/* of the matched FuMainStoreEntry */
+	gchar			*store_version;	/* device version when matched */
+	guint64			 store_flags;	/* updatable flags when matched */
+	gboolean		 has_update;
+	GVariant		*variant;	/* cached "{sa{sv}}" of device */
+	guint			 variant_serial;	/* of device when cached */
 } FuDeviceItem;
 
+typedef struct {
+	AsApp			*app;
+	GPtrArray		*releases;	/* of AsRelease with a version */
+	AsRelease		*release_default;
+	guint			 releases_len;
+	guint			 serial;
+	guint			 refcount;
+} FuMainStoreEntry;
+
 static gboolean fu_main_get_updates_item_update (FuMainPrivate *priv, FuDeviceItem *item);
+static gboolean fu_main_get_updates_item_is_stale (FuMainPrivate *priv, FuDeviceItem *item);
 
 static void
 fu_main_emit_changed (FuMainPrivate *priv)
@@ -216,8 +251,33 @@ fu_main_set_percentage (FuMainPrivate *priv, guint percentage)
 				       g_variant_new_uint32 (percentage));
 }
 
+static gboolean
+fu_main_item_variant_is_valid (FuDeviceItem *item)
+{
+	if (item->variant == NULL)
+		return FALSE;
+	return item->variant_serial == fwupd_result_get_serial (FWUPD_RESULT (item->device));
+}
+
+/* only serialize the device again if a property has been set */
 static GVariant *
-fu_main_device_array_to_variant (GPtrArray *devices, GError **error)
+fu_main_item_get_variant (FuMainPrivate *priv, FuDeviceItem *item)
+{
+	if (fu_main_item_variant_is_valid (item))
+		return item->variant;
+	if (item->variant != NULL)
+		g_variant_unref (item->variant);
+	item->variant = g_variant_ref_sink (fwupd_result_to_data (FWUPD_RESULT (item->device),
+								 "{sa{sv}}"));
+	item->variant_serial = fwupd_result_get_serial (FWUPD_RESULT (item->device));
+
+	/* the GetDevices reply is now out of date */
+	g_clear_pointer (&priv->devices_variant, g_variant_unref);
+	return item->variant;
+}
+
+static GVariant *
+fu_main_device_array_to_variant (FuMainPrivate *priv, GPtrArray *devices, GError **error)
 {
 	GVariantBuilder builder;
 
@@ -232,15 +292,38 @@ fu_main_device_array_to_variant (GPtrArray *devices, GError **error)
 
 	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
 	for (guint i = 0; i < devices->len; i++) {
-		GVariant *tmp;
-		FuDeviceItem *item;
-		item = g_ptr_array_index (devices, i);
-		tmp = fwupd_result_to_data (FWUPD_RESULT (item->device), "{sa{sv}}");
-		g_variant_builder_add_value (&builder, tmp);
+		FuDeviceItem *item = g_ptr_array_index (devices, i);
+		g_variant_builder_add_value (&builder,
+					     fu_main_item_get_variant (priv, item));
 	}
 	return g_variant_new ("(a{sa{sv}})", &builder);
 }
 
+/* returns a borrowed reference, which is fine for GDBus as it only sinks
+ * floating references */
+static GVariant *
+fu_main_get_devices_variant (FuMainPrivate *priv, GError **error)
+{
+	GVariant *val;
+
+	/* any device changed since the reply was built */
+	for (guint i = 0; i < priv->devices->len; i++) {
+		FuDeviceItem *item = g_ptr_array_index (priv->devices, i);
+		if (!fu_main_item_variant_is_valid (item)) {
+			g_clear_pointer (&priv->devices_variant, g_variant_unref);
+			break;
+		}
+	}
+	if (priv->devices_variant != NULL)
+		return priv->devices_variant;
+
+	val = fu_main_device_array_to_variant (priv, priv->devices, error);
+	if (val == NULL)
+		return NULL;
+	priv->devices_variant = g_variant_ref_sink (val);
+	return priv->devices_variant;
+}
+
 static void
 fu_main_invocation_return_value (FuMainPrivate *priv,
 				 GDBusMethodInvocation *invocation,
@@ -335,42 +418,136 @@ fu_main_item_free (FuDeviceItem *item)
 {
 	g_object_unref (item->device);
 	g_object_unref (item->provider);
+	if (item->variant != NULL)
+		g_variant_unref (item->variant);
+	g_free (item->store_version);
 	g_free (item);
 }
 
 static FuDeviceItem *
 fu_main_get_item_by_id (FuMainPrivate *priv, const gchar *id)
 {
-	for (guint i = 0; i < priv->devices->len; i++) {
-		FuDeviceItem *item = g_ptr_array_index (priv->devices, i);
-		if (g_strcmp0 (fu_device_get_id (item->device), id) == 0)
-			return item;
-		if (g_strcmp0 (fu_device_get_equivalent_id (item->device), id) == 0)
-			return item;
-	}
-	return NULL;
+	if (id == NULL)
+		return NULL;
+	return g_hash_table_lookup (priv->devices_by_id, id);
 }
 
 static FuDeviceItem *
 fu_main_get_item_by_guid (FuMainPrivate *priv, const gchar *guid)
 {
-	for (guint i = 0; i < priv->devices->len; i++) {
-		FuDeviceItem *item = g_ptr_array_index (priv->devices, i);
-		if (fu_device_has_guid (item->device, guid))
-			return item;
-	}
-	return NULL;
+	GPtrArray *items;
+	if (guid == NULL)
+		return NULL;
+	items = g_hash_table_lookup (priv->devices_by_guid, guid);
+	if (items == NULL)
+		return NULL;
+	return g_ptr_array_index (items, 0);
 }
 
 static FuProvider *
 fu_main_get_provider_by_name (FuMainPrivate *priv, const gchar *name)
 {
-	for (guint i = 0; i < priv->providers->len; i++) {
-		FuProvider *provider = g_ptr_array_index (priv->providers, i);
-		if (g_strcmp0 (fu_provider_get_name (provider), name) == 0)
-			return provider;
+	if (name == NULL)
+		return NULL;
+	return g_hash_table_lookup (priv->providers_by_name, name);
+}
+
+static void
+fu_main_item_index_id (FuMainPrivate *priv, FuDeviceItem *item, const gchar *id)
+{
+	/* the first device added with this ID wins */
+	if (id == NULL)
+		return;
+	if (g_hash_table_contains (priv->devices_by_id, id))
+		return;
+	g_hash_table_insert (priv->devices_by_id, g_strdup (id), item);
+}
+
+/* this is safe to call again when the device gains new GUIDs */
+static void
+fu_main_item_index_add (FuMainPrivate *priv, FuDeviceItem *item)
+{
+	GPtrArray *guids;
+
+	fu_main_item_index_id (priv, item, fu_device_get_id (item->device));
+	fu_main_item_index_id (priv, item, fu_device_get_equivalent_id (item->device));
+
+	guids = fu_device_get_guids (item->device);
+	for (guint i = 0; i < guids->len; i++) {
+		const gchar *guid = g_ptr_array_index (guids, i);
+		GPtrArray *items = g_hash_table_lookup (priv->devices_by_guid, guid);
+		if (items == NULL) {
+			items = g_ptr_array_new ();
+			g_hash_table_insert (priv->devices_by_guid,
+					     g_strdup (guid), items);
+		}
+		for (guint j = 0; j < items->len; j++) {
+			if (g_ptr_array_index (items, j) == item) {
+				items = NULL;
+				break;
+			}
+		}
+		if (items != NULL)
+			g_ptr_array_add (items, item);
 	}
-	return NULL;
+}
+
+static void
+fu_main_item_unindex_id (FuMainPrivate *priv, FuDeviceItem *item, const gchar *id)
+{
+	if (id == NULL)
+		return;
+	if (g_hash_table_lookup (priv->devices_by_id, id) != item)
+		return;
+	g_hash_table_remove (priv->devices_by_id, id);
+
+	/* another device may also use this ID */
+	for (guint i = 0; i < priv->devices->len; i++) {
+		FuDeviceItem *item_tmp = g_ptr_array_index (priv->devices, i);
+		if (item_tmp == item)
+			continue;
+		if (g_strcmp0 (fu_device_get_id (item_tmp->device), id) == 0 ||
+		    g_strcmp0 (fu_device_get_equivalent_id (item_tmp->device), id) == 0) {
+			g_hash_table_insert (priv->devices_by_id, g_strdup (id), item_tmp);
+			break;
+		}
+	}
+}
+
+static void
+fu_main_item_index_remove (FuMainPrivate *priv, FuDeviceItem *item)
+{
+	GPtrArray *guids;
+
+	fu_main_item_unindex_id (priv, item, fu_device_get_id (item->device));
+	fu_main_item_unindex_id (priv, item, fu_device_get_equivalent_id (item->device));
+
+	guids = fu_device_get_guids (item->device);
+	for (guint i = 0; i < guids->len; i++) {
+		const gchar *guid = g_ptr_array_index (guids, i);
+		GPtrArray *items = g_hash_table_lookup (priv->devices_by_guid, guid);
+		if (items == NULL)
+			continue;
+		g_ptr_array_remove (items, item);
+		if (items->len == 0)
+			g_hash_table_remove (priv->devices_by_guid, guid);
+	}
+}
+
+static void
+fu_main_add_item (FuMainPrivate *priv, FuDeviceItem *item)
+{
+	g_clear_pointer (&priv->devices_variant, g_variant_unref);
+	g_ptr_array_add (priv->devices, item);
+	fu_main_item_index_add (priv, item);
+}
+
+static void
+fu_main_remove_item (FuMainPrivate *priv, FuDeviceItem *item)
+{
+	g_clear_pointer (&priv->devices_variant, g_variant_unref);
+	fu_main_item_index_remove (priv, item);
+	g_ptr_array_remove (priv->devices, item);
 }
 
 static gboolean
@@ -460,8 +637,22 @@ typedef struct {
 	gboolean		 is_downgrade;
 	FuMainAuthKind		 auth_kind;
 	FuMainPrivate		*priv;
+	GError			*error;		/* first lane to fail */
+	guint			 lanes_pending;
 } FuMainAuthHelper;
 
+typedef struct {
+	FuMainAuthHelper	*helper;
+	FuProvider		*provider;
+	GPtrArray		*devices;	/* of FuDevice */
+	GPtrArray		*devices_copy;	/* of FuDevice, or NULL */
+	GPtrArray		*blob_fws;	/* of GBytes */
+	GPtrArray		*plugins;	/* of FuPlugin, or NULL */
+	gboolean		 needs_main_context;
+	gint			 done;		/* atomic */
+	guint			 percentage;	/* of the device being updated */
+} FuMainUpdateLane;
+
 static void
 fu_main_helper_free (FuMainAuthHelper *helper)
 {
@@ -474,10 +665,24 @@ fu_main_helper_free (FuMainAuthHelper *helper)
 		g_bytes_unref (helper->blob_cab);
 	if (helper->store != NULL)
 		g_object_unref (helper->store);
+	if (helper->error != NULL)
+		g_error_free (helper->error);
 	g_object_unref (helper->invocation);
 	g_free (helper);
 }
 
+static void
+fu_main_update_lane_free (FuMainUpdateLane *lane)
+{
+	g_object_unref (lane->provider);
+	g_ptr_array_unref (lane->devices);
+	if (lane->devices_copy != NULL)
+		g_ptr_array_unref (lane->devices_copy);
+	g_ptr_array_unref (lane->blob_fws);
+	g_ptr_array_unref (lane->plugins);
+	g_free (lane);
+}
+
 static gboolean
 fu_main_on_battery (FuMainPrivate *priv)
 {
@@ -519,6 +724,9 @@ fu_main_provider_unlock_authenticated (FuMainAuthHelper *helper, GError **error)
 					 error))
 			return FALSE;
 
+		/* the device may now have more GUIDs */
+		fu_main_item_index_add (helper->priv, item);
+
 		/* make the UI update */
 		fu_main_emit_device_changed (helper->priv, item->device);
 	}
@@ -529,11 +737,233 @@ fu_main_provider_unlock_authenticated (FuMainAuthHelper *helper, GError **error)
 	return TRUE;
 }
 
+/* the percentage of all the devices being updated */
+static guint
+fu_main_update_lanes_get_percentage (GPtrArray *lanes)
+{
+	guint64 done = 0;
+	guint64 total = 0;
+
+	for (guint i = 0; i < lanes->len; i++) {
+		FuMainUpdateLane *lane = g_ptr_array_index (lanes, i);
+		guint64 lane_total = lane->devices->len * 100;
+		guint64 lane_done;
+		lane_done = (guint64) g_atomic_int_get (&lane->done) * 100;
+		lane_done += MIN (lane->percentage, 100);
+		done += MIN (lane_done, lane_total);
+		total += lane_total;
+	}
+	if (total == 0)
+		return 0;
+	return (guint) ((done * 100) / total);
+}
+
+static FuMainUpdateLane *
+fu_main_update_lanes_get_by_provider (GPtrArray *lanes, FuProvider *provider)
+{
+	for (guint i = 0; i < lanes->len; i++) {
+		FuMainUpdateLane *lane = g_ptr_array_index (lanes, i);
+		if (lane->provider == provider)
+			return lane;
+	}
+	return NULL;
+}
+
+/* the main context reads the registered devices at any time, so a worker
+ * thread only ever sees a private copy of what the providers use */
+static FuDevice *
+fu_main_update_lane_copy_device (FuDevice *device)
+{
+	FuDevice *copy = fu_device_new ();
+	GPtrArray *guids = fu_device_get_guids (device);
+
+	fu_device_set_id (copy, fu_device_get_id (device));
+	fu_device_set_unique_id (copy, fwupd_result_get_unique_id (FWUPD_RESULT (device)));
+	for (guint i = 0; i < guids->len; i++)
+		fu_device_add_guid (copy, g_ptr_array_index (guids, i));
+	fwupd_result_set_device_name (FWUPD_RESULT (copy), fu_device_get_name (device));
+	fu_device_set_provider (copy, fu_device_get_provider (device));
+	fu_device_set_version (copy, fu_device_get_version (device));
+	fu_device_set_flags (copy, fu_device_get_flags (device));
+	fu_device_set_update_filename (copy, fu_device_get_update_filename (device));
+	fu_device_set_update_version (copy, fu_device_get_update_version (device));
+	fu_device_copy_metadata (copy, device);
+	return copy;
+}
+
+/* copy back what the provider changed, in the main context */
+static void
+fu_main_update_lane_sync_device (FuDevice *device, FuDevice *copy)
+{
+	if (g_strcmp0 (fu_device_get_version (device),
+		       fu_device_get_version (copy)) != 0)
+		fu_device_set_version (device, fu_device_get_version (copy));
+	if (fu_device_get_flags (device) != fu_device_get_flags (copy))
+		fu_device_set_flags (device, fu_device_get_flags (copy));
+	if (fu_device_get_update_state (device) != fu_device_get_update_state (copy))
+		fu_device_set_update_state (device, fu_device_get_update_state (copy));
+	if (g_strcmp0 (fu_device_get_update_error (device),
+		       fu_device_get_update_error (copy)) != 0)
+		fu_device_set_update_error (device, fu_device_get_update_error (copy));
+}
+
+/* runs in a worker thread, or in the main thread if the lane cannot */
+static void
+fu_main_update_lane_run_cb (GTask *task,
+			    gpointer source_object,
+			    gpointer task_data,
+			    GCancellable *cancellable)
+{
+	FuMainUpdateLane *lane = (FuMainUpdateLane *) task_data;
+	GPtrArray *devices = lane->devices;
+
+	/* never touch the registered devices from a worker thread */
+	if (lane->devices_copy != NULL)
+		devices = lane->devices_copy;
+
+	/* devices with the same provider are never updated in parallel */
+	for (guint i = 0; i < devices->len; i++) {
+		FuDevice *device = g_ptr_array_index (devices, i);
+		GError *error = NULL;
+		if (!fu_provider_update (lane->provider,
+					 device,
+					 lane->helper->blob_cab,
+					 g_ptr_array_index (lane->blob_fws, i),
+					 g_ptr_array_index (lane->plugins, i),
+					 lane->helper->flags,
+					 &error)) {
+			g_task_return_error (task, error);
+			return;
+		}
+		g_atomic_int_inc (&lane->done);
+	}
+	g_task_return_boolean (task, TRUE);
+}
+
 static gboolean
-fu_main_provider_update_authenticated (FuMainAuthHelper *helper, GError **error)
+fu_main_update_lane_idle_cb (gpointer user_data)
+{
+	g_autoptr(GTask) task = G_TASK (user_data);
+	fu_main_update_lane_run_cb (task, NULL, g_task_get_task_data (task), NULL);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+fu_main_update_lane_done_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	FuMainUpdateLane *lane = g_task_get_task_data (G_TASK (res));
+	FuMainAuthHelper *helper = lane->helper;
+	FuMainPrivate *priv = helper->priv;
+	GError *error = NULL;
+
+	/* save the first failure, but let the other lanes finish */
+	if (!g_task_propagate_boolean (G_TASK (res), &error)) {
+		g_warning ("failed to update %s devices: %s",
+			   fu_provider_get_name (lane->provider),
+			   error->message);
+		if (helper->error == NULL)
+			helper->error = error;
+		else
+			g_error_free (error);
+	}
+
+	/* the worker has finished with the copies */
+	if (lane->devices_copy != NULL) {
+		for (guint i = 0; i < lane->devices->len; i++) {
+			fu_main_update_lane_sync_device (g_ptr_array_index (lane->devices, i),
+							 g_ptr_array_index (lane->devices_copy, i));
+		}
+	}
+
+	/* make the UI update */
+	for (gint i = 0; i < g_atomic_int_get (&lane->done); i++) {
+		FuDevice *device = g_ptr_array_index (lane->devices, i);
+		fu_device_set_modified (device, (guint64) g_get_real_time () / G_USEC_PER_SEC);
+		fu_main_emit_device_changed (priv, device);
+	}
+	fu_main_set_percentage (priv, fu_main_update_lanes_get_percentage (priv->update_lanes));
+
+	/* wait for the others */
+	if (--helper->lanes_pending > 0)
+		return;
+
+	/* all done */
+	g_ptr_array_unref (priv->update_lanes);
+	priv->update_lanes = NULL;
+	fu_main_emit_changed (priv);
+	if (helper->error != NULL) {
+		fu_main_invocation_return_error (priv, helper->invocation, helper->error);
+	} else {
+		fu_main_invocation_return_value (priv, helper->invocation, NULL);
+	}
+	fu_main_helper_free (helper);
+}
+
+static gboolean
+fu_main_provider_update_offline (FuMainAuthHelper *helper, GError **error)
 {
 	FuDeviceItem *item;
 	FuPlugin *plugin;
+	gboolean ret = TRUE;
+	g_autoptr(GError) error_local = NULL;
+
+	/* schedule all the offline updates in one database transaction */
+	if (!fu_pending_begin (helper->priv->pending, error))
+		return FALSE;
+
+	/* run the correct providers for each device */
+	for (guint i = 0; i < helper->devices->len; i ++) {
+		FuDevice *device = g_ptr_array_index (helper->devices, i);
+		GBytes *blob_fw = g_ptr_array_index (helper->blob_fws, i);
+		item = fu_main_get_item_by_id (helper->priv,
+					       fu_device_get_id (device));
+		plugin = fu_main_get_plugin_for_device (helper->priv->plugins,
+							item->device);
+		if (!fu_provider_update (item->provider,
+					 item->device,
+					 helper->blob_cab,
+					 blob_fw,
+					 plugin,
+					 helper->flags,
+					 error)) {
+			ret = FALSE;
+			break;
+		}
+
+		/* make the UI update */
+		fu_device_set_modified (item->device, (guint64) g_get_real_time () / G_USEC_PER_SEC);
+		fu_main_emit_device_changed (helper->priv, item->device);
+	}
+
+	/* any devices already scheduled stay scheduled */
+	if (!fu_pending_commit (helper->priv->pending, &error_local)) {
+		if (ret) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return FALSE;
+		}
+		g_warning ("failed to commit: %s", error_local->message);
+	}
+	if (!ret)
+		return FALSE;
+
+	/* make the UI update */
+	fu_main_emit_changed (helper->priv);
+	return TRUE;
+}
+
+static gboolean
+fu_main_provider_update_check (FuMainAuthHelper *helper, GError **error)
+{
+	FuDeviceItem *item;
+
+	/* only one update at a time */
+	if (helper->priv->update_lanes != NULL) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "Already updating devices");
+		return FALSE;
+	}
 
 	/* check the devices still exists */
 	for (guint i = 0; i < helper->devices->len; i ++) {
@@ -582,32 +1012,101 @@ fu_main_provider_update_authenticated (FuMainAuthHelper *helper, GError **error)
 			}
 		}
 	}
+	return TRUE;
+}
 
-	/* run the correct providers for each device */
+/* takes ownership of @helper and returns the method invocation when done */
+static void
+fu_main_provider_update_authenticated (FuMainAuthHelper *helper)
+{
+	FuMainPrivate *priv = helper->priv;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) lanes = NULL;
+
+	if (!fu_main_provider_update_check (helper, &error)) {
+		fu_main_invocation_return_error (priv, helper->invocation, error);
+		fu_main_helper_free (helper);
+		return;
+	}
+
+	/* offline updates only write to the database */
+	if (helper->flags & FWUPD_INSTALL_FLAG_OFFLINE) {
+		if (!fu_main_provider_update_offline (helper, &error)) {
+			fu_main_invocation_return_error (priv, helper->invocation, error);
+		} else {
+			fu_main_invocation_return_value (priv, helper->invocation, NULL);
+		}
+		fu_main_helper_free (helper);
+		return;
+	}
+
+	/* group the devices by provider, as each provider can only update one
+	 * device at a time, but different providers can run in parallel */
+	lanes = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_main_update_lane_free);
 	for (guint i = 0; i < helper->devices->len; i ++) {
 		FuDevice *device = g_ptr_array_index (helper->devices, i);
-		GBytes *blob_fw = g_ptr_array_index (helper->blob_fws, i);
-		item = fu_main_get_item_by_id (helper->priv,
-					       fu_device_get_id (device));
-		plugin = fu_main_get_plugin_for_device (helper->priv->plugins,
-							item->device);
-		if (!fu_provider_update (item->provider,
-					 item->device,
-					 helper->blob_cab,
-					 blob_fw,
-					 plugin,
-					 helper->flags,
-					 error))
-			return FALSE;
-
-		/* make the UI update */
-		fu_device_set_modified (item->device, (guint64) g_get_real_time () / G_USEC_PER_SEC);
-		fu_main_emit_device_changed (helper->priv, item->device);
+		FuDeviceItem *item;
+		FuMainUpdateLane *lane;
+		FuPlugin *plugin;
+
+		item = fu_main_get_item_by_id (priv, fu_device_get_id (device));
+		lane = fu_main_update_lanes_get_by_provider (lanes, item->provider);
+		if (lane == NULL) {
+			lane = g_new0 (FuMainUpdateLane, 1);
+			lane->helper = helper;
+			lane->provider = g_object_ref (item->provider);
+			lane->devices = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+			lane->blob_fws = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+			lane->plugins = g_ptr_array_new ();
+			lane->needs_main_context = !fu_provider_get_update_in_thread (item->provider);
+			g_ptr_array_add (lanes, lane);
+		}
+		plugin = fu_main_get_plugin_for_device (priv->plugins, item->device);
+		if (plugin != NULL)
+			lane->needs_main_context = TRUE;
+		g_ptr_array_add (lane->devices, g_object_ref (item->device));
+		g_ptr_array_add (lane->blob_fws,
+				 g_bytes_ref (g_ptr_array_index (helper->blob_fws, i)));
+		g_ptr_array_add (lane->plugins, plugin);
+	}
+
+	/* the D-Bus interface stays responsive while the workers run */
+	priv->update_lanes = g_ptr_array_ref (lanes);
+	helper->lanes_pending = lanes->len;
+	fu_main_set_percentage (priv, 0);
+
+	/* start all the workers first */
+	for (guint i = 0; i < lanes->len; i++) {
+		FuMainUpdateLane *lane = g_ptr_array_index (lanes, i);
+		g_autoptr(GTask) task = NULL;
+		if (lane->needs_main_context)
+			continue;
+		g_debug ("updating %s devices in a worker thread",
+			 fu_provider_get_name (lane->provider));
+		lane->devices_copy = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+		for (guint j = 0; j < lane->devices->len; j++) {
+			FuDevice *device = g_ptr_array_index (lane->devices, j);
+			g_ptr_array_add (lane->devices_copy,
+					 fu_main_update_lane_copy_device (device));
+		}
+		task = g_task_new (NULL, NULL, fu_main_update_lane_done_cb, NULL);
+		g_task_set_task_data (task, lane, NULL);
+		g_task_run_in_thread (task, fu_main_update_lane_run_cb);
 	}
 
-	/* make the UI update */
-	fu_main_emit_changed (helper->priv);
-	return TRUE;
+	/* then the lanes that block the main context, each from an idle so
+	 * that this method call returns first */
+	for (guint i = 0; i < lanes->len; i++) {
+		FuMainUpdateLane *lane = g_ptr_array_index (lanes, i);
+		GTask *task;
+		if (!lane->needs_main_context)
+			continue;
+		g_debug ("updating %s devices in the main thread",
+			 fu_provider_get_name (lane->provider));
+		task = g_task_new (NULL, NULL, fu_main_update_lane_done_cb, NULL);
+		g_task_set_task_data (task, lane, NULL);
+		g_idle_add (fu_main_update_lane_idle_cb, task);
+	}
 }
 
 static void
@@ -643,13 +1142,8 @@ fu_main_check_authorization_cb (GObject *source, GAsyncResult *res, gpointer use
 
 	/* we're good to go */
 	if (helper->auth_kind == FU_MAIN_AUTH_KIND_INSTALL) {
-		if (!fu_main_provider_update_authenticated (helper, &error)) {
-			fu_main_invocation_return_error (helper->priv,
-							 helper->invocation,
-							 error);
-			fu_main_helper_free (helper);
-			return;
-		}
+		fu_main_provider_update_authenticated (helper);
+		return;
 	} else if (helper->auth_kind == FU_MAIN_AUTH_KIND_UNLOCK) {
 		if (!fu_main_provider_unlock_authenticated (helper, &error)) {
 			fu_main_invocation_return_error (helper->priv,
@@ -753,6 +1247,131 @@ fu_main_store_get_app_by_guids (AsStore *store, FuDevice *device)
 	return NULL;
 }
 
+static FuMainStoreEntry *
+fu_main_store_entry_ref (FuMainStoreEntry *entry)
+{
+	entry->refcount++;
+	return entry;
+}
+
+static void
+fu_main_store_entry_unref (FuMainStoreEntry *entry)
+{
+	if (--entry->refcount > 0)
+		return;
+	g_object_unref (entry->app);
+	g_ptr_array_unref (entry->releases);
+	g_free (entry);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FuMainStoreEntry, fu_main_store_entry_unref)
+
+static FuMainStoreEntry *
+fu_main_store_entry_new (FuMainPrivate *priv, AsApp *app)
+{
+	FuMainStoreEntry *entry;
+	GPtrArray *releases;
+
+	/* possibly convert the version from 0x to dotted */
+	fu_main_vendor_quirk_release_version (app);
+
+	entry = g_new0 (FuMainStoreEntry, 1);
+	entry->app = g_object_ref (app);
+	entry->serial = ++priv->store_serial;
+	entry->refcount = 1;
+	entry->release_default = as_app_get_release_default (app);
+	entry->releases = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	releases = as_app_get_releases (app);
+	entry->releases_len = releases->len;
+	for (guint i = 0; i < releases->len; i++) {
+		AsRelease *rel = g_ptr_array_index (releases, i);
+		if (as_release_get_version (rel) == NULL)
+			continue;
+		g_ptr_array_add (entry->releases, g_object_ref (rel));
+	}
+	return entry;
+}
+
+static gboolean
+fu_main_store_entry_is_valid (FuMainStoreEntry *entry, AsApp *app)
+{
+	if (entry->app != app)
+		return FALSE;
+	if (entry->releases_len != as_app_get_releases (app)->len)
+		return FALSE;
+	return entry->release_default == as_app_get_release_default (app);
+}
+
+/* rebuild the GUID index, reusing entries for components that have not
+ * changed so that any cached device matches remain valid */
+static void
+fu_main_store_index_rebuild (FuMainPrivate *priv)
+{
+	GPtrArray *apps;
+	g_autoptr(GHashTable) index_old = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	ptask = as_profile_start_literal (priv->profile, "FuMain:store-index");
+	index_old = priv->store_index;
+	priv->store_index = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   g_free,
+						   (GDestroyNotify) fu_main_store_entry_unref);
+	priv->store_index_dirty = FALSE;
+	apps = as_store_get_apps (priv->store);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		GPtrArray *provides = as_app_get_provides (app);
+		g_autoptr(FuMainStoreEntry) entry = NULL;
+
+		for (guint j = 0; j < provides->len; j++) {
+			AsProvide *prov = g_ptr_array_index (provides, j);
+			FuMainStoreEntry *entry_old;
+			const gchar *guid;
+
+			if (as_provide_get_kind (prov) != AS_PROVIDE_KIND_FIRMWARE_FLASHED)
+				continue;
+			guid = as_provide_get_value (prov);
+			if (guid == NULL)
+				continue;
+
+			/* first component providing the GUID wins */
+			if (g_hash_table_contains (priv->store_index, guid))
+				continue;
+			if (entry == NULL && index_old != NULL) {
+				entry_old = g_hash_table_lookup (index_old, guid);
+				if (entry_old != NULL &&
+				    fu_main_store_entry_is_valid (entry_old, app))
+					entry = fu_main_store_entry_ref (entry_old);
+			}
+			if (entry == NULL)
+				entry = fu_main_store_entry_new (priv, app);
+			g_hash_table_insert (priv->store_index,
+					     g_strdup (guid),
+					     fu_main_store_entry_ref (entry));
+		}
+	}
+	g_debug ("indexed %u GUIDs from %u components",
+		 g_hash_table_size (priv->store_index), apps->len);
+}
+
+static FuMainStoreEntry *
+fu_main_store_index_lookup (FuMainPrivate *priv, FuDevice *device)
+{
+	GPtrArray *guids = fu_device_get_guids (device);
+
+	/* the store changed since the index was built */
+	if (priv->store_index_dirty)
+		fu_main_store_index_rebuild (priv);
+	for (guint i = 0; i < guids->len; i++) {
+		FuMainStoreEntry *entry;
+		entry = g_hash_table_lookup (priv->store_index,
+					     g_ptr_array_index (guids, i));
+		if (entry != NULL)
+			return entry;
+	}
+	return NULL;
+}
+
 static AsScreenshot *
 _as_app_get_screenshot_default (AsApp *app)
 {
@@ -762,6 +1381,43 @@ _as_app_get_screenshot_default (AsApp *app)
 	return g_ptr_array_index (array, 0);
 }
 
+/* only decompress the payload (and detached signature) the release needs */
+static gboolean
+fu_main_release_ensure_blobs (AsRelease *rel,
+			      GBytes *blob_cab,
+			      const gchar *fn,
+			      guint64 size_max,
+			      GError **error)
+{
+	GBytes *blob;
+	const gchar *filenames[] = { fn, NULL, NULL };
+	g_autofree gchar *fn_signature = NULL;
+	g_autoptr(GHashTable) files = NULL;
+
+	/* already extracted for another device */
+	if (as_release_get_blob (rel, fn) != NULL)
+		return TRUE;
+
+	fn_signature = g_strdup_printf ("%s.asc", fn);
+	filenames[1] = fn_signature;
+	files = fu_cab_extract_files (blob_cab, filenames, size_max, error);
+	if (files == NULL)
+		return FALSE;
+	blob = g_hash_table_lookup (files, fn);
+	if (blob == NULL) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_READ,
+			     "failed to find %s in archive", fn);
+		return FALSE;
+	}
+	as_release_set_blob (rel, fn, blob);
+	blob = g_hash_table_lookup (files, fn_signature);
+	if (blob != NULL)
+		as_release_set_blob (rel, fn_signature, blob);
+	return TRUE;
+}
+
 static gboolean
 fu_main_update_helper_for_device (FuMainAuthHelper *helper,
 				  FuDevice *device,
@@ -844,6 +1500,10 @@ fu_main_update_helper_for_device (FuMainAuthHelper *helper,
 	}
 
 	/* not all devices have to use the same blob */
+	if (!fu_main_release_ensure_blobs (rel, helper->blob_cab, tmp,
+					   helper->priv->firmware_size_max,
+					   error))
+		return FALSE;
 	blob_fw = as_release_get_blob (rel, tmp);
 	if (blob_fw == NULL) {
 		g_set_error_literal (error,
@@ -927,9 +1587,10 @@ fu_main_update_helper (FuMainAuthHelper *helper, GError **error)
 {
 	g_autoptr(GError) error_first = NULL;
 
-	/* load store file which also decompresses firmware */
+	/* load the metadata only, the payloads are extracted when matched */
 	fu_main_set_status (helper->priv, FWUPD_STATUS_DECOMPRESSING);
-	if (!as_store_from_bytes (helper->store, helper->blob_cab, NULL, error))
+	if (!fu_cab_load_metadata (helper->store, helper->blob_cab,
+				   helper->priv->firmware_size_max, error))
 		return FALSE;
 
 	/* we've specified a specific device; failure is critical */
@@ -1077,145 +1738,461 @@ fu_main_get_item_by_id_fallback_pending (FuMainPrivate *priv, const gchar *id, G
 			item = g_new0 (FuDeviceItem, 1);
 			item->device = g_object_ref (dev);
 			item->provider = g_object_ref (provider);
-			g_ptr_array_add (priv->devices, item);
+			fu_main_add_item (priv, item);
 
 			/* FIXME: just a boolean on FuDeviceItem? */
 			fu_device_set_metadata (dev, "FakeDevice", "TRUE");
 		}
 		break;
 	}
-
-	/* no device found */
-	if (item == NULL) {
-		g_set_error_literal (error,
-				     FWUPD_ERROR,
-				     FWUPD_ERROR_NOT_FOUND,
-				     "no suitable devices found");
+
+	/* no device found */
+	if (item == NULL) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_NOT_FOUND,
+				     "no suitable devices found");
+	}
+	return item;
+}
+
+static const gchar *
+fu_main_get_action_id_for_device (FuMainAuthHelper *helper)
+{
+	gboolean all_removable = TRUE;
+	gboolean is_trusted;
+
+	/* only test the payload */
+	is_trusted = (helper->trust_flags & FWUPD_TRUST_FLAG_PAYLOAD) > 0;
+
+	/* any non-removable means false */
+	for (guint i = 0; i < helper->devices->len; i ++) {
+		FuDevice *device = g_ptr_array_index (helper->devices, i);
+		if (fu_device_has_flag (device, FWUPD_DEVICE_FLAG_INTERNAL)) {
+			all_removable = FALSE;
+			break;
+		}
+	}
+
+	/* relax authentication checks for removable devices */
+	if (all_removable) {
+		if (helper->is_downgrade)
+			return "org.freedesktop.fwupd.downgrade-hotplug";
+		if (is_trusted)
+			return "org.freedesktop.fwupd.update-hotplug-trusted";
+		return "org.freedesktop.fwupd.update-hotplug";
+	}
+
+	/* internal device */
+	if (helper->is_downgrade)
+		return "org.freedesktop.fwupd.downgrade-internal";
+	if (is_trusted)
+		return "org.freedesktop.fwupd.update-internal-trusted";
+	return "org.freedesktop.fwupd.update-internal";
+}
+
+/* the metadata is only ever gzip compressed or plain AppStream XML, and
+ * the parser chooses the decompressor from the file suffix */
+static const gchar *fu_main_metadata_suffixes[] = { ".xml.gz", ".xml", NULL };
+
+static const gchar *
+fu_main_metadata_get_suffix (const gchar *filename, GError **error)
+{
+	guint8 data[2];
+	gsize size = 0;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFileInputStream) stream = NULL;
+
+	/* peek the file type */
+	file = g_file_new_for_path (filename);
+	stream = g_file_read (file, NULL, error);
+	if (stream == NULL)
+		return NULL;
+	if (!g_input_stream_read_all (G_INPUT_STREAM (stream),
+				      data, sizeof(data), &size,
+				      NULL, error))
+		return NULL;
+	if (size < 2) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "file is too small");
+		return NULL;
+	}
+	if (data[0] == 0x1f && data[1] == 0x8b) {
+		g_debug ("using GZip decompressor for data");
+		return fu_main_metadata_suffixes[0];
+	}
+	if (data[0] == '<' && data[1] == '?') {
+		g_debug ("using no decompressor for data");
+		return fu_main_metadata_suffixes[1];
+	}
+	g_set_error (error,
+		     FWUPD_ERROR,
+		     FWUPD_ERROR_INVALID_FILE,
+		     "file type '0x%02x,0x%02x' not supported",
+		     data[0], data[1]);
+	return NULL;
+}
+
+/* the signed metadata last downloaded from the LVFS, or NULL */
+static gchar *
+fu_main_metadata_get_source (const gchar *cachedir)
+{
+	for (guint i = 0; fu_main_metadata_suffixes[i] != NULL; i++) {
+		g_autofree gchar *basename = NULL;
+		g_autofree gchar *fn = NULL;
+		basename = g_strdup_printf ("metadata%s", fu_main_metadata_suffixes[i]);
+		fn = g_build_filename (cachedir, basename, NULL);
+		if (g_file_test (fn, G_FILE_TEST_EXISTS))
+			return g_steal_pointer (&fn);
+	}
+	return NULL;
+}
+
+/* parses the (optionally compressed) AppStream metadata from the LVFS
+ * incrementally, without loading the whole document into memory */
+static AsStore *
+fu_main_store_from_source (const gchar *filename, GError **error)
+{
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(GFile) file = NULL;
+
+	store = as_store_new ();
+	file = g_file_new_for_path (filename);
+	if (!as_store_from_file (store, file, NULL, NULL, error))
+		return NULL;
+	return g_steal_pointer (&store);
+}
+
+static void
+fu_main_store_add_firmware (FuMainPrivate *priv, AsStore *store)
+{
+	GPtrArray *apps = as_store_get_apps (store);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		as_store_add_app (priv->store, app);
+	}
+}
+
+/* write a binary cache generated from the signed metadata */
+static gboolean
+fu_main_metadata_cache_save (AsStore *store,
+			     const gchar *fn_source,
+			     const gchar *fn_cache,
+			     GError **error)
+{
+	g_autoptr(GBytes) bytes_raw = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+
+	mapped_file = g_mapped_file_new (fn_source, FALSE, error);
+	if (mapped_file == NULL)
+		return FALSE;
+	bytes_raw = g_mapped_file_get_bytes (mapped_file);
+	return fu_store_cache_save (store, bytes_raw, fn_cache, error);
+}
+
+/* the system AppStream directories, without /var/cache/app-info where
+ * FU_MAIN_METADATA_XML is written only for other consumers; the same
+ * metadata is loaded from the binary cache instead */
+static const gchar *fu_main_appstream_dirs[] = {
+	"/usr/share/app-info/xmls",
+	"/var/lib/app-info/xmls",
+	NULL
+};
+
+static gboolean
+fu_main_load_appstream_system (AsStore *store, GError **error)
+{
+	for (guint i = 0; fu_main_appstream_dirs[i] != NULL; i++) {
+		if (!g_file_test (fu_main_appstream_dirs[i], G_FILE_TEST_EXISTS))
+			continue;
+		if (!as_store_load_path (store, fu_main_appstream_dirs[i],
+					 NULL, error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* add the metadata last downloaded from the LVFS, rebuilding the binary
+ * cache from the saved signed metadata if it is missing or out of date */
+static gboolean
+fu_main_metadata_cache_load (FuMainPrivate *priv, GError **error)
+{
+	g_autofree gchar *cachedir = NULL;
+	g_autofree gchar *fn_cache = NULL;
+	g_autofree gchar *fn_source = NULL;
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(GBytes) bytes_raw = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+
+	/* never refreshed */
+	cachedir = g_build_filename (LOCALSTATEDIR, "cache", "fwupd", NULL);
+	fn_source = fu_main_metadata_get_source (cachedir);
+	fn_cache = g_build_filename (cachedir, "metadata.cache", NULL);
+	if (fn_source == NULL)
+		return TRUE;
+	mapped_file = g_mapped_file_new (fn_source, FALSE, error);
+	if (mapped_file == NULL)
+		return FALSE;
+	bytes_raw = g_mapped_file_get_bytes (mapped_file);
+
+	/* fast path */
+	if (fu_store_cache_load (priv->store, bytes_raw, fn_cache, &error_local))
+		return TRUE;
+	g_debug ("rebuilding metadata cache: %s", error_local->message);
+
+	/* the source was verified when it was saved */
+	store = fu_main_store_from_source (fn_source, error);
+	if (store == NULL)
+		return FALSE;
+	fu_main_store_add_firmware (priv, store);
+	return fu_store_cache_save (store, bytes_raw, fn_cache, error);
+}
+
+static gboolean
+fu_main_release_equal (AsRelease *rel1, AsRelease *rel2)
+{
+	GPtrArray *csums1 = as_release_get_checksums (rel1);
+	GPtrArray *csums2 = as_release_get_checksums (rel2);
+
+	if (g_strcmp0 (as_release_get_version (rel1),
+		       as_release_get_version (rel2)) != 0)
+		return FALSE;
+	if (as_release_get_timestamp (rel1) != as_release_get_timestamp (rel2))
+		return FALSE;
+	if (g_strcmp0 (as_release_get_location_default (rel1),
+		       as_release_get_location_default (rel2)) != 0)
+		return FALSE;
+	if (g_strcmp0 (as_release_get_description (rel1, NULL),
+		       as_release_get_description (rel2, NULL)) != 0)
+		return FALSE;
+	if (csums1->len != csums2->len)
+		return FALSE;
+	for (guint i = 0; i < csums1->len; i++) {
+		AsChecksum *csum1 = g_ptr_array_index (csums1, i);
+		AsChecksum *csum2 = g_ptr_array_index (csums2, i);
+		if (as_checksum_get_target (csum1) != as_checksum_get_target (csum2))
+			return FALSE;
+		if (g_strcmp0 (as_checksum_get_value (csum1),
+			       as_checksum_get_value (csum2)) != 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* only compares what is used when matching and reporting updates */
+static gboolean
+fu_main_app_equal (AsApp *app1, AsApp *app2)
+{
+	GPtrArray *provides1 = as_app_get_provides (app1);
+	GPtrArray *provides2 = as_app_get_provides (app2);
+	GPtrArray *releases1 = as_app_get_releases (app1);
+	GPtrArray *releases2 = as_app_get_releases (app2);
+
+	if (g_strcmp0 (as_app_get_name (app1, NULL),
+		       as_app_get_name (app2, NULL)) != 0)
+		return FALSE;
+	if (g_strcmp0 (as_app_get_comment (app1, NULL),
+		       as_app_get_comment (app2, NULL)) != 0)
+		return FALSE;
+	if (g_strcmp0 (as_app_get_description (app1, NULL),
+		       as_app_get_description (app2, NULL)) != 0)
+		return FALSE;
+	if (g_strcmp0 (as_app_get_developer_name (app1, NULL),
+		       as_app_get_developer_name (app2, NULL)) != 0)
+		return FALSE;
+	if (g_strcmp0 (as_app_get_project_license (app1),
+		       as_app_get_project_license (app2)) != 0)
+		return FALSE;
+	if (g_strcmp0 (as_app_get_url_item (app1, AS_URL_KIND_HOMEPAGE),
+		       as_app_get_url_item (app2, AS_URL_KIND_HOMEPAGE)) != 0)
+		return FALSE;
+	if (g_strcmp0 (as_app_get_metadata_item (app1, FU_DEVICE_KEY_FWUPD_PLUGIN),
+		       as_app_get_metadata_item (app2, FU_DEVICE_KEY_FWUPD_PLUGIN)) != 0)
+		return FALSE;
+	if (provides1->len != provides2->len)
+		return FALSE;
+	for (guint i = 0; i < provides1->len; i++) {
+		AsProvide *prov1 = g_ptr_array_index (provides1, i);
+		AsProvide *prov2 = g_ptr_array_index (provides2, i);
+		if (as_provide_get_kind (prov1) != as_provide_get_kind (prov2))
+			return FALSE;
+		if (g_strcmp0 (as_provide_get_value (prov1),
+			       as_provide_get_value (prov2)) != 0)
+			return FALSE;
+	}
+	if (releases1->len != releases2->len)
+		return FALSE;
+	for (guint i = 0; i < releases1->len; i++) {
+		if (!fu_main_release_equal (g_ptr_array_index (releases1, i),
+					    g_ptr_array_index (releases2, i)))
+			return FALSE;
 	}
-	return item;
+	return TRUE;
 }
 
-static const gchar *
-fu_main_get_action_id_for_device (FuMainAuthHelper *helper)
+/* replace only the components that were added, changed or removed so that
+ * the index entries, and the device matches, of the others are kept */
+static void
+fu_main_store_apply_delta (FuMainPrivate *priv, AsStore *store)
 {
-	gboolean all_removable = TRUE;
-	gboolean is_trusted;
-
-	/* only test the payload */
-	is_trusted = (helper->trust_flags & FWUPD_TRUST_FLAG_PAYLOAD) > 0;
+	GPtrArray *apps;
+	guint cnt_added = 0;
+	guint cnt_changed = 0;
+	guint cnt_removed = 0;
+	g_autoptr(GPtrArray) apps_old = NULL;
 
-	/* any non-removable means false */
-	for (guint i = 0; i < helper->devices->len; i ++) {
-		FuDevice *device = g_ptr_array_index (helper->devices, i);
-		if (fu_device_has_flag (device, FWUPD_DEVICE_FLAG_INTERNAL)) {
-			all_removable = FALSE;
-			break;
-		}
+	/* anything no longer in the metadata */
+	apps_old = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	apps = as_store_get_apps (priv->store);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		if (as_store_get_app_by_id (store, as_app_get_id (app)) == NULL)
+			g_ptr_array_add (apps_old, g_object_ref (app));
 	}
-
-	/* relax authentication checks for removable devices */
-	if (all_removable) {
-		if (helper->is_downgrade)
-			return "org.freedesktop.fwupd.downgrade-hotplug";
-		if (is_trusted)
-			return "org.freedesktop.fwupd.update-hotplug-trusted";
-		return "org.freedesktop.fwupd.update-hotplug";
+	for (guint i = 0; i < apps_old->len; i++) {
+		AsApp *app = g_ptr_array_index (apps_old, i);
+		as_store_remove_app (priv->store, app);
+		cnt_removed++;
 	}
 
-	/* internal device */
-	if (helper->is_downgrade)
-		return "org.freedesktop.fwupd.downgrade-internal";
-	if (is_trusted)
-		return "org.freedesktop.fwupd.update-internal-trusted";
-	return "org.freedesktop.fwupd.update-internal";
+	/* compare using the same versions the index would use */
+	apps = as_store_get_apps (store);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		AsApp *app_old;
+
+		fu_main_vendor_quirk_release_version (app);
+		app_old = as_store_get_app_by_id (priv->store, as_app_get_id (app));
+		if (app_old != NULL) {
+			if (fu_main_app_equal (app_old, app))
+				continue;
+			as_store_remove_app (priv->store, app_old);
+			cnt_changed++;
+		} else {
+			cnt_added++;
+		}
+		as_store_add_app (priv->store, app);
+	}
+	g_debug ("metadata refresh: %u added, %u changed, %u removed, %u unchanged",
+		 cnt_added, cnt_changed, cnt_removed,
+		 apps->len - cnt_added - cnt_changed);
 }
 
 static gboolean
 fu_main_daemon_update_metadata (FuMainPrivate *priv, gint fd, gint fd_sig, GError **error)
 {
-	const guint8 *data;
-	gsize size;
-	GPtrArray *apps;
-	g_autofree gchar *xml = NULL;
+	g_autofree gchar *basename = NULL;
+	g_autofree gchar *cachedir = NULL;
+	g_autofree gchar *fn_cache = NULL;
+	g_autofree gchar *fn_source = NULL;
+	g_autofree gchar *fn_source_old = NULL;
+	g_autofree gchar *fn_source_tmp = NULL;
+	g_autofree gchar *fn_stream_tmp = NULL;
+	const gchar *suffix;
 	g_autoptr(AsStore) store = NULL;
-	g_autoptr(GBytes) bytes = NULL;
-	g_autoptr(GBytes) bytes_raw = NULL;
 	g_autoptr(GBytes) bytes_sig = NULL;
-	g_autoptr(FuKeyring) kr = NULL;
-	g_autoptr(GConverter) converter = NULL;
 	g_autoptr(GFile) file = NULL;
-	g_autoptr(GInputStream) stream_buf = NULL;
+	g_autoptr(FuKeyring) kr = NULL;
+	g_autoptr(GFile) file_tmp = NULL;
+	g_autoptr(GFileOutputStream) stream_tmp = NULL;
 	g_autoptr(GInputStream) stream_fd = NULL;
-	g_autoptr(GInputStream) stream = NULL;
 	g_autoptr(GInputStream) stream_sig = NULL;
 
-	/* read the entire file into memory */
-	stream_fd = g_unix_input_stream_new (fd, TRUE);
-	bytes_raw = g_input_stream_read_bytes (stream_fd, 0x100000, NULL, error);
-	if (bytes_raw == NULL)
+	/* read signature */
+	stream_sig = g_unix_input_stream_new (fd_sig, TRUE);
+	bytes_sig = g_input_stream_read_bytes (stream_sig, 0x800, NULL, error);
+	if (bytes_sig == NULL)
 		return FALSE;
-	stream_buf = g_memory_input_stream_new ();
-	g_memory_input_stream_add_bytes (G_MEMORY_INPUT_STREAM (stream_buf), bytes_raw);
 
-	/* peek the file type and get data */
-	data = g_bytes_get_data (bytes_raw, &size);
-	if (size < 2) {
-		g_set_error_literal (error,
-				     FWUPD_ERROR,
-				     FWUPD_ERROR_INVALID_FILE,
-				     "file is too small");
+	/* load trusted keys */
+	kr = fu_keyring_new ();
+	if (!fu_keyring_add_public_keys (kr, "/etc/pki/fwupd-metadata", error))
 		return FALSE;
-	}
-	if (data[0] == 0x1f && data[1] == 0x8b) {
-		g_debug ("using GZip decompressor for data");
-		converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
-		stream = g_converter_input_stream_new (stream_buf, converter);
-		bytes = g_input_stream_read_bytes (stream, 0x100000, NULL, error);
-		if (bytes == NULL)
-			return FALSE;
-	} else if (data[0] == '<' && data[1] == '?') {
-		g_debug ("using no decompressor for data");
-		bytes = g_bytes_ref (bytes_raw);
-	} else {
+
+	/* verify the payload as it is copied to disk, so that the size of
+	 * the metadata does not affect how much memory is used */
+	cachedir = g_build_filename (LOCALSTATEDIR, "cache", "fwupd", NULL);
+	fn_stream_tmp = g_build_filename (cachedir, "metadata.tmp", NULL);
+	fn_cache = g_build_filename (cachedir, "metadata.cache", NULL);
+	if (g_mkdir_with_parents (cachedir, 0755) < 0) {
 		g_set_error (error,
 			     FWUPD_ERROR,
-			     FWUPD_ERROR_INVALID_FILE,
-			     "file type '0x%02x,0x%02x' not supported",
-			     data[0], data[1]);
+			     FWUPD_ERROR_WRITE,
+			     "Failed to create %s", cachedir);
 		return FALSE;
 	}
-
-	/* read signature */
-	stream_sig = g_unix_input_stream_new (fd_sig, TRUE);
-	bytes_sig = g_input_stream_read_bytes (stream_sig, 0x800, NULL, error);
-	if (bytes_sig == NULL)
+	file_tmp = g_file_new_for_path (fn_stream_tmp);
+	stream_tmp = g_file_replace (file_tmp, NULL, FALSE,
+				     G_FILE_CREATE_REPLACE_DESTINATION,
+				     NULL, error);
+	if (stream_tmp == NULL)
+		return FALSE;
+	stream_fd = g_unix_input_stream_new (fd, TRUE);
+	if (!fu_keyring_verify_stream (kr, stream_fd,
+				       G_OUTPUT_STREAM (stream_tmp),
+				       bytes_sig, FU_MAIN_METADATA_SIZE_MAX,
+				       error)) {
+		g_unlink (fn_stream_tmp);
+		return FALSE;
+	}
+	if (!g_output_stream_close (G_OUTPUT_STREAM (stream_tmp), NULL, error)) {
+		g_unlink (fn_stream_tmp);
 		return FALSE;
+	}
 
-	/* verify file */
-	kr = fu_keyring_new ();
-	if (!fu_keyring_add_public_keys (kr, "/etc/pki/fwupd-metadata", error))
+	/* check the magic bytes and give the file the matching suffix */
+	suffix = fu_main_metadata_get_suffix (fn_stream_tmp, error);
+	if (suffix == NULL) {
+		g_unlink (fn_stream_tmp);
 		return FALSE;
-	if (!fu_keyring_verify_data (kr, bytes_raw, bytes_sig, error))
+	}
+	fn_source_tmp = g_strdup_printf ("%s%s", fn_stream_tmp, suffix);
+	if (g_rename (fn_stream_tmp, fn_source_tmp) < 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_WRITE,
+			     "Failed to rename %s to %s",
+			     fn_stream_tmp, fn_source_tmp);
+		g_unlink (fn_stream_tmp);
 		return FALSE;
+	}
 
 	/* load the store locally until we know it is valid */
-	store = as_store_new ();
-	data = g_bytes_get_data (bytes, &size);
-	xml = g_strndup ((const gchar *) data, size);
-	if (!as_store_from_xml (store, xml, NULL, error))
+	store = fu_main_store_from_source (fn_source_tmp, error);
+	if (store == NULL) {
+		g_unlink (fn_source_tmp);
 		return FALSE;
+	}
 
-	/* add the new application from the store */
-	as_store_remove_all (priv->store);
-	apps = as_store_get_apps (store);
-	for (guint i = 0; i < apps->len; i++) {
-		AsApp *app = g_ptr_array_index (apps, i);
-		as_store_add_app (priv->store, app);
+	/* replace the old source, which may have had the other suffix */
+	fn_source_old = fu_main_metadata_get_source (cachedir);
+	basename = g_strdup_printf ("metadata%s", suffix);
+	fn_source = g_build_filename (cachedir, basename, NULL);
+	if (g_rename (fn_source_tmp, fn_source) < 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_WRITE,
+			     "Failed to rename %s to %s",
+			     fn_source_tmp, fn_source);
+		g_unlink (fn_source_tmp);
+		return FALSE;
 	}
+	if (fn_source_old != NULL && g_strcmp0 (fn_source_old, fn_source) != 0)
+		g_unlink (fn_source_old);
+
+	/* only replace what changed */
+	fu_main_store_apply_delta (priv, store);
+
+	/* save the new cache */
+	if (!fu_main_metadata_cache_save (store, fn_source, fn_cache, error))
+		return FALSE;
 
 	/* save the new file */
 	as_store_set_api_version (priv->store, 0.9);
-	file = g_file_new_for_path ("/var/cache/app-info/xmls/fwupd.xml");
+	file = g_file_new_for_path (FU_MAIN_METADATA_XML);
 	if (!as_store_to_file (priv->store, file,
 			       AS_NODE_TO_XML_FLAG_ADD_HEADER |
 			       AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE |
@@ -1250,8 +2227,22 @@ fu_main_store_delay_cb (gpointer user_data)
 	/* are any devices now supported? */
 	for (guint i = 0; i < priv->devices->len; i++) {
 		FuDeviceItem *item = g_ptr_array_index (priv->devices, i);
-		if (fu_main_get_updates_item_update (priv, item))
-			fu_main_emit_device_changed (priv, item->device);
+		gboolean has_update_old;
+		g_autofree gchar *update_version_old = NULL;
+
+		/* only devices matching a changed component */
+		if (!fu_main_get_updates_item_is_stale (priv, item))
+			continue;
+
+		/* only tell clients if the offered update is different */
+		has_update_old = item->store_serial != 0 && item->has_update;
+		update_version_old = g_strdup (fu_device_get_update_version (item->device));
+		fu_main_get_updates_item_update (priv, item);
+		if (has_update_old == (item->store_serial != 0 && item->has_update) &&
+		    g_strcmp0 (fu_device_get_update_version (item->device),
+			       update_version_old) == 0)
+			continue;
+		fu_main_emit_device_changed (priv, item->device);
 	}
 
 	priv->store_changed_id = 0;
@@ -1261,37 +2252,26 @@ fu_main_store_delay_cb (gpointer user_data)
 static void
 fu_main_store_changed_cb (AsStore *store, FuMainPrivate *priv)
 {
+	/* do not match against a stale index before the delay */
+	priv->store_index_dirty = TRUE;
 	if (priv->store_changed_id != 0)
 		return;
 	priv->store_changed_id = g_timeout_add (200, fu_main_store_delay_cb, priv);
 }
 
 static gboolean
-fu_main_get_updates_item_update (FuMainPrivate *priv, FuDeviceItem *item)
+fu_main_get_updates_item_match (FuDeviceItem *item, FuMainStoreEntry *entry)
 {
-	AsApp *app;
+	AsApp *app = entry->app;
 	AsChecksum *csum;
 	AsRelease *rel;
-	GPtrArray *releases;
 	const gchar *tmp;
 	const gchar *version;
 	g_autoptr(GPtrArray) updates_list = NULL;
 
-	/* get device version */
-	version = fu_device_get_version (item->device);
-	if (version == NULL)
-		return FALSE;
-
-	/* match the GUIDs in the XML */
-	app = fu_main_store_get_app_by_guids (priv->store, item->device);
-	if (app == NULL)
-		return FALSE;
-
-	/* possibly convert the version from 0x to dotted */
-	fu_main_vendor_quirk_release_version (app);
-
 	/* get latest release */
-	rel = as_app_get_release_default (app);
+	version = fu_device_get_version (item->device);
+	rel = entry->release_default;
 	if (rel == NULL) {
 		g_debug ("%s [%s] has no firmware update metadata",
 			 fu_device_get_id (item->device),
@@ -1319,14 +2299,6 @@ fu_main_get_updates_item_update (FuMainPrivate *priv, FuDeviceItem *item)
 		return FALSE;
 	}
 
-	/* can we only do this on AC power */
-	if (fu_device_has_flag (item->device, FWUPD_DEVICE_FLAG_REQUIRE_AC) &&
-	    fu_main_on_battery (priv)) {
-		g_debug ("ignoring update for %s as not on AC power",
-			 fu_device_get_id (item->device));
-		return FALSE;
-	}
-
 	/* add application metadata */
 	fu_device_set_update_id (item->device, as_app_get_id (app));
 	tmp = as_app_get_developer_name (app, NULL);
@@ -1370,9 +2342,8 @@ fu_main_get_updates_item_update (FuMainPrivate *priv, FuDeviceItem *item)
 
 	/* get the list of releases newer than the one installed */
 	updates_list = g_ptr_array_new ();
-	releases = as_app_get_releases (app);
-	for (guint i = 0; i < releases->len; i++) {
-		rel = g_ptr_array_index (releases, i);
+	for (guint i = 0; i < entry->releases->len; i++) {
+		rel = g_ptr_array_index (entry->releases, i);
 		if (as_utils_vercmp (as_release_get_version (rel), version) <= 0)
 			continue;
 		tmp = as_release_get_description (rel, NULL);
@@ -1406,6 +2377,79 @@ fu_main_get_updates_item_update (FuMainPrivate *priv, FuDeviceItem *item)
 	return TRUE;
 }
 
+/* the device flags that fu_main_get_updates_item_match() depends on */
+static guint64
+fu_main_get_updates_item_flags (FuDeviceItem *item)
+{
+	return fu_device_get_flags (item->device) &
+	       (FWUPD_DEVICE_FLAG_ALLOW_ONLINE | FWUPD_DEVICE_FLAG_ALLOW_OFFLINE);
+}
+
+static gboolean
+fu_main_get_updates_item_is_stale (FuMainPrivate *priv, FuDeviceItem *item)
+{
+	FuMainStoreEntry *entry;
+	const gchar *version;
+
+	version = fu_device_get_version (item->device);
+	if (version == NULL)
+		return item->store_serial != 0;
+	entry = fu_main_store_index_lookup (priv, item->device);
+	if (entry == NULL)
+		return item->store_serial != 0;
+	if (item->store_serial != entry->serial)
+		return TRUE;
+	if (item->store_flags != fu_main_get_updates_item_flags (item))
+		return TRUE;
+	return g_strcmp0 (item->store_version, version) != 0;
+}
+
+static gboolean
+fu_main_get_updates_item_update (FuMainPrivate *priv, FuDeviceItem *item)
+{
+	FuMainStoreEntry *entry;
+	const gchar *version;
+
+	/* get device version */
+	version = fu_device_get_version (item->device);
+	if (version == NULL) {
+		item->store_serial = 0;
+		return FALSE;
+	}
+
+	/* match the GUIDs in the index */
+	entry = fu_main_store_index_lookup (priv, item->device);
+	if (entry == NULL) {
+		item->store_serial = 0;
+		return FALSE;
+	}
+
+	/* only match again if the component, the device version or whether
+	 * the device can be updated changed */
+	if (item->store_serial != entry->serial ||
+	    item->store_flags != fu_main_get_updates_item_flags (item) ||
+	    g_strcmp0 (item->store_version, version) != 0) {
+		item->has_update = fu_main_get_updates_item_match (item, entry);
+		item->store_serial = entry->serial;
+		item->store_flags = fu_main_get_updates_item_flags (item);
+		g_free (item->store_version);
+		item->store_version = g_strdup (version);
+	}
+	if (!item->has_update)
+		return FALSE;
+
+	/* can we only do this on AC power */
+	if (fu_device_has_flag (item->device, FWUPD_DEVICE_FLAG_REQUIRE_AC) &&
+	    fu_main_on_battery (priv)) {
+		g_debug ("ignoring update for %s as not on AC power",
+			 fu_device_get_id (item->device));
+		return FALSE;
+	}
+
+	/* success */
+	return TRUE;
+}
+
 /* find any updates using the AppStream metadata */
 static GPtrArray *
 fu_main_get_updates (FuMainPrivate *priv, GError **error)
@@ -1419,6 +2463,73 @@ fu_main_get_updates (FuMainPrivate *priv, GError **error)
 	return updates;
 }
 
+/* copies the client data to a private temporary file which is then mapped,
+ * so the client cannot modify or truncate it while it is being parsed;
+ * the file is on disk rather than in /tmp, which is often in RAM, and the
+ * fd is always closed */
+static GBytes *
+fu_main_get_bytes_from_fd (FuMainPrivate *priv, gint fd, GError **error)
+{
+	gint fd_tmp;
+	guint64 total = 0;
+	g_autofree gchar *cachedir = NULL;
+	g_autofree gchar *fn_tmp = NULL;
+	g_autofree guint8 *buf = NULL;
+	g_autoptr(GInputStream) stream_in = NULL;
+	g_autoptr(GOutputStream) stream_out = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+
+	stream_in = g_unix_input_stream_new (fd, TRUE);
+	cachedir = g_build_filename (LOCALSTATEDIR, "cache", "fwupd", NULL);
+	if (g_mkdir_with_parents (cachedir, 0700) < 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_WRITE,
+			     "Failed to create %s", cachedir);
+		return NULL;
+	}
+	fn_tmp = g_build_filename (cachedir, "install-XXXXXX.cab", NULL);
+	fd_tmp = g_mkstemp (fn_tmp);
+	if (fd_tmp < 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_WRITE,
+			     "Failed to create %s: %s",
+			     fn_tmp, g_strerror (errno));
+		return NULL;
+	}
+	stream_out = g_unix_output_stream_new (fd_tmp, TRUE);
+
+	/* nothing else can open the file once it is unlinked */
+	g_unlink (fn_tmp);
+
+	buf = g_malloc (0x8000);
+	for (;;) {
+		gssize sz;
+		sz = g_input_stream_read (stream_in, buf, 0x8000, NULL, error);
+		if (sz < 0)
+			return NULL;
+		if (sz == 0)
+			break;
+		total += (guint64) sz;
+		if (total > priv->firmware_size_max) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "file is too large, maximum is %" G_GUINT64_FORMAT " bytes",
+				     priv->firmware_size_max);
+			return NULL;
+		}
+		if (!g_output_stream_write_all (stream_out, buf, (gsize) sz,
+						NULL, NULL, error))
+			return NULL;
+	}
+	mapped = g_mapped_file_new_from_fd (fd_tmp, FALSE, error);
+	if (mapped == NULL)
+		return NULL;
+	return g_mapped_file_get_bytes (mapped);
+}
+
 static AsStore *
 fu_main_get_store_from_fd (FuMainPrivate *priv, gint fd, GError **error)
 {
@@ -1426,13 +2537,9 @@ fu_main_get_store_from_fd (FuMainPrivate *priv, gint fd, GError **error)
 	g_autoptr(AsStore) store = NULL;
 	g_autoptr(GBytes) blob_cab = NULL;
 	g_autoptr(GError) error_local = NULL;
-	g_autoptr(GInputStream) stream = NULL;
 
-	/* read the entire fd to a data blob */
-	stream = g_unix_input_stream_new (fd, TRUE);
-	blob_cab = g_input_stream_read_bytes (stream,
-					      FU_MAIN_FIRMWARE_SIZE_MAX,
-					      NULL, &error_local);
+	/* copy the fd to a private file and map that */
+	blob_cab = fu_main_get_bytes_from_fd (priv, fd, &error_local);
 	if (blob_cab == NULL){
 		g_set_error_literal (error,
 				     FWUPD_ERROR,
@@ -1630,7 +2737,7 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 	/* return 'as' */
 	if (g_strcmp0 (method_name, "GetDevices") == 0) {
 		g_debug ("Called %s()", method_name);
-		val = fu_main_device_array_to_variant (priv->devices, &error);
+		val = fu_main_get_devices_variant (priv, &error);
 		if (val == NULL) {
 			if (g_error_matches (error,
 					     FWUPD_ERROR,
@@ -1653,7 +2760,7 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 			fu_main_invocation_return_error (priv, invocation, error);
 			return;
 		}
-		val = fu_main_device_array_to_variant (updates, &error);
+		val = fu_main_device_array_to_variant (priv, updates, &error);
 		if (val == NULL) {
 			if (g_error_matches (error,
 					     FWUPD_ERROR,
@@ -1832,7 +2939,7 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 
 	/* return 's' */
 	if (g_strcmp0 (method_name, "Verify") == 0) {
-		AsApp *app;
+		FuMainStoreEntry *entry;
 		AsChecksum *csum;
 		AsRelease *release;
 		FuDeviceItem *item = NULL;
@@ -1861,8 +2968,8 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 		}
 
 		/* find component in metadata */
-		app = fu_main_store_get_app_by_guids (priv->store, item->device);
-		if (app == NULL) {
+		entry = fu_main_store_index_lookup (priv, item->device);
+		if (entry == NULL) {
 			g_set_error_literal (&error,
 					     FWUPD_ERROR,
 					     FWUPD_ERROR_NOT_FOUND,
@@ -1873,7 +2980,7 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 
 		/* find version in metadata */
 		version = fu_device_get_version (item->device);
-		release = as_app_get_release (app, version);
+		release = as_app_get_release (entry->app, version);
 		if (release == NULL) {
 			g_set_error (&error,
 				     FWUPD_ERROR,
@@ -1925,7 +3032,6 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 		g_autoptr(PolkitSubject) subject = NULL;
 		g_autoptr(GVariantIter) iter = NULL;
 		g_autoptr(GBytes) blob_cab = NULL;
-		g_autoptr(GInputStream) stream = NULL;
 
 		/* check the id exists */
 		g_variant_get (parameters, "(&sha{sv})", &id, &fd_handle, &iter);
@@ -1978,11 +3084,8 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 			return;
 		}
 
-		/* read the entire fd to a data blob */
-		stream = g_unix_input_stream_new (fd, TRUE);
-		blob_cab = g_input_stream_read_bytes (stream,
-						      FU_MAIN_FIRMWARE_SIZE_MAX,
-						      NULL, &error);
+		/* copy the fd to a private file and map that */
+		blob_cab = fu_main_get_bytes_from_fd (priv, fd, &error);
 		if (blob_cab == NULL){
 			fu_main_invocation_return_error (priv, invocation, error);
 			return;
@@ -2009,12 +3112,7 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 
 		/* is root */
 		if (fu_main_dbus_get_uid (priv, sender) == 0) {
-			if (!fu_main_provider_update_authenticated (helper, &error)) {
-				fu_main_invocation_return_error (priv, invocation, error);
-			} else {
-				fu_main_invocation_return_value (priv, invocation, NULL);
-			}
-			fu_main_helper_free (helper);
+			fu_main_provider_update_authenticated (helper);
 			return;
 		}
 
@@ -2271,7 +3369,7 @@ fu_main_provider_device_added_cb (FuProvider *provider,
 {
 	FuMainPrivate *priv = (FuMainPrivate *) user_data;
 	FuDeviceItem *item;
-	AsApp *app;
+	FuMainStoreEntry *entry;
 	FuPlugin *plugin;
 	g_auto(GStrv) guids = NULL;
 	g_autoptr(GError) error = NULL;
@@ -2314,13 +3412,13 @@ fu_main_provider_device_added_cb (FuProvider *provider,
 	item = g_new0 (FuDeviceItem, 1);
 	item->device = g_object_ref (device);
 	item->provider = g_object_ref (provider);
-	g_ptr_array_add (priv->devices, item);
+	fu_main_add_item (priv, item);
 
 	/* does this match anything in the AppStream data */
-	app = fu_main_store_get_app_by_guids (priv->store, item->device);
-	if (app != NULL) {
+	entry = fu_main_store_index_lookup (priv, item->device);
+	if (entry != NULL) {
 		const gchar *tmp;
-		tmp = as_app_get_metadata_item (app, FU_DEVICE_KEY_FWUPD_PLUGIN);
+		tmp = as_app_get_metadata_item (entry->app, FU_DEVICE_KEY_FWUPD_PLUGIN);
 		if (tmp != NULL) {
 			g_debug ("setting plugin: %s", tmp);
 			fu_device_set_metadata (item->device,
@@ -2339,6 +3437,9 @@ fu_main_provider_device_added_cb (FuProvider *provider,
 		}
 	}
 
+	/* the probe may have added GUIDs */
+	fu_main_item_index_add (priv, item);
+
 	/* match the metadata at this point so clients can tell if the
 	 * device is worthy */
 	fu_main_get_updates_item_update (priv, item);
@@ -2372,17 +3473,101 @@ fu_main_provider_device_removed_cb (FuProvider *provider,
 
 	/* make the UI update */
 	fu_main_emit_device_removed (priv, device);
-	g_ptr_array_remove (priv->devices, item);
+	fu_main_remove_item (priv, item);
+	fu_main_emit_changed (priv);
+}
+
+static void
+fu_main_provider_device_changed_cb (FuProvider *provider,
+				    FuDevice *device,
+				    gpointer user_data)
+{
+	FuMainPrivate *priv = (FuMainPrivate *) user_data;
+	FuDeviceItem *item;
+
+	item = fu_main_get_item_by_id (priv, fu_device_get_id (device));
+	if (item == NULL) {
+		g_debug ("no device to change %s", fu_device_get_id (device));
+		return;
+	}
+
+	/* check this came from the same provider */
+	if (g_strcmp0 (fu_provider_get_name (provider),
+		       fu_provider_get_name (item->provider)) != 0) {
+		g_debug ("ignoring duplicate change from %s",
+			 fu_provider_get_name (provider));
+		return;
+	}
+
+	/* the device may now have more GUIDs */
+	fu_main_item_index_add (priv, item);
+
+	/* make the UI update */
+	fu_main_emit_device_changed (priv, item->device);
 	fu_main_emit_changed (priv);
 }
 
+typedef struct {
+	FuMainPrivate		*priv;
+	FuProvider		*provider;
+	guint			 value;
+} FuMainProviderSignalHelper;
+
+static FuMainProviderSignalHelper *
+fu_main_provider_signal_helper_new (FuMainPrivate *priv,
+				    FuProvider *provider,
+				    guint value)
+{
+	FuMainProviderSignalHelper *helper = g_new0 (FuMainProviderSignalHelper, 1);
+	helper->priv = priv;
+	helper->provider = provider;
+	helper->value = value;
+	return helper;
+}
+
+static gboolean
+fu_main_provider_status_changed_idle_cb (gpointer user_data)
+{
+	FuMainProviderSignalHelper *helper = (FuMainProviderSignalHelper *) user_data;
+	fu_main_set_status (helper->priv, helper->value);
+	return G_SOURCE_REMOVE;
+}
+
 static void
 fu_main_provider_status_changed_cb (FuProvider *provider,
 				    FwupdStatus status,
 				    gpointer user_data)
 {
 	FuMainPrivate *priv = (FuMainPrivate *) user_data;
-	fu_main_set_status (priv, status);
+
+	/* this may be emitted from a worker thread when updating */
+	g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT,
+				    fu_main_provider_status_changed_idle_cb,
+				    fu_main_provider_signal_helper_new (priv, provider, status),
+				    g_free);
+}
+
+static gboolean
+fu_main_provider_percentage_changed_idle_cb (gpointer user_data)
+{
+	FuMainProviderSignalHelper *helper = (FuMainProviderSignalHelper *) user_data;
+	FuMainPrivate *priv = helper->priv;
+	FuMainUpdateLane *lane;
+
+	/* not updating, or not part of the update */
+	if (priv->update_lanes == NULL) {
+		fu_main_set_percentage (priv, helper->value);
+		return G_SOURCE_REMOVE;
+	}
+	lane = fu_main_update_lanes_get_by_provider (priv->update_lanes,
+						     helper->provider);
+	if (lane == NULL)
+		return G_SOURCE_REMOVE;
+
+	/* combine with the progress of the other lanes */
+	lane->percentage = helper->value;
+	fu_main_set_percentage (priv, fu_main_update_lanes_get_percentage (priv->update_lanes));
+	return G_SOURCE_REMOVE;
 }
 
 static void
@@ -2391,18 +3576,28 @@ fu_main_provider_percentage_changed_cb (FuProvider *provider,
 					gpointer user_data)
 {
 	FuMainPrivate *priv = (FuMainPrivate *) user_data;
-	fu_main_set_percentage (priv, percentage);
+
+	/* this may be emitted from a worker thread when updating */
+	g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT,
+				    fu_main_provider_percentage_changed_idle_cb,
+				    fu_main_provider_signal_helper_new (priv, provider, percentage),
+				    g_free);
 }
 
 static void
 fu_main_add_provider (FuMainPrivate *priv, FuProvider *provider)
 {
+	fu_provider_set_pending (provider, priv->pending);
+	fu_claims_add_provider (priv->claims, provider);
 	g_signal_connect (provider, "device-added",
 			  G_CALLBACK (fu_main_provider_device_added_cb),
 			  priv);
 	g_signal_connect (provider, "device-removed",
 			  G_CALLBACK (fu_main_provider_device_removed_cb),
 			  priv);
+	g_signal_connect (provider, "device-changed",
+			  G_CALLBACK (fu_main_provider_device_changed_cb),
+			  priv);
 	g_signal_connect (provider, "status-changed",
 			  G_CALLBACK (fu_main_provider_status_changed_cb),
 			  priv);
@@ -2410,12 +3605,16 @@ fu_main_add_provider (FuMainPrivate *priv, FuProvider *provider)
 			  G_CALLBACK (fu_main_provider_percentage_changed_cb),
 			  priv);
 	g_ptr_array_add (priv->providers, provider);
+	g_hash_table_insert (priv->providers_by_name,
+			     g_strdup (fu_provider_get_name (provider)),
+			     provider);
 }
 
 int
 main (int argc, char *argv[])
 {
 	FuMainPrivate *priv = NULL;
+	FuProvider *provider_usb;
 	gboolean immediate_exit = FALSE;
 	gboolean ret;
 	gboolean timed_exit = FALSE;
@@ -2459,8 +3658,15 @@ main (int argc, char *argv[])
 	priv->status = FWUPD_STATUS_IDLE;
 	priv->percentage = 0;
 	priv->devices = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_main_item_free);
+	priv->devices_by_id = g_hash_table_new_full (g_str_hash, g_str_equal,
+						     g_free, NULL);
+	priv->devices_by_guid = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       g_free, (GDestroyNotify) g_ptr_array_unref);
+	priv->providers_by_name = g_hash_table_new_full (g_str_hash, g_str_equal,
+							 g_free, NULL);
 	priv->loop = g_main_loop_new (NULL, FALSE);
 	priv->pending = fu_pending_new ();
+	priv->claims = fu_claims_new ();
 	priv->store = as_store_new ();
 	priv->profile = as_profile_new ();
 	g_signal_connect (priv->store, "changed",
@@ -2479,13 +3685,17 @@ main (int argc, char *argv[])
 
 	/* load AppStream */
 	as_store_add_filter (priv->store, AS_APP_KIND_FIRMWARE);
-	if (!as_store_load (priv->store,
-			    AS_STORE_LOAD_FLAG_APP_INFO_SYSTEM,
-			    NULL, &error)){
+	if (!fu_main_load_appstream_system (priv->store, &error)) {
 		g_warning ("FuMain: failed to load AppStream data: %s",
 			   error->message);
 		return FALSE;
 	}
+	if (!fu_main_metadata_cache_load (priv, &error)) {
+		g_warning ("FuMain: failed to load metadata cache: %s",
+			   error->message);
+		g_clear_error (&error);
+	}
+	fu_main_store_index_rebuild (priv);
 
 	/* read config file */
 	config_file = g_build_filename (SYSCONFDIR, "fwupd.conf", NULL);
@@ -2498,6 +3708,11 @@ main (int argc, char *argv[])
 		retval = EXIT_FAILURE;
 		goto out;
 	}
+	priv->firmware_size_max = g_key_file_get_uint64 (priv->config, "fwupd",
+							 "FirmwareSizeMax", NULL);
+	if (priv->firmware_size_max == 0)
+		priv->firmware_size_max = FU_MAIN_FIRMWARE_SIZE_MAX;
+	priv->firmware_size_max *= 1024 * 1024;
 
 	/* add providers */
 	priv->providers = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -2516,8 +3731,10 @@ main (int argc, char *argv[])
 	fu_main_add_provider (priv, fu_provider_dell_new ());
 #endif
 
-	/* last as least priority */
-	fu_main_add_provider (priv, fu_provider_usb_new ());
+	/* last as least priority, and only for devices nobody else claims */
+	provider_usb = fu_provider_usb_new ();
+	fu_provider_usb_set_claims (FU_PROVIDER_USB (provider_usb), priv->claims);
+	fu_main_add_provider (priv, provider_usb);
 
 	/* load introspection from file */
 	priv->introspection_daemon = fu_main_load_introspection (FWUPD_DBUS_INTERFACE ".xml",
@@ -2580,15 +3797,23 @@ out:
 			g_object_unref (priv->profile);
 		if (priv->store != NULL)
 			g_object_unref (priv->store);
+		if (priv->store_index != NULL)
+			g_hash_table_unref (priv->store_index);
 		if (priv->introspection_daemon != NULL)
 			g_dbus_node_info_unref (priv->introspection_daemon);
 		if (priv->store_changed_id != 0)
 			g_source_remove (priv->store_changed_id);
 		g_object_unref (priv->pending);
+		g_object_unref (priv->claims);
 		if (priv->providers != NULL)
 			g_ptr_array_unref (priv->providers);
 		if (priv->plugins != NULL)
 			g_hash_table_unref (priv->plugins);
+		g_hash_table_unref (priv->devices_by_id);
+		g_hash_table_unref (priv->devices_by_guid);
+		g_hash_table_unref (priv->providers_by_name);
+		if (priv->devices_variant != NULL)
+			g_variant_unref (priv->devices_variant);
 		g_ptr_array_unref (priv->devices);
 		g_free (priv);
 	}
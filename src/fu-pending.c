@@ -25,19 +25,66 @@
 #include <glib-object.h>
 #include <gio/gio.h>
 #include <sqlite3.h>
-#include <stdlib.h>
 
 #include "fu-pending.h"
 
 static void fu_pending_finalize			 (GObject *object);
 
+typedef enum {
+	FU_PENDING_STMT_ADD_DEVICE,
+	FU_PENDING_STMT_REMOVE_DEVICE,
+	FU_PENDING_STMT_GET_DEVICE,
+	FU_PENDING_STMT_GET_DEVICES,
+	FU_PENDING_STMT_SET_STATE,
+	FU_PENDING_STMT_SET_ERROR,
+	FU_PENDING_STMT_LAST
+} FuPendingStmt;
+
 typedef struct {
 	sqlite3				*db;
+	sqlite3_stmt			*stmts[FU_PENDING_STMT_LAST];
+	guint				 transaction_depth;
+	GMutex				 mutex;		/* for stmts */
 } FuPendingPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (FuPending, fu_pending, G_TYPE_OBJECT)
 #define GET_PRIVATE(o) (fu_pending_get_instance_private (o))
 
+#define FU_PENDING_COLUMNS	"device_id,"		\
+				"unique_id,"		\
+				"state,"		\
+				"timestamp,"		\
+				"error,"		\
+				"filename,"		\
+				"display_name,"		\
+				"provider,"		\
+				"version_old,"		\
+				"version_new"
+
+static const gchar *fu_pending_stmt_sql[] = {
+	/* FU_PENDING_STMT_ADD_DEVICE */
+	"INSERT INTO pending (device_id,"
+			     "unique_id,"
+			     "state,"
+			     "filename,"
+			     "display_name,"
+			     "provider,"
+			     "version_old,"
+			     "version_new) "
+	"VALUES (?1,?2,?3,?4,?5,?6,?7,?8)",
+	/* FU_PENDING_STMT_REMOVE_DEVICE */
+	"DELETE FROM pending WHERE device_id = ?1",
+	/* FU_PENDING_STMT_GET_DEVICE */
+	"SELECT " FU_PENDING_COLUMNS " FROM pending WHERE device_id = ?1",
+	/* FU_PENDING_STMT_GET_DEVICES */
+	"SELECT " FU_PENDING_COLUMNS " FROM pending",
+	/* FU_PENDING_STMT_SET_STATE */
+	"UPDATE pending SET state = ?2 WHERE device_id = ?1",
+	/* FU_PENDING_STMT_SET_ERROR */
+	"UPDATE pending SET error = ?2 WHERE device_id = ?1",
+	NULL
+};
+
 static gboolean
 fu_pending_load (FuPending *pending, GError **error)
 {
@@ -71,9 +118,19 @@ fu_pending_load (FuPending *pending, GError **error)
 			     "Can't open %s: %s",
 			     filename, sqlite3_errmsg (priv->db));
 		sqlite3_close (priv->db);
+		priv->db = NULL;
 		return FALSE;
 	}
 
+	/* a write-ahead log means one fsync per transaction, not per row */
+	rc = sqlite3_exec (priv->db, "PRAGMA journal_mode=WAL;",
+			   NULL, NULL, &error_msg);
+	if (rc != SQLITE_OK) {
+		g_debug ("FuPending: failed to use WAL journal: %s", error_msg);
+		sqlite3_free (error_msg);
+	}
+	sqlite3_exec (priv->db, "PRAGMA synchronous=NORMAL;", NULL, NULL, NULL);
+
 	/* check devices */
 	rc = sqlite3_exec (priv->db, "SELECT * FROM pending LIMIT 1",
 			   NULL, NULL, &error_msg);
@@ -141,46 +198,77 @@ fu_pending_load (FuPending *pending, GError **error)
 		sqlite3_exec (priv->db, statement, NULL, NULL, NULL);
 	}
 
+	/* add index (since 0.7.6) */
+	statement = "CREATE INDEX IF NOT EXISTS pending_state_timestamp "
+		    "ON pending (state, timestamp);";
+	rc = sqlite3_exec (priv->db, statement, NULL, NULL, &error_msg);
+	if (rc != SQLITE_OK) {
+		g_debug ("FuPending: failed to create index: %s", error_msg);
+		sqlite3_free (error_msg);
+	}
+
 	return TRUE;
 }
 
-gboolean
-fu_pending_add_device (FuPending *pending, FwupdResult *res, GError **error)
+/* returns a reset statement, compiling it on first use */
+static sqlite3_stmt *
+fu_pending_get_stmt (FuPending *pending, FuPendingStmt kind, GError **error)
 {
 	FuPendingPrivate *priv = GET_PRIVATE (pending);
-	char *error_msg = NULL;
-	char *statement;
-	gboolean ret = TRUE;
 	gint rc;
 
-	g_return_val_if_fail (FU_IS_PENDING (pending), FALSE);
-
 	/* lazy load */
 	if (priv->db == NULL) {
 		if (!fu_pending_load (pending, error))
-			return FALSE;
+			return NULL;
 	}
 
-	g_debug ("FuPending: add device %s", fwupd_result_get_device_id (res));
-	statement = sqlite3_mprintf ("INSERT INTO pending (device_id,"
-							  "unique_id,"
-							  "state,"
-							  "filename,"
-							  "display_name,"
-							  "provider,"
-							  "version_old,"
-							  "version_new) "
-				     "VALUES ('%q','%q','%i','%q','%q','%q','%q','%q')",
-				     fwupd_result_get_device_id (res),
-				     fwupd_result_get_unique_id (res),
-				     FWUPD_UPDATE_STATE_PENDING,
-				     fwupd_result_get_update_filename (res),
-				     fwupd_result_get_device_name (res),
-				     fwupd_result_get_device_provider (res),
-				     fwupd_result_get_device_version (res),
-				     fwupd_result_get_update_version (res));
-
-	/* insert entry */
+	/* already prepared */
+	if (priv->stmts[kind] != NULL) {
+		sqlite3_reset (priv->stmts[kind]);
+		sqlite3_clear_bindings (priv->stmts[kind]);
+		return priv->stmts[kind];
+	}
+	rc = sqlite3_prepare_v2 (priv->db, fu_pending_stmt_sql[kind], -1,
+				 &priv->stmts[kind], NULL);
+	if (rc != SQLITE_OK) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INTERNAL,
+			     "Failed to prepare SQL: %s",
+			     sqlite3_errmsg (priv->db));
+		return NULL;
+	}
+	return priv->stmts[kind];
+}
+
+/* runs a statement that returns no rows */
+static gboolean
+fu_pending_stmt_exec (FuPending *pending, sqlite3_stmt *stmt, GError **error)
+{
+	FuPendingPrivate *priv = GET_PRIVATE (pending);
+	gint rc;
+
+	rc = sqlite3_step (stmt);
+	sqlite3_reset (stmt);
+	if (rc != SQLITE_DONE) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_WRITE,
+			     "SQL error: %s",
+			     sqlite3_errmsg (priv->db));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+fu_pending_exec_literal (FuPending *pending, const gchar *statement, GError **error)
+{
+	FuPendingPrivate *priv = GET_PRIVATE (pending);
+	char *error_msg = NULL;
+	gint rc;
+
 	rc = sqlite3_exec (priv->db, statement, NULL, NULL, &error_msg);
 	if (rc != SQLITE_OK) {
 		g_set_error (error,
@@ -189,24 +277,21 @@ fu_pending_add_device (FuPending *pending, FwupdResult *res, GError **error)
 			     "SQL error: %s",
 			     error_msg);
 		sqlite3_free (error_msg);
-		ret = FALSE;
-		goto out;
+		return FALSE;
 	}
-out:
-	sqlite3_free (statement);
-	return ret;
+	return TRUE;
 }
 
+/* groups all changes into one transaction until the matching
+ * fu_pending_commit(); calls can be nested */
 gboolean
-fu_pending_remove_device (FuPending *pending, FwupdResult *res, GError **error)
+fu_pending_begin (FuPending *pending, GError **error)
 {
 	FuPendingPrivate *priv = GET_PRIVATE (pending);
-	char *error_msg = NULL;
-	char *statement;
-	gboolean ret = TRUE;
-	gint rc;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail (FU_IS_PENDING (pending), FALSE);
+	locker = g_mutex_locker_new (&priv->mutex);
 
 	/* lazy load */
 	if (priv->db == NULL) {
@@ -214,186 +299,173 @@ fu_pending_remove_device (FuPending *pending, FwupdResult *res, GError **error)
 			return FALSE;
 	}
 
-	g_debug ("FuPending: remove device %s", fwupd_result_get_device_id (res));
-	statement = sqlite3_mprintf ("DELETE FROM pending WHERE "
-				     "device_id = '%q';",
-				     fwupd_result_get_device_id (res));
-
-	/* remove entry */
-	rc = sqlite3_exec (priv->db, statement, NULL, NULL, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_set_error (error,
-			     FWUPD_ERROR,
-			     FWUPD_ERROR_WRITE,
-			     "SQL error: %s",
-			     error_msg);
-		sqlite3_free (error_msg);
-		ret = FALSE;
-		goto out;
+	if (priv->transaction_depth++ > 0)
+		return TRUE;
+	if (!fu_pending_exec_literal (pending, "BEGIN IMMEDIATE;", error)) {
+		priv->transaction_depth = 0;
+		return FALSE;
 	}
-out:
-	sqlite3_free (statement);
-	return ret;
+	return TRUE;
+}
+
+gboolean
+fu_pending_commit (FuPending *pending, GError **error)
+{
+	FuPendingPrivate *priv = GET_PRIVATE (pending);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (FU_IS_PENDING (pending), FALSE);
+	g_return_val_if_fail (priv->transaction_depth > 0, FALSE);
+	locker = g_mutex_locker_new (&priv->mutex);
+
+	if (--priv->transaction_depth > 0)
+		return TRUE;
+	return fu_pending_exec_literal (pending, "COMMIT;", error);
+}
+
+gboolean
+fu_pending_add_device (FuPending *pending, FwupdResult *res, GError **error)
+{
+	FuPendingPrivate *priv = GET_PRIVATE (pending);
+	sqlite3_stmt *stmt;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (FU_IS_PENDING (pending), FALSE);
+	locker = g_mutex_locker_new (&priv->mutex);
+
+	stmt = fu_pending_get_stmt (pending, FU_PENDING_STMT_ADD_DEVICE, error);
+	if (stmt == NULL)
+		return FALSE;
+
+	g_debug ("FuPending: add device %s", fwupd_result_get_device_id (res));
+	sqlite3_bind_text (stmt, 1, fwupd_result_get_device_id (res), -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 2, fwupd_result_get_unique_id (res), -1, SQLITE_STATIC);
+	sqlite3_bind_int (stmt, 3, FWUPD_UPDATE_STATE_PENDING);
+	sqlite3_bind_text (stmt, 4, fwupd_result_get_update_filename (res), -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 5, fwupd_result_get_device_name (res), -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 6, fwupd_result_get_device_provider (res), -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 7, fwupd_result_get_device_version (res), -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 8, fwupd_result_get_update_version (res), -1, SQLITE_STATIC);
+	return fu_pending_stmt_exec (pending, stmt, error);
+}
+
+gboolean
+fu_pending_remove_device (FuPending *pending, FwupdResult *res, GError **error)
+{
+	FuPendingPrivate *priv = GET_PRIVATE (pending);
+	sqlite3_stmt *stmt;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (FU_IS_PENDING (pending), FALSE);
+	locker = g_mutex_locker_new (&priv->mutex);
+
+	stmt = fu_pending_get_stmt (pending, FU_PENDING_STMT_REMOVE_DEVICE, error);
+	if (stmt == NULL)
+		return FALSE;
+
+	g_debug ("FuPending: remove device %s", fwupd_result_get_device_id (res));
+	sqlite3_bind_text (stmt, 1, fwupd_result_get_device_id (res), -1, SQLITE_STATIC);
+	return fu_pending_stmt_exec (pending, stmt, error);
 }
 
-static gint
-fu_pending_device_sqlite_cb (void *data,
-			gint argc,
-			gchar **argv,
-			gchar **col_name)
+static FwupdResult *
+fu_pending_result_from_stmt (sqlite3_stmt *stmt)
 {
-	GPtrArray *array = (GPtrArray *) data;
 	FwupdResult *res;
+	const gchar *tmp;
+	guint64 timestamp;
 
-	/* create new result */
+	/* create new result, the columns are in FU_PENDING_COLUMNS order */
 	res = fwupd_result_new ();
-	g_ptr_array_add (array, res);
+	g_debug ("FuPending: got sql result %s", sqlite3_column_text (stmt, 0));
+	fwupd_result_set_device_id (res, (const gchar *) sqlite3_column_text (stmt, 0));
+	fwupd_result_set_unique_id (res, (const gchar *) sqlite3_column_text (stmt, 1));
+	fwupd_result_set_update_state (res, sqlite3_column_int (stmt, 2));
+	tmp = (const gchar *) sqlite3_column_text (stmt, 3);
+	timestamp = g_ascii_strtoull (tmp != NULL ? tmp : "0", NULL, 10);
+	if (timestamp > 0)
+		fwupd_result_set_device_created (res, timestamp);
+	tmp = (const gchar *) sqlite3_column_text (stmt, 4);
+	if (tmp != NULL)
+		fwupd_result_set_update_error (res, tmp);
+	fwupd_result_set_update_filename (res, (const gchar *) sqlite3_column_text (stmt, 5));
+	fwupd_result_set_device_name (res, (const gchar *) sqlite3_column_text (stmt, 6));
+	fwupd_result_set_device_provider (res, (const gchar *) sqlite3_column_text (stmt, 7));
+	fwupd_result_set_device_version (res, (const gchar *) sqlite3_column_text (stmt, 8));
+	fwupd_result_set_update_version (res, (const gchar *) sqlite3_column_text (stmt, 9));
+	return res;
+}
 
-	g_debug ("FuPending: got sql result %s", argv[0]);
-	for (gint i = 0; i < argc; i++) {
-		if (g_strcmp0 (col_name[i], "device_id") == 0) {
-			fwupd_result_set_device_id (res, argv[i]);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "unique_id") == 0) {
-			fwupd_result_set_unique_id (res, argv[i]);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "filename") == 0) {
-			fwupd_result_set_update_filename (res, argv[i]);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "display_name") == 0) {
-			fwupd_result_set_device_name (res, argv[i]);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "version_old") == 0) {
-			fwupd_result_set_device_version (res, argv[i]);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "version_new") == 0) {
-			fwupd_result_set_update_version (res, argv[i]);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "provider") == 0) {
-			fwupd_result_set_device_provider (res, argv[i]);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "state") == 0) {
-			FwupdUpdateState state = atoi (argv[i]);
-			fwupd_result_set_update_state (res, state);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "timestamp") == 0) {
-			guint64 timestamp = g_ascii_strtoull (argv[i], NULL, 10);
-			if (timestamp > 0)
-				fwupd_result_set_device_created (res, timestamp);
-			continue;
-		}
-		if (g_strcmp0 (col_name[i], "error") == 0) {
-			if (argv[i] != NULL)
-				fwupd_result_set_update_error (res, argv[i]);
-			continue;
-		}
-		g_warning ("unhandled %s=%s", col_name[i], argv[i]);
-	}
+static GPtrArray *
+fu_pending_stmt_get_results (FuPending *pending, sqlite3_stmt *stmt, GError **error)
+{
+	FuPendingPrivate *priv = GET_PRIVATE (pending);
+	gint rc;
+	g_autoptr(GPtrArray) array = NULL;
 
-	return 0;
+	array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	while ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+		g_ptr_array_add (array, fu_pending_result_from_stmt (stmt));
+	sqlite3_reset (stmt);
+	if (rc != SQLITE_DONE) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_READ,
+			     "SQL error: %s",
+			     sqlite3_errmsg (priv->db));
+		return NULL;
+	}
+	return g_steal_pointer (&array);
 }
 
 FwupdResult *
 fu_pending_get_device (FuPending *pending, const gchar *device_id, GError **error)
 {
 	FuPendingPrivate *priv = GET_PRIVATE (pending);
-	FwupdResult *res = NULL;
-	char *error_msg = NULL;
-	char *statement;
-	gint rc;
+	sqlite3_stmt *stmt;
 	g_autoptr(GPtrArray) array_tmp = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail (FU_IS_PENDING (pending), NULL);
+	locker = g_mutex_locker_new (&priv->mutex);
 
-	/* lazy load */
-	if (priv->db == NULL) {
-		if (!fu_pending_load (pending, error))
-			return NULL;
-	}
+	stmt = fu_pending_get_stmt (pending, FU_PENDING_STMT_GET_DEVICE, error);
+	if (stmt == NULL)
+		return NULL;
 
 	/* get all the devices */
 	g_debug ("FuPending: get res");
-	statement = sqlite3_mprintf ("SELECT * FROM pending WHERE "
-				     "device_id = '%q';",
-				     device_id);
-	array_tmp = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
-	rc = sqlite3_exec (priv->db,
-			   statement,
-			   fu_pending_device_sqlite_cb,
-			   array_tmp,
-			   &error_msg);
-	if (rc != SQLITE_OK) {
-		g_set_error (error,
-			     FWUPD_ERROR,
-			     FWUPD_ERROR_READ,
-			     "SQL error: %s",
-			     error_msg);
-		sqlite3_free (error_msg);
-		goto out;
-	}
+	sqlite3_bind_text (stmt, 1, device_id, -1, SQLITE_STATIC);
+	array_tmp = fu_pending_stmt_get_results (pending, stmt, error);
+	if (array_tmp == NULL)
+		return NULL;
 	if (array_tmp->len == 0) {
 		g_set_error_literal (error,
 				     FWUPD_ERROR,
 				     FWUPD_ERROR_NOT_FOUND,
 				     "No devices found");
-		goto out;
+		return NULL;
 	}
-	res = g_object_ref (g_ptr_array_index (array_tmp, 0));
-out:
-	sqlite3_free (statement);
-	return res;
+	return g_object_ref (g_ptr_array_index (array_tmp, 0));
 }
 
 GPtrArray *
 fu_pending_get_devices (FuPending *pending, GError **error)
 {
 	FuPendingPrivate *priv = GET_PRIVATE (pending);
-	GPtrArray *array = NULL;
-	char *error_msg = NULL;
-	char *statement;
-	gint rc;
-	g_autoptr(GPtrArray) array_tmp = NULL;
+	sqlite3_stmt *stmt;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail (FU_IS_PENDING (pending), NULL);
+	locker = g_mutex_locker_new (&priv->mutex);
 
-	/* lazy load */
-	if (priv->db == NULL) {
-		if (!fu_pending_load (pending, error))
-			return NULL;
-	}
+	stmt = fu_pending_get_stmt (pending, FU_PENDING_STMT_GET_DEVICES, error);
+	if (stmt == NULL)
+		return NULL;
 
 	/* get all the devices */
 	g_debug ("FuPending: get devices");
-	statement = sqlite3_mprintf ("SELECT * FROM pending;");
-	array_tmp = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
-	rc = sqlite3_exec (priv->db,
-			   statement,
-			   fu_pending_device_sqlite_cb,
-			   array_tmp,
-			   &error_msg);
-	if (rc != SQLITE_OK) {
-		g_set_error (error,
-			     FWUPD_ERROR,
-			     FWUPD_ERROR_READ,
-			     "SQL error: %s",
-			     error_msg);
-		sqlite3_free (error_msg);
-		goto out;
-	}
-
-	/* success */
-	array = g_ptr_array_ref (array_tmp);
-out:
-	sqlite3_free (statement);
-	return array;
+	return fu_pending_stmt_get_results (pending, stmt, error);
 }
 
 gboolean
@@ -403,41 +475,22 @@ fu_pending_set_state (FuPending *pending,
 		      GError **error)
 {
 	FuPendingPrivate *priv = GET_PRIVATE (pending);
-	char *error_msg = NULL;
-	char *statement;
-	gboolean ret = TRUE;
-	gint rc;
+	sqlite3_stmt *stmt;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail (FU_IS_PENDING (pending), FALSE);
+	locker = g_mutex_locker_new (&priv->mutex);
 
-	/* lazy load */
-	if (priv->db == NULL) {
-		if (!fu_pending_load (pending, error))
-			return FALSE;
-	}
+	stmt = fu_pending_get_stmt (pending, FU_PENDING_STMT_SET_STATE, error);
+	if (stmt == NULL)
+		return FALSE;
 
 	g_debug ("FuPending: set state of %s to %s",
 		 fwupd_result_get_device_id (res),
 		 fwupd_update_state_to_string (state));
-	statement = sqlite3_mprintf ("UPDATE pending SET state='%i' WHERE "
-				     "device_id = '%q';",
-				     state, fwupd_result_get_device_id (res));
-
-	/* remove entry */
-	rc = sqlite3_exec (priv->db, statement, NULL, NULL, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_set_error (error,
-			     FWUPD_ERROR,
-			     FWUPD_ERROR_WRITE,
-			     "SQL error: %s",
-			     error_msg);
-		sqlite3_free (error_msg);
-		ret = FALSE;
-		goto out;
-	}
-out:
-	sqlite3_free (statement);
-	return ret;
+	sqlite3_bind_text (stmt, 1, fwupd_result_get_device_id (res), -1, SQLITE_STATIC);
+	sqlite3_bind_int (stmt, 2, state);
+	return fu_pending_stmt_exec (pending, stmt, error);
 }
 
 gboolean
@@ -447,41 +500,21 @@ fu_pending_set_error_msg (FuPending *pending,
 			  GError **error)
 {
 	FuPendingPrivate *priv = GET_PRIVATE (pending);
-	char *error_msg = NULL;
-	char *statement;
-	gboolean ret = TRUE;
-	gint rc;
+	sqlite3_stmt *stmt;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail (FU_IS_PENDING (pending), FALSE);
+	locker = g_mutex_locker_new (&priv->mutex);
 
-	/* lazy load */
-	if (priv->db == NULL) {
-		if (!fu_pending_load (pending, error))
-			return FALSE;
-	}
+	stmt = fu_pending_get_stmt (pending, FU_PENDING_STMT_SET_ERROR, error);
+	if (stmt == NULL)
+		return FALSE;
 
 	g_debug ("FuPending: add comment to %s: %s",
 		 fwupd_result_get_device_id (res), error_msg2);
-	statement = sqlite3_mprintf ("UPDATE pending SET error='%q' WHERE "
-				     "device_id = '%q';",
-				     error_msg2,
-				     fwupd_result_get_device_id (res));
-
-	/* remove entry */
-	rc = sqlite3_exec (priv->db, statement, NULL, NULL, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_set_error (error,
-			     FWUPD_ERROR,
-			     FWUPD_ERROR_WRITE,
-			     "SQL error: %s",
-			     error_msg);
-		sqlite3_free (error_msg);
-		ret = FALSE;
-		goto out;
-	}
-out:
-	sqlite3_free (statement);
-	return ret;
+	sqlite3_bind_text (stmt, 1, fwupd_result_get_device_id (res), -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 2, error_msg2, -1, SQLITE_STATIC);
+	return fu_pending_stmt_exec (pending, stmt, error);
 }
 
 static void
@@ -494,6 +527,8 @@ fu_pending_class_init (FuPendingClass *klass)
 static void
 fu_pending_init (FuPending *pending)
 {
+	FuPendingPrivate *priv = GET_PRIVATE (pending);
+	g_mutex_init (&priv->mutex);
 }
 
 static void
@@ -502,8 +537,15 @@ fu_pending_finalize (GObject *object)
 	FuPending *pending = FU_PENDING (object);
 	FuPendingPrivate *priv = GET_PRIVATE (pending);
 
+	if (priv->transaction_depth > 0)
+		g_warning ("FuPending: finalized inside a transaction");
+	for (guint i = 0; i < FU_PENDING_STMT_LAST; i++) {
+		if (priv->stmts[i] != NULL)
+			sqlite3_finalize (priv->stmts[i]);
+	}
 	if (priv->db != NULL)
 		sqlite3_close (priv->db);
+	g_mutex_clear (&priv->mutex);
 
 	G_OBJECT_CLASS (fu_pending_parent_class)->finalize (object);
 }
@@ -38,6 +38,10 @@ struct _FuPendingClass
 
 FuPending	*fu_pending_new				(void);
 
+gboolean	 fu_pending_begin			(FuPending	*pending,
+							 GError		**error);
+gboolean	 fu_pending_commit			(FuPending	*pending,
+							 GError		**error);
 gboolean	 fu_pending_add_device			(FuPending	*pending,
 							 FwupdResult	*res,
 							 GError		**error);
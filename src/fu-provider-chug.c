@@ -549,6 +549,20 @@ fu_provider_chug_coldplug (FuProvider *provider, GError **error)
 	return TRUE;
 }
 
+static gboolean
+fu_provider_chug_claim_usb_device (FuProvider *provider, GUsbDevice *usb_device)
+{
+	ChDeviceMode mode;
+
+	/* the newer devices are handled by the DFU provider */
+	mode = ch_device_get_mode (usb_device);
+	if (mode == CH_DEVICE_MODE_UNKNOWN ||
+	    mode == CH_DEVICE_MODE_BOOTLOADER_PLUS ||
+	    mode == CH_DEVICE_MODE_FIRMWARE_PLUS)
+		return FALSE;
+	return TRUE;
+}
+
 static void
 fu_provider_chug_class_init (FuProviderChugClass *klass)
 {
@@ -559,6 +573,7 @@ fu_provider_chug_class_init (FuProviderChugClass *klass)
 	provider_class->coldplug = fu_provider_chug_coldplug;
 	provider_class->update_online = fu_provider_chug_update;
 	provider_class->verify = fu_provider_chug_verify;
+	provider_class->claim_usb_device = fu_provider_chug_claim_usb_device;
 	object_class->finalize = fu_provider_chug_finalize;
 }
 
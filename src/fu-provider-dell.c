@@ -1235,6 +1235,8 @@ fu_provider_dell_init (FuProviderDell *provider_dell)
 	priv->fake_smbios = FALSE;
 	if (g_getenv ("FWUPD_DELL_FAKE_SMBIOS") != NULL)
 		priv->fake_smbios = TRUE;
+
+	fu_provider_set_update_in_thread (FU_PROVIDER (provider_dell), TRUE);
 }
 
 static void
@@ -126,6 +126,9 @@ fu_provider_dfu_device_changed_cb (DfuContext *ctx,
 		g_warning ("ignoring device: %s", error->message);
 		return;
 	}
+
+	/* the runtime may now have a different VID, PID or release */
+	fu_provider_device_changed (FU_PROVIDER (provider_dfu), dev);
 }
 
 static void
@@ -384,6 +387,23 @@ fu_provider_dfu_verify (FuProvider *provider,
 	return TRUE;
 }
 
+static gboolean
+fu_provider_dfu_claim_usb_device (FuProvider *provider, GUsbDevice *usb_device)
+{
+	g_autoptr(DfuDevice) device = NULL;
+
+	/* this only parses the descriptors */
+	device = dfu_device_new (usb_device);
+	if (device == NULL)
+		return FALSE;
+
+	/* ignore defective runtimes */
+	if (dfu_device_get_mode (device) == DFU_MODE_RUNTIME &&
+	    dfu_device_has_quirk (device, DFU_DEVICE_QUIRK_IGNORE_RUNTIME))
+		return FALSE;
+	return TRUE;
+}
+
 static void
 fu_provider_dfu_class_init (FuProviderDfuClass *klass)
 {
@@ -394,6 +414,7 @@ fu_provider_dfu_class_init (FuProviderDfuClass *klass)
 	provider_class->coldplug = fu_provider_dfu_coldplug;
 	provider_class->update_online = fu_provider_dfu_update;
 	provider_class->verify = fu_provider_dfu_verify;
+	provider_class->claim_usb_device = fu_provider_dfu_claim_usb_device;
 	object_class->finalize = fu_provider_dfu_finalize;
 }
 
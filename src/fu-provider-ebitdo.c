@@ -35,6 +35,8 @@ static void	fu_provider_ebitdo_finalize	(GObject	*object);
 typedef struct {
 	GHashTable		*devices;		/* id : FuDevice */
 	GHashTable		*devices_runtime;	/* id : EbitdoDevice */
+	GHashTable		*devices_usb;		/* id : GUsbDevice */
+	GMutex			 devices_usb_mutex;
 	GUsbContext		*usb_ctx;
 	gboolean		 done_enumerate;
 } FuProviderEbitdoPrivate;
@@ -121,6 +123,13 @@ fu_provider_ebitdo_device_added (FuProviderEbitdo *provider_ebitdo,
 			 ebitdo_device_get_guid (ebitdo_dev));
 	}
 
+	/* the update runs in a worker thread, which cannot use the context */
+	g_mutex_lock (&priv->devices_usb_mutex);
+	g_hash_table_insert (priv->devices_usb,
+			     g_strdup (platform_id),
+			     g_object_ref (usb_device));
+	g_mutex_unlock (&priv->devices_usb_mutex);
+
 	/* insert to hash */
 	fu_provider_device_add (FU_PROVIDER (provider_ebitdo), dev);
 	g_hash_table_insert (priv->devices, g_strdup (platform_id), g_object_ref (dev));
@@ -154,11 +163,19 @@ fu_provider_ebitdo_update (FuProvider *provider,
 
 	/* get version */
 	platform_id = fu_device_get_id (dev);
-	usb_device = g_usb_context_find_by_platform_id (priv->usb_ctx,
-							platform_id,
-							error);
-	if (usb_device == NULL)
+	g_mutex_lock (&priv->devices_usb_mutex);
+	usb_device = g_hash_table_lookup (priv->devices_usb, platform_id);
+	if (usb_device != NULL)
+		g_object_ref (usb_device);
+	g_mutex_unlock (&priv->devices_usb_mutex);
+	if (usb_device == NULL) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_FOUND,
+			     "device %s was removed",
+			     platform_id);
 		return FALSE;
+	}
 	ebitdo_dev = ebitdo_device_new (usb_device);
 	if (ebitdo_device_get_kind (ebitdo_dev) != EBITDO_DEVICE_KIND_BOOTLOADER) {
 		g_set_error_literal (error,
@@ -211,6 +228,9 @@ fu_provider_ebitdo_device_removed_cb (GUsbContext *ctx,
 
 	/* already in database */
 	platform_id = g_usb_device_get_platform_id (usb_device);
+	g_mutex_lock (&priv->devices_usb_mutex);
+	g_hash_table_remove (priv->devices_usb, platform_id);
+	g_mutex_unlock (&priv->devices_usb_mutex);
 	dev = g_hash_table_lookup (priv->devices, platform_id);
 	if (dev == NULL)
 		return;
@@ -229,6 +249,16 @@ fu_provider_ebitdo_coldplug (FuProvider *provider, GError **error)
 	return TRUE;
 }
 
+static gboolean
+fu_provider_ebitdo_claim_usb_device (FuProvider *provider, GUsbDevice *usb_device)
+{
+	g_autoptr(EbitdoDevice) ebitdo_dev = NULL;
+
+	/* this only matches the VID:PID */
+	ebitdo_dev = ebitdo_device_new (usb_device);
+	return ebitdo_device_get_kind (ebitdo_dev) != EBITDO_DEVICE_KIND_UNKNOWN;
+}
+
 static void
 fu_provider_ebitdo_class_init (FuProviderEbitdoClass *klass)
 {
@@ -238,6 +268,7 @@ fu_provider_ebitdo_class_init (FuProviderEbitdoClass *klass)
 	provider_class->get_name = fu_provider_ebitdo_get_name;
 	provider_class->coldplug = fu_provider_ebitdo_coldplug;
 	provider_class->update_online = fu_provider_ebitdo_update;
+	provider_class->claim_usb_device = fu_provider_ebitdo_claim_usb_device;
 	object_class->finalize = fu_provider_ebitdo_finalize;
 }
 
@@ -249,6 +280,9 @@ fu_provider_ebitdo_init (FuProviderEbitdo *provider_ebitdo)
 					       g_free, (GDestroyNotify) g_object_unref);
 	priv->devices_runtime = g_hash_table_new_full (g_str_hash, g_str_equal,
 						       g_free, (GDestroyNotify) g_object_unref);
+	priv->devices_usb = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   g_free, (GDestroyNotify) g_object_unref);
+	g_mutex_init (&priv->devices_usb_mutex);
 	priv->usb_ctx = g_usb_context_new (NULL);
 	g_signal_connect (priv->usb_ctx, "device-added",
 			  G_CALLBACK (fu_provider_ebitdo_device_added_cb),
@@ -256,6 +290,8 @@ fu_provider_ebitdo_init (FuProviderEbitdo *provider_ebitdo)
 	g_signal_connect (priv->usb_ctx, "device-removed",
 			  G_CALLBACK (fu_provider_ebitdo_device_removed_cb),
 			  provider_ebitdo);
+
+	fu_provider_set_update_in_thread (FU_PROVIDER (provider_ebitdo), TRUE);
 }
 
 static void
@@ -266,6 +302,8 @@ fu_provider_ebitdo_finalize (GObject *object)
 
 	g_hash_table_unref (priv->devices);
 	g_hash_table_unref (priv->devices_runtime);
+	g_hash_table_unref (priv->devices_usb);
+	g_mutex_clear (&priv->devices_usb_mutex);
 	g_object_unref (priv->usb_ctx);
 
 	G_OBJECT_CLASS (fu_provider_ebitdo_parent_class)->finalize (object);
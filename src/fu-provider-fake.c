@@ -83,6 +83,7 @@ fu_provider_fake_class_init (FuProviderFakeClass *klass)
 static void
 fu_provider_fake_init (FuProviderFake *provider_fake)
 {
+	fu_provider_set_update_in_thread (FU_PROVIDER (provider_fake), TRUE);
 }
 
 static void
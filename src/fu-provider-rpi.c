@@ -310,6 +310,8 @@ fu_provider_rpi_init (FuProviderRpi *provider_rpi)
 	tmp = g_getenv ("FWUPD_RPI_FW_DIR");
 	if (tmp != NULL)
 		fu_provider_rpi_set_fw_dir (provider_rpi, tmp);
+
+	fu_provider_set_update_in_thread (FU_PROVIDER (provider_rpi), TRUE);
 }
 
 void
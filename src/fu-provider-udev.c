@@ -24,6 +24,7 @@
 #include <fwupd.h>
 #include <appstream-glib.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <gudev/gudev.h>
 #include <string.h>
 
@@ -36,6 +37,9 @@ static void	fu_provider_udev_finalize	(GObject	*object);
 typedef struct {
 	GHashTable		*devices;
 	GUdevClient		*gudev_client;
+	GKeyFile		*rom_cache;
+	gchar			*rom_cache_fn;
+	gchar			*boot_id;
 } FuProviderUdevPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (FuProviderUdev, fu_provider_udev, FU_TYPE_PROVIDER)
@@ -56,17 +60,138 @@ fu_provider_udev_get_id (GUdevDevice *device)
 	return id;
 }
 
+/* this does not change when the ROM is reflashed, so entries are only
+ * trusted for the current boot and are dropped when the device goes away */
+static gchar *
+fu_provider_udev_get_rom_cache_key (GUdevDevice *device, const gchar *rom_fn)
+{
+	const gchar *attrs[] = { "vendor", "device", "subsystem_vendor",
+				 "subsystem_device", "revision", NULL };
+	GStatBuf st;
+	g_autofree gchar *slot = NULL;
+	g_autoptr(GString) key = g_string_new ("PCI");
+
+	/* two identical cards can have different ROMs */
+	slot = g_path_get_basename (g_udev_device_get_sysfs_path (device));
+	g_string_append_printf (key, ":%s", slot);
+	for (guint i = 0; attrs[i] != NULL; i++) {
+		const gchar *tmp = g_udev_device_get_sysfs_attr (device, attrs[i]);
+		if (tmp == NULL)
+			return NULL;
+		g_string_append_printf (key, ":%s", tmp);
+	}
+	if (g_stat (rom_fn, &st) != 0)
+		return NULL;
+	g_string_append_printf (key, ":%" G_GUINT64_FORMAT, (guint64) st.st_size);
+	return g_string_free (g_steal_pointer (&key), FALSE);
+}
+
 static gboolean
-fu_provider_udev_unlock (FuProvider *provider,
-			 FuDevice *device,
-			 GError **error)
+fu_provider_udev_rom_cache_lookup (FuProviderUdev *provider_udev,
+				   const gchar *key,
+				   gchar **version,
+				   gchar **guid,
+				   gchar **checksum)
+{
+	FuProviderUdevPrivate *priv = GET_PRIVATE (provider_udev);
+	g_autofree gchar *boot_id = NULL;
+	g_autofree gchar *fwupd_version = NULL;
+
+	if (key == NULL || priv->boot_id == NULL)
+		return FALSE;
+	if (!g_key_file_has_group (priv->rom_cache, key))
+		return FALSE;
+
+	/* the parser may have changed */
+	fwupd_version = g_key_file_get_string (priv->rom_cache, key,
+					       "FwupdVersion", NULL);
+	if (g_strcmp0 (fwupd_version, PACKAGE_VERSION) != 0) {
+		g_debug ("ignoring ROM cache for %s from %s", key, fwupd_version);
+		g_key_file_remove_group (priv->rom_cache, key, NULL);
+		return FALSE;
+	}
+
+	/* the ROM may have been reflashed before a reboot */
+	boot_id = g_key_file_get_string (priv->rom_cache, key, "BootId", NULL);
+	if (g_strcmp0 (boot_id, priv->boot_id) != 0) {
+		g_debug ("ignoring ROM cache for %s from previous boot", key);
+		g_key_file_remove_group (priv->rom_cache, key, NULL);
+		return FALSE;
+	}
+	*version = g_key_file_get_string (priv->rom_cache, key, "Version", NULL);
+	*guid = g_key_file_get_string (priv->rom_cache, key, "Guid", NULL);
+	*checksum = g_key_file_get_string (priv->rom_cache, key, "Checksum", NULL);
+	if (*version == NULL || *guid == NULL || *checksum == NULL) {
+		g_clear_pointer (version, g_free);
+		g_clear_pointer (guid, g_free);
+		g_clear_pointer (checksum, g_free);
+		return FALSE;
+	}
+	g_debug ("using ROM cache for %s", key);
+	return TRUE;
+}
+
+static void
+fu_provider_udev_rom_cache_save (FuProviderUdev *provider_udev)
+{
+	FuProviderUdevPrivate *priv = GET_PRIVATE (provider_udev);
+	g_autofree gchar *dirname = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* not fatal */
+	dirname = g_path_get_dirname (priv->rom_cache_fn);
+	if (g_mkdir_with_parents (dirname, 0755) != 0) {
+		g_warning ("failed to create %s", dirname);
+		return;
+	}
+	if (!g_key_file_save_to_file (priv->rom_cache, priv->rom_cache_fn, &error))
+		g_warning ("failed to save ROM cache: %s", error->message);
+}
+
+static void
+fu_provider_udev_rom_cache_add (FuProviderUdev *provider_udev,
+				const gchar *key,
+				FuRom *rom)
+{
+	FuProviderUdevPrivate *priv = GET_PRIVATE (provider_udev);
+
+	if (key == NULL || priv->boot_id == NULL)
+		return;
+	g_key_file_set_string (priv->rom_cache, key, "FwupdVersion", PACKAGE_VERSION);
+	g_key_file_set_string (priv->rom_cache, key, "BootId", priv->boot_id);
+	g_key_file_set_string (priv->rom_cache, key, "Version", fu_rom_get_version (rom));
+	g_key_file_set_string (priv->rom_cache, key, "Guid", fu_rom_get_guid (rom));
+	g_key_file_set_string (priv->rom_cache, key, "Checksum", fu_rom_get_checksum (rom));
+	fu_provider_udev_rom_cache_save (provider_udev);
+}
+
+static void
+fu_provider_udev_rom_cache_remove (FuProviderUdev *provider_udev,
+				   const gchar *key)
+{
+	FuProviderUdevPrivate *priv = GET_PRIVATE (provider_udev);
+
+	if (key == NULL)
+		return;
+	if (!g_key_file_remove_group (priv->rom_cache, key, NULL))
+		return;
+	fu_provider_udev_rom_cache_save (provider_udev);
+}
+
+static gboolean
+fu_provider_udev_load_rom (FuProviderUdev *provider_udev,
+			   FuDevice *device,
+			   gboolean use_cache,
+			   gchar **version,
+			   gchar **guid,
+			   gchar **checksum,
+			   GError **error)
 {
+	const gchar *key;
 	const gchar *rom_fn;
 	g_autoptr(FuRom) rom = NULL;
 	g_autoptr(GFile) file = NULL;
 
-	/* get the FW version from the rom */
-	g_debug ("unlocking UDev device %s", fu_device_get_id (device));
 	rom_fn = fu_device_get_metadata (device, "RomFilename");
 	if (rom_fn == NULL) {
 		g_set_error_literal (error,
@@ -75,25 +200,54 @@ fu_provider_udev_unlock (FuProvider *provider,
 				     "Unable to read firmware from device");
 		return FALSE;
 	}
+
+	/* already read this ROM */
+	key = fu_device_get_metadata (device, "RomCacheKey");
+	if (use_cache &&
+	    fu_provider_udev_rom_cache_lookup (provider_udev, key,
+					       version, guid, checksum))
+		return TRUE;
+
 	file = g_file_new_for_path (rom_fn);
 	rom = fu_rom_new ();
 	if (!fu_rom_load_file (rom, file, FU_ROM_LOAD_FLAG_BLANK_PPID, NULL, error))
 		return FALSE;
+	fu_provider_udev_rom_cache_add (provider_udev, key, rom);
+	*version = g_strdup (fu_rom_get_version (rom));
+	*guid = g_strdup (fu_rom_get_guid (rom));
+	*checksum = g_strdup (fu_rom_get_checksum (rom));
+	return TRUE;
+}
+
+static gboolean
+fu_provider_udev_unlock (FuProvider *provider,
+			 FuDevice *device,
+			 GError **error)
+{
+	FuProviderUdev *provider_udev = FU_PROVIDER_UDEV (provider);
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *guid = NULL;
+	g_autofree gchar *version = NULL;
+
+	/* get the FW version from the rom */
+	g_debug ("unlocking UDev device %s", fu_device_get_id (device));
+	if (!fu_provider_udev_load_rom (provider_udev, device, TRUE,
+					&version, &guid, &checksum, error))
+		return FALSE;
 
 	/* update version */
-	if (g_strcmp0 (fu_device_get_version (device),
-		       fu_rom_get_version (rom)) != 0) {
+	if (g_strcmp0 (fu_device_get_version (device), version) != 0) {
 		g_debug ("changing version of %s from %s to %s",
 			 fu_device_get_id (device),
 			 fu_device_get_version (device),
-			 fu_rom_get_version (rom));
-		fu_device_set_version (device, fu_rom_get_version (rom));
+			 version);
+		fu_device_set_version (device, version);
 	}
 
 	/* Also add the GUID from the firmware as the firmware may be more
 	 * generic, which also allows us to match the GUID when doing 'verify'
 	 * on a device with a different PID to the firmware */
-	fu_device_add_guid (device, fu_rom_get_guid (rom));
+	fu_device_add_guid (device, guid);
 
 	return TRUE;
 }
@@ -104,24 +258,16 @@ fu_provider_udev_verify (FuProvider *provider,
 			 FuProviderVerifyFlags flags,
 			 GError **error)
 {
-	const gchar *rom_fn;
-	g_autoptr(GFile) file = NULL;
-	g_autoptr(FuRom) rom = NULL;
+	FuProviderUdev *provider_udev = FU_PROVIDER_UDEV (provider);
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *guid = NULL;
+	g_autofree gchar *version = NULL;
 
-	/* open the file */
-	rom_fn = fu_device_get_metadata (device, "RomFilename");
-	if (rom_fn == NULL) {
-		g_set_error_literal (error,
-				     FWUPD_ERROR,
-				     FWUPD_ERROR_INTERNAL,
-				     "Unable to read firmware from device");
-		return FALSE;
-	}
-	file = g_file_new_for_path (rom_fn);
-	rom = fu_rom_new ();
-	if (!fu_rom_load_file (rom, file, FU_ROM_LOAD_FLAG_BLANK_PPID, NULL, error))
+	/* always read the ROM as the point is to detect a changed image */
+	if (!fu_provider_udev_load_rom (provider_udev, device, FALSE,
+					&version, &guid, &checksum, error))
 		return FALSE;
-	fu_device_set_checksum (device, fu_rom_get_checksum (rom));
+	fu_device_set_checksum (device, checksum);
 	return TRUE;
 }
 
@@ -190,7 +336,11 @@ fu_provider_udev_client_add (FuProviderUdev *provider_udev, GUdevDevice *device)
 	/* get the FW version from the rom when unlocked */
 	rom_fn = g_build_filename (g_udev_device_get_sysfs_path (device), "rom", NULL);
 	if (g_file_test (rom_fn, G_FILE_TEST_EXISTS)) {
+		g_autofree gchar *key = NULL;
 		fu_device_set_metadata (dev, "RomFilename", rom_fn);
+		key = fu_provider_udev_get_rom_cache_key (device, rom_fn);
+		if (key != NULL)
+			fu_device_set_metadata (dev, "RomCacheKey", key);
 		fu_device_add_flag (dev, FWUPD_DEVICE_FLAG_LOCKED);
 	}
 
@@ -215,6 +365,10 @@ fu_provider_udev_client_remove (FuProviderUdev *provider_udev, GUdevDevice *devi
 	dev = g_hash_table_lookup (priv->devices, id);
 	if (dev == NULL)
 		return;
+
+	/* the ROM may be different when the device comes back */
+	fu_provider_udev_rom_cache_remove (provider_udev,
+					   fu_device_get_metadata (dev, "RomCacheKey"));
 	fu_provider_device_remove (FU_PROVIDER (provider_udev), dev);
 }
 
@@ -279,10 +433,22 @@ fu_provider_udev_init (FuProviderUdev *provider_udev)
 {
 	FuProviderUdevPrivate *priv = GET_PRIVATE (provider_udev);
 	const gchar *subsystems[] = { NULL };
+	g_autoptr(GError) error = NULL;
 
 	priv->devices = g_hash_table_new_full (g_str_hash, g_str_equal,
 					       g_free, (GDestroyNotify) g_object_unref);
 	priv->gudev_client = g_udev_client_new (subsystems);
+	priv->rom_cache = g_key_file_new ();
+	if (g_file_get_contents ("/proc/sys/kernel/random/boot_id",
+				 &priv->boot_id, NULL, NULL))
+		g_strstrip (priv->boot_id);
+	priv->rom_cache_fn = g_build_filename (LOCALSTATEDIR, "cache", "fwupd",
+					       "rom.cache", NULL);
+	if (!g_key_file_load_from_file (priv->rom_cache, priv->rom_cache_fn,
+					G_KEY_FILE_NONE, &error)) {
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_warning ("failed to load ROM cache: %s", error->message);
+	}
 	g_signal_connect (priv->gudev_client, "uevent",
 			  G_CALLBACK (fu_provider_udev_client_uevent_cb), provider_udev);
 }
@@ -295,6 +461,9 @@ fu_provider_udev_finalize (GObject *object)
 
 	g_hash_table_unref (priv->devices);
 	g_object_unref (priv->gudev_client);
+	g_key_file_unref (priv->rom_cache);
+	g_free (priv->rom_cache_fn);
+	g_free (priv->boot_id);
 
 	G_OBJECT_CLASS (fu_provider_udev_parent_class)->finalize (object);
 }
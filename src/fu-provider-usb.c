@@ -24,19 +24,33 @@
 #include <appstream-glib.h>
 #include <fwupd.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <gusb.h>
 
 #include "fu-device.h"
 #include "fu-provider-usb.h"
+#include "fu-usb-cache.h"
 
 static void	fu_provider_usb_finalize	(GObject	*object);
 
 typedef struct {
 	GHashTable		*devices;
 	GUsbContext		*usb_ctx;
-	gboolean		 done_enumerate;
+	GPtrArray		*coldplug_devices;	/* of GUsbDevice */
+	FuUsbCache		*cache;
+	FuClaims		*claims;
 } FuProviderUsbPrivate;
 
+/* the string descriptors we need from each device */
+typedef struct {
+	GUsbDevice		*device;
+	gchar			*cache_key;
+	gchar			*product;
+	gchar			*version;
+	gchar			*guid;
+	gboolean		 valid;
+} FuProviderUsbStrings;
+
 G_DEFINE_TYPE_WITH_PRIVATE (FuProviderUsb, fu_provider_usb, FU_TYPE_PROVIDER)
 #define GET_PRIVATE(o) (fu_provider_usb_get_instance_private (o))
 
@@ -46,67 +60,157 @@ fu_provider_usb_get_name (FuProvider *provider)
 	return "USB";
 }
 
+static gchar *
+fu_provider_usb_get_cache_key (GUsbDevice *device)
+{
+	return g_strdup_printf ("%s:%04x:%04x:%04x",
+				g_usb_device_get_platform_id (device),
+				g_usb_device_get_vid (device),
+				g_usb_device_get_pid (device),
+				g_usb_device_get_release (device));
+}
+
+static FuProviderUsbStrings *
+fu_provider_usb_strings_new (GUsbDevice *device)
+{
+	FuProviderUsbStrings *strings = g_new0 (FuProviderUsbStrings, 1);
+	strings->device = g_object_ref (device);
+	strings->cache_key = fu_provider_usb_get_cache_key (device);
+	return strings;
+}
+
 static void
-fu_provider_usb_device_added (FuProviderUsb *provider_usb, GUsbDevice *device)
+fu_provider_usb_strings_free (FuProviderUsbStrings *strings)
+{
+	g_object_unref (strings->device);
+	g_free (strings->cache_key);
+	g_free (strings->product);
+	g_free (strings->version);
+	g_free (strings->guid);
+	g_free (strings);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FuProviderUsbStrings, fu_provider_usb_strings_free)
+
+/* this opens the device, and so may be run in a worker thread */
+static void
+fu_provider_usb_strings_read (FuProviderUsbStrings *strings)
+{
+	GUsbDevice *device = strings->device;
+	guint8 idx = 0x00;
+	g_autoptr(GError) error = NULL;
+
+	/* try to get the version without claiming interface */
+	if (!g_usb_device_open (device, &error)) {
+		g_debug ("Failed to open: %s", error->message);
+		return;
+	}
+
+	/* get product */
+	idx = g_usb_device_get_product_index (device);
+	if (idx != 0x00)
+		strings->product = g_usb_device_get_string_descriptor (device, idx, NULL);
+
+	/* get version number */
+	idx = g_usb_device_get_custom_index (device,
+					     G_USB_DEVICE_CLASS_VENDOR_SPECIFIC,
+					     'F', 'W', NULL);
+	if (idx != 0x00)
+		strings->version = g_usb_device_get_string_descriptor (device, idx, NULL);
+
+	/* get GUID from the descriptor if set */
+	idx = g_usb_device_get_custom_index (device,
+					     G_USB_DEVICE_CLASS_VENDOR_SPECIFIC,
+					     'G', 'U', NULL);
+	if (idx != 0x00)
+		strings->guid = g_usb_device_get_string_descriptor (device, idx, NULL);
+
+	/* we're done here */
+	if (!g_usb_device_close (device, &error))
+		g_debug ("Failed to close: %s", error->message);
+	strings->valid = TRUE;
+}
+
+static void
+fu_provider_usb_strings_read_cb (gpointer data, gpointer user_data)
+{
+	fu_provider_usb_strings_read ((FuProviderUsbStrings *) data);
+}
+
+static gboolean
+fu_provider_usb_cache_lookup (FuProviderUsb *provider_usb,
+			      FuProviderUsbStrings *strings)
 {
 	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
+	if (!fu_usb_cache_lookup (priv->cache, strings->cache_key,
+				  &strings->product,
+				  &strings->version,
+				  &strings->guid))
+		return FALSE;
+	strings->valid = TRUE;
+	return TRUE;
+}
+
+static void
+fu_provider_usb_cache_add (FuProviderUsb *provider_usb,
+			   FuProviderUsbStrings *strings)
+{
+	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
+
+	/* we could not open the device, so try again next time */
+	if (!strings->valid)
+		return;
+	fu_usb_cache_add (priv->cache, strings->cache_key,
+			  strings->product, strings->version, strings->guid);
+}
+
+static void
+fu_provider_usb_cache_save (FuProviderUsb *provider_usb)
+{
+	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
+	g_autoptr(GError) error = NULL;
+
+	/* not fatal */
+	if (!fu_usb_cache_save (priv->cache, &error))
+		g_warning ("failed to save USB cache: %s", error->message);
+}
+
+static void
+fu_provider_usb_device_add_strings (FuProviderUsb *provider_usb,
+				    FuProviderUsbStrings *strings)
+{
+	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
+	GUsbDevice *device = strings->device;
 	const gchar *platform_id = NULL;
-	guint8 idx = 0x00;
 	g_autofree gchar *devid1 = NULL;
 	g_autofree gchar *devid2 = NULL;
-	g_autofree gchar *product = NULL;
 	g_autofree gchar *version = NULL;
-	g_autoptr(AsProfile) profile = as_profile_new ();
-	g_autoptr(AsProfileTask) ptask = NULL;
 	g_autoptr(FuDevice) dev = NULL;
-	g_autoptr(GError) error = NULL;
 
-	/* ignore hubs */
-	if (g_usb_device_get_device_class (device) == G_USB_DEVICE_CLASS_HUB)
+	/* could not open, or no product */
+	if (!strings->valid)
 		return;
-	ptask = as_profile_start (profile, "FuProviderUsb:added{%04x:%04x}",
-				  g_usb_device_get_vid (device),
-				  g_usb_device_get_pid (device));
+	if (strings->product == NULL || strings->product[0] == '\0') {
+		g_debug ("no product string descriptor");
+		return;
+	}
 
 	/* is already in database */
 	platform_id = g_usb_device_get_platform_id (device);
-	dev = g_hash_table_lookup (priv->devices, platform_id);
-	if (dev != NULL) {
+	if (g_hash_table_lookup (priv->devices, platform_id) != NULL) {
 		g_debug ("ignoring duplicate %s", platform_id);
 		return;
 	}
 
-	/* try to get the version without claiming interface */
-	if (!g_usb_device_open (device, &error)) {
-		g_debug ("Failed to open: %s", error->message);
-		return;
-	}
-
 	/* insert to hash if valid */
 	dev = fu_device_new ();
 	fu_device_set_id (dev, platform_id);
-
-	/* get product */
-	idx = g_usb_device_get_product_index (device);
-	if (idx != 0x00) {
-		g_autoptr(AsProfileTask) ptask2 = NULL;
-		ptask2 = as_profile_start_literal (profile, "FuProviderUsb:get-string-desc");
-		product = g_usb_device_get_string_descriptor (device, idx, NULL);
-	}
-	if (product == NULL) {
-		g_debug ("no product string descriptor");
-		g_usb_device_close (device, NULL);
-		return;
-	}
-	fu_device_set_name (dev, product);
+	fu_device_set_name (dev, strings->product);
 
 	/* get version number, falling back to the USB device release */
-	idx = g_usb_device_get_custom_index (device,
-					     G_USB_DEVICE_CLASS_VENDOR_SPECIFIC,
-					     'F', 'W', NULL);
-	if (idx != 0x00)
-		version = g_usb_device_get_string_descriptor (device, idx, NULL);
-	if (version == NULL) {
+	if (strings->version != NULL) {
+		version = g_strdup (strings->version);
+	} else {
 		guint16 release;
 		release = g_usb_device_get_release (device);
 		version = as_utils_version_from_uint16 (release,
@@ -115,14 +219,8 @@ fu_provider_usb_device_added (FuProviderUsb *provider_usb, GUsbDevice *device)
 	fu_device_set_version (dev, version);
 
 	/* get GUID from the descriptor if set */
-	idx = g_usb_device_get_custom_index (device,
-					     G_USB_DEVICE_CLASS_VENDOR_SPECIFIC,
-					     'G', 'U', NULL);
-	if (idx != 0x00) {
-		g_autofree gchar *guid = NULL;
-		guid = g_usb_device_get_string_descriptor (device, idx, NULL);
-		fu_device_add_guid (dev, guid);
-	}
+	if (strings->guid != NULL)
+		fu_device_add_guid (dev, strings->guid);
 
 	/* also fall back to the USB VID:PID hash */
 	devid1 = g_strdup_printf ("USB\\VID_%04X&PID_%04X",
@@ -135,29 +233,61 @@ fu_provider_usb_device_added (FuProviderUsb *provider_usb, GUsbDevice *device)
 				  g_usb_device_get_release (device));
 	fu_device_add_guid (dev, devid2);
 
-	/* we're done here */
-	if (!g_usb_device_close (device, &error))
-		g_debug ("Failed to close: %s", error->message);
-
 	/* insert to hash */
 	fu_provider_device_add (FU_PROVIDER (provider_usb), dev);
 	g_hash_table_insert (priv->devices, g_strdup (platform_id), g_object_ref (dev));
 }
 
-typedef struct {
-	FuProviderUsb	*provider_usb;
-	GUsbDevice	*device;
-} FuProviderUsbHelper;
-
 static gboolean
-fu_provider_usb_device_added_delay_cb (gpointer user_data)
+fu_provider_usb_device_is_interesting (FuProviderUsb *provider_usb, GUsbDevice *device)
+{
+	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
+	const gchar *platform_id;
+
+	/* ignore hubs */
+	if (g_usb_device_get_device_class (device) == G_USB_DEVICE_CLASS_HUB)
+		return FALSE;
+
+	/* is already in database */
+	platform_id = g_usb_device_get_platform_id (device);
+	if (g_hash_table_lookup (priv->devices, platform_id) != NULL) {
+		g_debug ("ignoring duplicate %s", platform_id);
+		return FALSE;
+	}
+
+	/* another provider will add this */
+	if (priv->claims != NULL) {
+		const gchar *claimant = fu_claims_lookup (priv->claims, device);
+		if (claimant != NULL) {
+			g_debug ("ignoring %s as handled by %s",
+				 platform_id, claimant);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static void
+fu_provider_usb_device_added (FuProviderUsb *provider_usb, GUsbDevice *device)
 {
-	FuProviderUsbHelper *helper = (FuProviderUsbHelper *) user_data;
-	fu_provider_usb_device_added (helper->provider_usb, helper->device);
-	g_object_unref (helper->provider_usb);
-	g_object_unref (helper->device);
-	g_free (helper);
-	return FALSE;
+	g_autoptr(AsProfile) profile = as_profile_new ();
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(FuProviderUsbStrings) strings = NULL;
+
+	if (!fu_provider_usb_device_is_interesting (provider_usb, device))
+		return;
+	ptask = as_profile_start (profile, "FuProviderUsb:added{%04x:%04x}",
+				  g_usb_device_get_vid (device),
+				  g_usb_device_get_pid (device));
+
+	/* only open the device if we've not seen it before */
+	strings = fu_provider_usb_strings_new (device);
+	if (!fu_provider_usb_cache_lookup (provider_usb, strings)) {
+		fu_provider_usb_strings_read (strings);
+		fu_provider_usb_cache_add (provider_usb, strings);
+		fu_provider_usb_cache_save (provider_usb);
+	}
+	fu_provider_usb_device_add_strings (provider_usb, strings);
 }
 
 static void
@@ -167,17 +297,13 @@ fu_provider_usb_device_added_cb (GUsbContext *ctx,
 {
 	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
 
-	/* use a small delay for hotplugging so that other, better, providers
-	 * can claim this interface and add the FuDevice */
-	if (priv->done_enumerate) {
-		FuProviderUsbHelper *helper;
-		g_debug ("waiting a small time for other providers");
-		helper = g_new0 (FuProviderUsbHelper, 1);
-		helper->provider_usb = g_object_ref (provider_usb);
-		helper->device = g_object_ref (device);
-		g_timeout_add (500, fu_provider_usb_device_added_delay_cb, helper);
+	/* read these all at once when enumeration is complete */
+	if (priv->coldplug_devices != NULL) {
+		g_ptr_array_add (priv->coldplug_devices, g_object_ref (device));
 		return;
 	}
+
+	/* other providers are asked synchronously if they want the device */
 	fu_provider_usb_device_added (provider_usb, device);
 }
 
@@ -189,6 +315,16 @@ fu_provider_usb_device_removed_cb (GUsbContext *ctx,
 	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
 	FuDevice *dev;
 	const gchar *platform_id = NULL;
+	g_autofree gchar *cache_key = NULL;
+
+	/* the next device in this port may be handled by someone else */
+	if (priv->claims != NULL)
+		fu_claims_remove (priv->claims, device);
+
+	/* the firmware may be different when it comes back */
+	cache_key = fu_provider_usb_get_cache_key (device);
+	if (fu_usb_cache_remove (priv->cache, cache_key))
+		fu_provider_usb_cache_save (provider_usb);
 
 	/* already in database */
 	platform_id = g_usb_device_get_platform_id (device);
@@ -205,11 +341,66 @@ fu_provider_usb_coldplug (FuProvider *provider, GError **error)
 {
 	FuProviderUsb *provider_usb = FU_PROVIDER_USB (provider);
 	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
+	GThreadPool *pool = NULL;
+	guint cache_misses = 0;
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GPtrArray) items = NULL;
+	g_autoptr(AsProfile) profile = as_profile_new ();
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	/* collect the devices rather than opening each in turn */
+	priv->coldplug_devices = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	g_usb_context_enumerate (priv->usb_ctx);
-	priv->done_enumerate = TRUE;
+	devices = g_steal_pointer (&priv->coldplug_devices);
+
+	/* read the string descriptors of devices not in the cache at the
+	 * same time, as each needs several control transfers */
+	ptask = as_profile_start_literal (profile, "FuProviderUsb:coldplug");
+	items = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_provider_usb_strings_free);
+	for (guint i = 0; i < devices->len; i++) {
+		GUsbDevice *device = g_ptr_array_index (devices, i);
+		FuProviderUsbStrings *strings;
+		if (!fu_provider_usb_device_is_interesting (provider_usb, device))
+			continue;
+		strings = fu_provider_usb_strings_new (device);
+		g_ptr_array_add (items, strings);
+		if (fu_provider_usb_cache_lookup (provider_usb, strings))
+			continue;
+		if (pool == NULL) {
+			pool = g_thread_pool_new (fu_provider_usb_strings_read_cb,
+						  NULL, 8, TRUE, error);
+			if (pool == NULL)
+				return FALSE;
+		}
+		if (!g_thread_pool_push (pool, strings, error)) {
+			g_thread_pool_free (pool, TRUE, TRUE);
+			return FALSE;
+		}
+		cache_misses++;
+	}
+	if (pool != NULL)
+		g_thread_pool_free (pool, FALSE, TRUE);
+	g_debug ("read %u of %u USB devices, the rest were cached",
+		 cache_misses, items->len);
+
+	/* add in enumeration order */
+	for (guint i = 0; i < items->len; i++) {
+		FuProviderUsbStrings *strings = g_ptr_array_index (items, i);
+		fu_provider_usb_cache_add (provider_usb, strings);
+		fu_provider_usb_device_add_strings (provider_usb, strings);
+	}
+	if (cache_misses > 0)
+		fu_provider_usb_cache_save (provider_usb);
 	return TRUE;
 }
 
+void
+fu_provider_usb_set_claims (FuProviderUsb *provider_usb, FuClaims *claims)
+{
+	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
+	g_set_object (&priv->claims, claims);
+}
+
 static void
 fu_provider_usb_class_init (FuProviderUsbClass *klass)
 {
@@ -225,9 +416,17 @@ static void
 fu_provider_usb_init (FuProviderUsb *provider_usb)
 {
 	FuProviderUsbPrivate *priv = GET_PRIVATE (provider_usb);
+	g_autofree gchar *cache_fn = NULL;
+	g_autoptr(GError) error = NULL;
+
 	priv->devices = g_hash_table_new_full (g_str_hash, g_str_equal,
 					       g_free, (GDestroyNotify) g_object_unref);
 	priv->usb_ctx = g_usb_context_new (NULL);
+	priv->cache = fu_usb_cache_new ();
+	cache_fn = g_build_filename (LOCALSTATEDIR, "cache", "fwupd",
+				     "usb.cache", NULL);
+	if (!fu_usb_cache_load (priv->cache, cache_fn, &error))
+		g_warning ("failed to load USB cache: %s", error->message);
 	g_signal_connect (priv->usb_ctx, "device-added",
 			  G_CALLBACK (fu_provider_usb_device_added_cb),
 			  provider_usb);
@@ -244,6 +443,9 @@ fu_provider_usb_finalize (GObject *object)
 
 	g_hash_table_unref (priv->devices);
 	g_object_unref (priv->usb_ctx);
+	g_object_unref (priv->cache);
+	if (priv->claims != NULL)
+		g_object_unref (priv->claims);
 
 	G_OBJECT_CLASS (fu_provider_usb_parent_class)->finalize (object);
 }
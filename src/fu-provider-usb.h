@@ -24,6 +24,7 @@
 
 #include <glib-object.h>
 
+#include "fu-claims.h"
 #include "fu-device.h"
 #include "fu-provider.h"
 
@@ -38,6 +39,8 @@ struct _FuProviderUsbClass
 };
 
 FuProvider	*fu_provider_usb_new		(void);
+void		 fu_provider_usb_set_claims	(FuProviderUsb	*provider_usb,
+						 FuClaims	*claims);
 
 G_END_DECLS
 
@@ -39,6 +39,7 @@ static void	fu_provider_finalize	(GObject	*object);
 enum {
 	SIGNAL_DEVICE_ADDED,
 	SIGNAL_DEVICE_REMOVED,
+	SIGNAL_DEVICE_CHANGED,
 	SIGNAL_STATUS_CHANGED,
 	SIGNAL_PERCENTAGE_CHANGED,
 	SIGNAL_LAST
@@ -46,7 +47,46 @@ enum {
 
 static guint signals[SIGNAL_LAST] = { 0 };
 
-G_DEFINE_TYPE (FuProvider, fu_provider, G_TYPE_OBJECT)
+typedef struct {
+	FuPending		*pending;
+	gboolean		 update_in_thread;
+} FuProviderPrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE (FuProvider, fu_provider, G_TYPE_OBJECT)
+#define GET_PRIVATE(o) (fu_provider_get_instance_private (o))
+
+void
+fu_provider_set_pending (FuProvider *provider, FuPending *pending)
+{
+	FuProviderPrivate *priv = GET_PRIVATE (provider);
+	g_set_object (&priv->pending, pending);
+}
+
+/* the online update can be run from a worker thread, i.e. it does not
+ * need the main context to be iterated to complete */
+void
+fu_provider_set_update_in_thread (FuProvider *provider, gboolean update_in_thread)
+{
+	FuProviderPrivate *priv = GET_PRIVATE (provider);
+	priv->update_in_thread = update_in_thread;
+}
+
+gboolean
+fu_provider_get_update_in_thread (FuProvider *provider)
+{
+	FuProviderPrivate *priv = GET_PRIVATE (provider);
+	return priv->update_in_thread;
+}
+
+/* use the daemon-wide database if set, rather than opening it each time */
+static FuPending *
+fu_provider_get_pending (FuProvider *provider)
+{
+	FuProviderPrivate *priv = GET_PRIVATE (provider);
+	if (priv->pending == NULL)
+		priv->pending = fu_pending_new ();
+	return priv->pending;
+}
 
 static gboolean
 fu_provider_offline_invalidate (GError **error)
@@ -110,12 +150,11 @@ fu_provider_schedule_update (FuProvider *provider,
 	gchar tmpname[] = {"XXXXXX.cap"};
 	g_autofree gchar *dirname = NULL;
 	g_autofree gchar *filename = NULL;
+	FuPending *pending = fu_provider_get_pending (provider);
 	g_autoptr(FwupdResult) res_tmp = NULL;
-	g_autoptr(FuPending) pending = NULL;
 	g_autoptr(GFile) file = NULL;
 
 	/* id already exists */
-	pending = fu_pending_new ();
 	res_tmp = fu_pending_get_device (pending, fu_device_get_id (device), NULL);
 	if (res_tmp != NULL) {
 		g_set_error (error,
@@ -215,7 +254,7 @@ fu_provider_update (FuProvider *provider,
 		    GError **error)
 {
 	FuProviderClass *klass = FU_PROVIDER_GET_CLASS (provider);
-	g_autoptr(FuPending) pending = NULL;
+	FuPending *pending;
 	g_autoptr(FwupdResult) res_pending = NULL;
 	GError *error_update = NULL;
 
@@ -249,7 +288,7 @@ fu_provider_update (FuProvider *provider,
 				     "No online update possible");
 		return FALSE;
 	}
-	pending = fu_pending_new ();
+	pending = fu_provider_get_pending (provider);
 	res_pending = fu_pending_get_device (pending, fu_device_get_id (device), NULL);
 	if (!klass->update_online (provider, device, blob_fw, flags, &error_update)) {
 		/* save the error to the database */
@@ -295,14 +334,14 @@ fu_provider_clear_results (FuProvider *provider, FuDevice *device, GError **erro
 	FuProviderClass *klass = FU_PROVIDER_GET_CLASS (provider);
 	g_autoptr(GError) error_local = NULL;
 	g_autoptr(FwupdResult) res_pending = NULL;
-	g_autoptr(FuPending) pending = NULL;
+	FuPending *pending;
 
 	/* handled by the provider */
 	if (klass->clear_results != NULL)
 		return klass->clear_results (provider, device, error);
 
 	/* handled using the database */
-	pending = fu_pending_new ();
+	pending = fu_provider_get_pending (provider);
 	res_pending = fu_pending_get_device (pending,
 					     fu_device_get_id (device),
 					     &error_local);
@@ -328,14 +367,14 @@ fu_provider_get_results (FuProvider *provider, FuDevice *device, GError **error)
 	const gchar *tmp;
 	g_autoptr(GError) error_local = NULL;
 	g_autoptr(FwupdResult) res_pending = NULL;
-	g_autoptr(FuPending) pending = NULL;
+	FuPending *pending;
 
 	/* handled by the provider */
 	if (klass->get_results != NULL)
 		return klass->get_results (provider, device, error);
 
 	/* handled using the database */
-	pending = fu_pending_new ();
+	pending = fu_provider_get_pending (provider);
 	res_pending = fu_pending_get_device (pending,
 					     fu_device_get_id (device),
 					     &error_local);
@@ -375,6 +414,17 @@ fu_provider_get_results (FuProvider *provider, FuDevice *device, GError **error)
 	return TRUE;
 }
 
+/* this must not do any I/O as it is called for every USB device that is
+ * plugged in, before the provider has seen the device itself */
+gboolean
+fu_provider_claim_usb_device (FuProvider *provider, GUsbDevice *usb_device)
+{
+	FuProviderClass *klass = FU_PROVIDER_GET_CLASS (provider);
+	if (klass->claim_usb_device != NULL)
+		return klass->claim_usb_device (provider, usb_device);
+	return FALSE;
+}
+
 const gchar *
 fu_provider_get_name (FuProvider *provider)
 {
@@ -404,6 +454,16 @@ fu_provider_device_remove (FuProvider *provider, FuDevice *device)
 	g_signal_emit (provider, signals[SIGNAL_DEVICE_REMOVED], 0, device);
 }
 
+/* the device was already added, but has new GUIDs or other properties */
+void
+fu_provider_device_changed (FuProvider *provider, FuDevice *device)
+{
+	g_debug ("emit changed from %s: %s",
+		 fu_provider_get_name (provider),
+		 fu_device_get_id (device));
+	g_signal_emit (provider, signals[SIGNAL_DEVICE_CHANGED], 0, device);
+}
+
 void
 fu_provider_set_status (FuProvider *provider, FwupdStatus status)
 {
@@ -442,6 +502,12 @@ fu_provider_class_init (FuProviderClass *klass)
 			      G_STRUCT_OFFSET (FuProviderClass, device_removed),
 			      NULL, NULL, g_cclosure_marshal_VOID__OBJECT,
 			      G_TYPE_NONE, 1, FU_TYPE_DEVICE);
+	signals[SIGNAL_DEVICE_CHANGED] =
+		g_signal_new ("device-changed",
+			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (FuProviderClass, device_changed),
+			      NULL, NULL, g_cclosure_marshal_VOID__OBJECT,
+			      G_TYPE_NONE, 1, FU_TYPE_DEVICE);
 	signals[SIGNAL_STATUS_CHANGED] =
 		g_signal_new ("status-changed",
 			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
@@ -464,5 +530,11 @@ fu_provider_init (FuProvider *provider)
 static void
 fu_provider_finalize (GObject *object)
 {
+	FuProvider *provider = FU_PROVIDER (object);
+	FuProviderPrivate *priv = GET_PRIVATE (provider);
+
+	if (priv->pending != NULL)
+		g_object_unref (priv->pending);
+
 	G_OBJECT_CLASS (fu_provider_parent_class)->finalize (object);
 }
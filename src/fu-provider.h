@@ -23,8 +23,10 @@
 #define __FU_PROVIDER_H
 
 #include <glib-object.h>
+#include <gusb.h>
 
 #include "fu-device.h"
+#include "fu-pending.h"
 #include "fu-plugin.h"
 #include "fu-provider.h"
 
@@ -70,12 +72,16 @@ struct _FuProviderClass
 	gboolean	 (*get_results)		(FuProvider	*provider,
 						 FuDevice	*device,
 						 GError		**error);
+	gboolean	 (*claim_usb_device)	(FuProvider	*provider,
+						 GUsbDevice	*usb_device);
 
 	/* signals */
 	void		 (* device_added)	(FuProvider	*provider,
 						 FuDevice	*device);
 	void		 (* device_removed)	(FuProvider	*provider,
 						 FuDevice	*device);
+	void		 (* device_changed)	(FuProvider	*provider,
+						 FuDevice	*device);
 	void		 (* status_changed)	(FuProvider	*provider,
 						 FwupdStatus	 status);
 	void		 (* percentage_changed)	(FuProvider	*provider,
@@ -88,11 +94,18 @@ void		 fu_provider_device_add		(FuProvider	*provider,
 						 FuDevice	*device);
 void		 fu_provider_device_remove	(FuProvider	*provider,
 						 FuDevice	*device);
+void		 fu_provider_device_changed	(FuProvider	*provider,
+						 FuDevice	*device);
 void		 fu_provider_set_status		(FuProvider	*provider,
 						 FwupdStatus	 status);
 void		 fu_provider_set_percentage	(FuProvider	*provider,
 						 guint		 percentage);
 const gchar	*fu_provider_get_name		(FuProvider	*provider);
+void		 fu_provider_set_pending	(FuProvider	*provider,
+						 FuPending	*pending);
+void		 fu_provider_set_update_in_thread (FuProvider	*provider,
+						 gboolean	 update_in_thread);
+gboolean	 fu_provider_get_update_in_thread (FuProvider	*provider);
 gboolean	 fu_provider_coldplug		(FuProvider	*provider,
 						 GError		**error);
 gboolean	 fu_provider_update		(FuProvider	*provider,
@@ -115,6 +128,8 @@ gboolean	 fu_provider_clear_results	(FuProvider	*provider,
 gboolean	 fu_provider_get_results	(FuProvider	*provider,
 						 FuDevice	*device,
 						 GError		**error);
+gboolean	 fu_provider_claim_usb_device	(FuProvider	*provider,
+						 GUsbDevice	*usb_device);
 GChecksumType	 fu_provider_get_checksum_type	(FuProviderVerifyFlags flags);
 
 G_END_DECLS
@@ -34,7 +34,7 @@ static void fu_rom_finalize			 (GObject *object);
 
 /* data from http://resources.infosecinstitute.com/pci-expansion-rom/ */
 typedef struct {
-	guint8		*rom_data;
+	guint8		*rom_data;	/* owned by FuRomPrivate->blob */
 	guint32		 rom_len;
 	guint32		 rom_offset;
 	guint32		 entry_point;
@@ -59,6 +59,8 @@ typedef struct {
 	GChecksum			*checksum_wip;
 	GChecksumType			 checksum_type;
 	GInputStream			*stream;
+	GByteArray			*blob;
+	gboolean			 stream_eof;
 	FuRomKind			 kind;
 	gchar				*version;
 	gchar				*guid;
@@ -67,13 +69,15 @@ typedef struct {
 	GPtrArray			*hdrs; /* of FuRomPciHeader */
 } FuRomPrivate;
 
+#define FU_ROM_SIZE_MAX		0x400000
+#define FU_ROM_READ_CHUNK	0x10000
+
 G_DEFINE_TYPE_WITH_PRIVATE (FuRom, fu_rom, G_TYPE_OBJECT)
 #define GET_PRIVATE(o) (fu_rom_get_instance_private (o))
 
 static void
 fu_rom_pci_header_free (FuRomPciHeader *hdr)
 {
-	g_free (hdr->rom_data);
 	g_free (hdr);
 }
 
@@ -414,6 +418,12 @@ fu_rom_pci_get_header (guint8 *buffer, gssize sz)
 {
 	FuRomPciHeader *hdr;
 
+	/* not enough data left for a header */
+	if (sz < 0x1c) {
+		g_debug ("Not PCI ROM, only 0x%02x bytes", (guint) sz);
+		return NULL;
+	}
+
 	/* check signature */
 	if (memcmp (buffer, "\x55\xaa", 2) != 0) {
 		if (memcmp (buffer, "\x56\x4e", 2) == 0) {
@@ -435,9 +445,13 @@ fu_rom_pci_get_header (guint8 *buffer, gssize sz)
 		g_debug ("fixing up last image size");
 		hdr->rom_len = (guint32) sz;
 	}
+	if (hdr->rom_len > sz) {
+		g_debug ("truncating image to 0x%04x", (guint) sz);
+		hdr->rom_len = (guint32) sz;
+	}
 
-	/* copy this locally to the header */
-	hdr->rom_data = g_memdup (buffer, hdr->rom_len);
+	/* this points into the blob, so is only valid until it grows */
+	hdr->rom_data = buffer;
 
 	/* parse out CPI */
 	hdr->entry_point = ((guint32) buffer[0x05] << 16) +
@@ -448,6 +462,10 @@ fu_rom_pci_get_header (guint8 *buffer, gssize sz)
 
 	/* parse the header data */
 	g_debug ("looking for PCI DATA @ 0x%04x", hdr->cpi_ptr);
+	if ((gssize) hdr->cpi_ptr + 0x1c > sz) {
+		g_debug ("No available PCI DATA @ 0x%04x", hdr->cpi_ptr);
+		return hdr;
+	}
 	fu_rom_pci_parse_data (hdr);
 	return hdr;
 }
@@ -548,21 +566,60 @@ fu_rom_find_version (FuRomKind kind, FuRomPciHeader *hdr)
 	return NULL;
 }
 
+/* reads until at least @len bytes are available or the stream ends */
+static gboolean
+fu_rom_stream_fill (FuRom *rom, gsize len, GCancellable *cancellable, GError **error)
+{
+	FuRomPrivate *priv = GET_PRIVATE (rom);
+
+	len = MIN (len, FU_ROM_SIZE_MAX);
+	while (!priv->stream_eof && priv->blob->len < len) {
+		gsize sz_old = priv->blob->len;
+		gsize sz_chunk = MAX (len - sz_old, FU_ROM_READ_CHUNK);
+		gssize sz;
+
+		sz_chunk = MIN (sz_chunk, FU_ROM_SIZE_MAX - sz_old);
+		g_byte_array_set_size (priv->blob, (guint) (sz_old + sz_chunk));
+		sz = g_input_stream_read (priv->stream,
+					  priv->blob->data + sz_old,
+					  sz_chunk,
+					  cancellable,
+					  error);
+		if (sz < 0) {
+			g_byte_array_set_size (priv->blob, (guint) sz_old);
+			return FALSE;
+		}
+		g_byte_array_set_size (priv->blob, (guint) (sz_old + (gsize) sz));
+		if (sz == 0 || priv->blob->len >= FU_ROM_SIZE_MAX)
+			priv->stream_eof = TRUE;
+	}
+	return TRUE;
+}
+
+/* does the data look like the start of another PCI ROM image */
+static gboolean
+fu_rom_pci_has_signature (const guint8 *buffer, gsize sz)
+{
+	if (sz < 2)
+		return FALSE;
+	return memcmp (buffer, "\x55\xaa", 2) == 0 ||
+	       memcmp (buffer, "\x56\x4e", 2) == 0;
+}
+
 gboolean
 fu_rom_load_file (FuRom *rom, GFile *file, FuRomLoadFlags flags,
 		  GCancellable *cancellable, GError **error)
 {
 	FuRomPrivate *priv = GET_PRIVATE (rom);
 	FuRomPciHeader *hdr = NULL;
-	const gssize buffer_sz = 0x400000;
-	gssize sz;
+	FuRomPciHeader *hdr_prev = NULL;
+	gsize sz;
+	guint8 *buffer;
 	guint32 jump = 0;
 	guint32 hdr_sz = 0;
-	guint number_reads = 0;
 	g_autoptr(GError) error_local = NULL;
 	g_autofree gchar *fn = NULL;
 	g_autofree gchar *id = NULL;
-	g_autofree guint8 *buffer = NULL;
 	g_autoptr(GFileOutputStream) output_stream = NULL;
 	g_autoptr(AsProfile) profile = as_profile_new ();
 	g_autoptr(AsProfileTask) ptask = NULL;
@@ -593,62 +650,75 @@ fu_rom_load_file (FuRom *rom, GFile *file, FuRomLoadFlags flags,
 	}
 
 	/* read out the header */
-	buffer = g_malloc ((gsize) buffer_sz);
-	sz = g_input_stream_read (priv->stream, buffer, buffer_sz,
-				  cancellable, error);
-	if (sz < 0)
+	if (!fu_rom_stream_fill (rom, 1024, cancellable, error))
 		return FALSE;
-	if (sz < 1024) {
+	if (priv->blob->len < 1024) {
 		g_set_error (error,
 			     FWUPD_ERROR,
 			     FWUPD_ERROR_INVALID_FILE,
-			     "Firmware too small: %" G_GSSIZE_FORMAT " bytes", sz);
+			     "Firmware too small: %u bytes", priv->blob->len);
 		return FALSE;
 	}
 
-	/* ensure we got enough data to fill the buffer */
-	while (sz < buffer_sz) {
-		gssize sz_chunk;
-		sz_chunk = g_input_stream_read (priv->stream,
-						buffer + sz,
-						buffer_sz - sz,
-						cancellable,
-						error);
-		if (sz_chunk == 0)
-			break;
-		g_debug ("ROM returned 0x%04x bytes, adding 0x%04x...",
-			 (guint) sz, (guint) sz_chunk);
-		if (sz_chunk < 0)
-			return FALSE;
-		sz += sz_chunk;
-
-		/* check the firmware isn't serving us small chunks */
-		if (number_reads++ > 16) {
-			g_set_error_literal (error,
-					     FWUPD_ERROR,
-					     FWUPD_ERROR_INVALID_FILE,
-					     "firmware not fulfilling requests");
-			return FALSE;
-		}
-	}
-	g_debug ("ROM buffer filled %" G_GSSIZE_FORMAT "kb/%" G_GSSIZE_FORMAT "kb",
-		 sz / 0x400, buffer_sz / 0x400);
-
 	/* detect optional IFR header and skip to option ROM */
-	if (memcmp (buffer, "NVGI", 4) == 0)
-		hdr_sz = GUINT16_FROM_BE (buffer[0x15]);
+	if (memcmp (priv->blob->data, "NVGI", 4) == 0)
+		hdr_sz = GUINT16_FROM_BE (priv->blob->data[0x15]);
 
-	/* read all the ROM headers */
-	while (sz > hdr_sz + jump) {
+	/* read the ROM headers as the data arrives, only reading as much of
+	 * each image as its header says it needs */
+	while (TRUE) {
+		guint32 offset = hdr_sz + jump;
 		guint32 jump_sz;
-		g_debug ("looking for PCI ROM @ 0x%04x", hdr_sz + jump);
-		hdr = fu_rom_pci_get_header (&buffer[hdr_sz + jump], sz - hdr_sz - jump);
+
+		/* enough for the PCI ROM header */
+		if (!fu_rom_stream_fill (rom, (gsize) offset + 0x1c,
+					 cancellable, error))
+			return FALSE;
+		if (priv->blob->len <= offset)
+			break;
+
+		/* we can't just break on hdr->last_image as NVIDIA uses
+		 * packed but not merged extended headers; anything else
+		 * after the last image is checked for junk data below */
+		if (hdr_prev != NULL && (hdr_prev->last_image & 0x80) > 0 &&
+		    !fu_rom_pci_has_signature (priv->blob->data + offset,
+					       priv->blob->len - offset)) {
+			g_debug ("last image found @ 0x%04x", hdr_prev->rom_offset);
+			hdr = NULL;
+		} else {
+			gsize image_len = G_MAXSIZE;
+
+			/* get the whole image, or everything if the size is unset */
+			if (priv->blob->len >= (gsize) offset + 0x1c) {
+				guint8 *tmp = priv->blob->data + offset;
+				guint16 cpi_ptr = ((guint16) tmp[0x19] << 8) + tmp[0x18];
+				if (tmp[0x02] > 0)
+					image_len = MAX ((gsize) tmp[0x02] * 512,
+							 (gsize) cpi_ptr + 0x1c);
+			}
+			if (image_len != G_MAXSIZE)
+				image_len += offset;
+			if (!fu_rom_stream_fill (rom, image_len, cancellable, error))
+				return FALSE;
+
+			g_debug ("looking for PCI ROM @ 0x%04x", offset);
+			buffer = priv->blob->data;
+			sz = priv->blob->len;
+			hdr = fu_rom_pci_get_header (&buffer[offset], (gssize) (sz - offset));
+		}
 		if (hdr == NULL) {
 			gboolean found_data = FALSE;
 
-			/* check it's not just NUL padding */
-			for (guint i = 0; i < hdr_sz + jump; i++) {
-				if (buffer[hdr_sz + jump + i] != 0x00) {
+			/* check it's not just NUL padding; this only looks as
+			 * many bytes past the offset as the offset itself, as
+			 * it always has, so existing checksums do not change */
+			if (!fu_rom_stream_fill (rom, FU_ROM_SIZE_MAX,
+						 cancellable, error))
+				return FALSE;
+			buffer = priv->blob->data;
+			sz = priv->blob->len;
+			for (gsize i = offset; i < MIN ((gsize) offset * 2, sz); i++) {
+				if (buffer[i] != 0x00) {
 					found_data = TRUE;
 					break;
 				}
@@ -660,9 +730,8 @@ fu_rom_load_file (FuRom *rom, GFile *file, FuRomLoadFlags flags,
 				hdr->device_id = 0x0000;
 				hdr->code_type = 0x00;
 				hdr->last_image = 0x80;
-				hdr->rom_offset = hdr_sz + jump;
+				hdr->rom_offset = offset;
 				hdr->rom_len = (guint32) (sz - hdr->rom_offset);
-				hdr->rom_data = g_memdup (&buffer[hdr->rom_offset], hdr->rom_len);
 				hdr->image_len = hdr->rom_len;
 				g_ptr_array_add (priv->hdrs, hdr);
 			} else {
@@ -672,11 +741,9 @@ fu_rom_load_file (FuRom *rom, GFile *file, FuRomLoadFlags flags,
 		}
 
 		/* save this so we can fix checksums */
-		hdr->rom_offset = hdr_sz + jump;
-
-		/* we can't break on hdr->last_image as
-		 * NVIDIA uses packed but not merged extended headers */
+		hdr->rom_offset = offset;
 		g_ptr_array_add (priv->hdrs, hdr);
+		hdr_prev = hdr;
 
 		/* NVIDIA don't always set a ROM size for extensions */
 		jump_sz = hdr->rom_len;
@@ -686,6 +753,15 @@ fu_rom_load_file (FuRom *rom, GFile *file, FuRomLoadFlags flags,
 			break;
 		jump += jump_sz;
 	}
+	g_debug ("ROM read 0x%04xkb", priv->blob->len / 0x400);
+
+	/* the blob will not move now, so point each image into it */
+	buffer = priv->blob->data;
+	sz = priv->blob->len;
+	for (guint i = 0; i < priv->hdrs->len; i++) {
+		hdr = g_ptr_array_index (priv->hdrs, i);
+		hdr->rom_data = buffer + hdr->rom_offset;
+	}
 
 	/* we found nothing */
 	if (priv->hdrs->len == 0) {
@@ -770,6 +846,85 @@ fu_rom_load_file (FuRom *rom, GFile *file, FuRomLoadFlags flags,
 	return TRUE;
 }
 
+static void
+fu_rom_load_item_free (FuRomLoadItem *item)
+{
+	g_free (item->filename);
+	if (item->rom != NULL)
+		g_object_unref (item->rom);
+	if (item->error != NULL)
+		g_error_free (item->error);
+	g_free (item);
+}
+
+typedef struct {
+	FuRomLoadFlags		 flags;
+	GCancellable		*cancellable;
+} FuRomLoadHelper;
+
+static void
+fu_rom_load_item_cb (gpointer data, gpointer user_data)
+{
+	FuRomLoadItem *item = (FuRomLoadItem *) data;
+	FuRomLoadHelper *helper = (FuRomLoadHelper *) user_data;
+	g_autoptr(FuRom) rom = fu_rom_new ();
+	g_autoptr(GFile) file = g_file_new_for_path (item->filename);
+	if (!fu_rom_load_file (rom, file, helper->flags,
+			       helper->cancellable, &item->error))
+		return;
+	item->rom = g_steal_pointer (&rom);
+}
+
+/**
+ * fu_rom_load_files:
+ * @filenames: ROM filenames
+ * @flags: some #FuRomLoadFlags
+ * @jobs: the number of files to load at once, or 0 for the number of CPUs
+ * @cancellable: a #GCancellable, or %NULL
+ *
+ * Loads ROM files concurrently, which is much faster when each is read
+ * slowly from sysfs.
+ *
+ * Returns: (transfer container) (element-type FuRomLoadItem): one item for
+ * each of @filenames in the same order
+ **/
+GPtrArray *
+fu_rom_load_files (gchar **filenames,
+		   FuRomLoadFlags flags,
+		   guint jobs,
+		   GCancellable *cancellable)
+{
+	FuRomLoadHelper helper = { flags, cancellable };
+	GPtrArray *items;
+	GThreadPool *pool;
+	g_autoptr(GError) error_local = NULL;
+
+	items = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_rom_load_item_free);
+	for (guint i = 0; filenames[i] != NULL; i++) {
+		FuRomLoadItem *item = g_new0 (FuRomLoadItem, 1);
+		item->filename = g_strdup (filenames[i]);
+		g_ptr_array_add (items, item);
+	}
+	if (jobs == 0)
+		jobs = g_get_num_processors ();
+
+	/* fall back to loading in this thread */
+	pool = g_thread_pool_new (fu_rom_load_item_cb, &helper,
+				  (gint) MIN (jobs, MAX (items->len, 1)),
+				  TRUE, &error_local);
+	if (pool == NULL) {
+		g_warning ("failed to create thread pool: %s",
+			   error_local->message);
+		for (guint i = 0; i < items->len; i++)
+			fu_rom_load_item_cb (g_ptr_array_index (items, i), &helper);
+		return items;
+	}
+	for (guint i = 0; i < items->len; i++)
+		g_thread_pool_push (pool, g_ptr_array_index (items, i), NULL);
+	g_thread_pool_free (pool, FALSE, TRUE);
+	return items;
+}
+
 FuRomKind
 fu_rom_get_kind (FuRom *rom)
 {
@@ -838,6 +993,7 @@ fu_rom_init (FuRom *rom)
 	priv->checksum_type = G_CHECKSUM_SHA1;
 	priv->checksum_wip = g_checksum_new (priv->checksum_type);
 	priv->hdrs = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_rom_pci_header_free);
+	priv->blob = g_byte_array_new ();
 }
 
 static void
@@ -850,6 +1006,7 @@ fu_rom_finalize (GObject *object)
 	g_free (priv->version);
 	g_free (priv->guid);
 	g_ptr_array_unref (priv->hdrs);
+	g_byte_array_unref (priv->blob);
 	if (priv->stream != NULL)
 		g_object_unref (priv->stream);
 
@@ -50,7 +50,17 @@ typedef enum {
 	FU_ROM_LOAD_FLAG_LAST
 } FuRomLoadFlags;
 
+typedef struct {
+	gchar		*filename;
+	FuRom		*rom;		/* NULL if loading failed */
+	GError		*error;
+} FuRomLoadItem;
+
 FuRom		*fu_rom_new				(void);
+GPtrArray	*fu_rom_load_files			(gchar		**filenames,
+							 FuRomLoadFlags	 flags,
+							 guint		 jobs,
+							 GCancellable	*cancellable);
 
 gboolean	 fu_rom_load_file			(FuRom		*rom,
 							 GFile		*file,
@@ -26,12 +26,16 @@
 #include <glib/gstdio.h>
 #include <gio/gfiledescriptorbased.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "fu-cab.h"
 #include "fu-keyring.h"
 #include "fu-pending.h"
 #include "fu-provider-fake.h"
 #include "fu-provider-rpi.h"
 #include "fu-rom.h"
+#include "fu-store-cache.h"
+#include "fu-usb-cache.h"
 
 #ifdef HAVE_DELL
   #include "fu-provider-dell.h"
@@ -749,6 +753,7 @@ fu_pending_func (void)
 	gboolean ret;
 	FwupdResult *res;
 	g_autoptr(FuPending) pending = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
 	g_autofree gchar *dirname = NULL;
 	g_autofree gchar *filename = NULL;
 
@@ -821,6 +826,27 @@ fu_pending_func (void)
 	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_NOT_FOUND);
 	g_assert (res == NULL);
 	g_clear_error (&error);
+
+	/* add several devices in one transaction */
+	ret = fu_pending_begin (pending, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	for (guint i = 0; i < 3; i++) {
+		g_autofree gchar *id = g_strdup_printf ("self-test-%u", i);
+		res = FWUPD_RESULT (fu_device_new ());
+		fu_device_set_id (res, id);
+		ret = fu_pending_add_device (pending, res, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		g_object_unref (res);
+	}
+	ret = fu_pending_commit (pending, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	devices = fu_pending_get_devices (pending, &error);
+	g_assert_no_error (error);
+	g_assert (devices != NULL);
+	g_assert_cmpint (devices->len, ==, 3);
 }
 
 static void
@@ -829,9 +855,16 @@ fu_keyring_func (void)
 	gboolean ret;
 	g_autoptr(GError) error = NULL;
 	g_autofree gchar *fw_fail = NULL;
+	gsize fw_pass_len = 0;
 	g_autofree gchar *fw_pass = NULL;
+	g_autofree gchar *fw_pass_data = NULL;
 	g_autofree gchar *pki_dir = NULL;
+	g_autofree gchar *sig_armored = NULL;
 	g_autoptr(FuKeyring) keyring = NULL;
+	g_autoptr(GBytes) blob_sig = NULL;
+	g_autoptr(GFile) file_pass = NULL;
+	g_autoptr(GInputStream) stream_pass = NULL;
+	g_autoptr(GOutputStream) stream_copy = NULL;
 	const gchar *sig =
 	"iQEcBAABCAAGBQJVt0B4AAoJEEim2A5FOLrCFb8IAK+QTLY34Wu8xZ8nl6p3JdMu"
 	"HOaifXAmX7291UrsFRwdabU2m65pqxQLwcoFrqGv738KuaKtu4oIwo9LIrmmTbEh"
@@ -854,6 +887,26 @@ fu_keyring_func (void)
 	g_assert_no_error (error);
 	g_assert (ret);
 
+	/* verify while copying */
+	sig_armored = g_strdup_printf ("-----BEGIN PGP SIGNATURE-----\n"
+				       "Version: GnuPG v1\n\n"
+				       "%s\n"
+				       "-----END PGP SIGNATURE-----\n", sig);
+	blob_sig = g_bytes_new_static (sig_armored, strlen (sig_armored));
+	file_pass = g_file_new_for_path (fw_pass);
+	stream_pass = G_INPUT_STREAM (g_file_read (file_pass, NULL, &error));
+	g_assert_no_error (error);
+	g_assert (stream_pass != NULL);
+	stream_copy = g_memory_output_stream_new_resizable ();
+	ret = fu_keyring_verify_stream (keyring, stream_pass, stream_copy, blob_sig,
+					G_MAXUINT32, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_get_contents (fw_pass, &fw_pass_data, &fw_pass_len, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (stream_copy)), ==, fw_pass_len);
+
 	/* verify will fail */
 	fw_fail = fu_test_get_filename ("colorhug/colorhug-als-3.0.2.cab");
 	ret = fu_keyring_verify_file (keyring, fw_fail, sig, &error);
@@ -862,6 +915,186 @@ fu_keyring_func (void)
 	g_clear_error (&error);
 }
 
+static void
+fu_cab_func (void)
+{
+	AsApp *app;
+	AsChecksum *csum;
+	AsRelease *rel;
+	GBytes *blob_tmp;
+	gboolean ret;
+	const gchar *filenames[] = { "firmware.bin", "missing.bin", NULL };
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(GBytes) blob_cab = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) files = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+	g_autofree gchar *fn = NULL;
+
+	fn = fu_test_get_filename ("colorhug/colorhug-als-3.0.2.cab");
+	if (fn == NULL) {
+		g_test_skip ("no colorhug-als-3.0.2.cab, skipping");
+		return;
+	}
+	mapped = g_mapped_file_new (fn, FALSE, &error);
+	g_assert_no_error (error);
+	g_assert (mapped != NULL);
+	blob_cab = g_mapped_file_get_bytes (mapped);
+
+	/* only the metadata */
+	store = as_store_new ();
+	ret = fu_cab_load_metadata (store, blob_cab, G_MAXUINT32, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (as_store_get_size (store), ==, 1);
+	app = as_store_get_app_by_id (store, "com.hughski.ColorHugALS.firmware");
+	g_assert (app != NULL);
+	rel = as_app_get_release_default (app);
+	g_assert (rel != NULL);
+	csum = as_release_get_checksum_by_target (rel, AS_CHECKSUM_TARGET_CONTENT);
+	g_assert (csum != NULL);
+	g_assert_cmpstr (as_checksum_get_filename (csum), ==, "firmware.bin");
+	g_assert (as_release_get_blob (rel, "firmware.bin") == NULL);
+
+	/* just the payload */
+	files = fu_cab_extract_files (blob_cab, filenames, G_MAXUINT32, &error);
+	g_assert_no_error (error);
+	g_assert (files != NULL);
+	g_assert_cmpint (g_hash_table_size (files), ==, 1);
+	blob_tmp = g_hash_table_lookup (files, "firmware.bin");
+	g_assert (blob_tmp != NULL);
+	g_assert_cmpint (g_bytes_get_size (blob_tmp), >, 0);
+}
+
+static void
+fu_store_cache_func (void)
+{
+	AsApp *app;
+	AsChecksum *csum;
+	AsRelease *rel;
+	gboolean ret;
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *fn_cache = NULL;
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(AsStore) store_cache = NULL;
+	g_autoptr(GBytes) blob_cab = NULL;
+	g_autoptr(GBytes) blob_other = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+
+	fn = fu_test_get_filename ("colorhug/colorhug-als-3.0.2.cab");
+	if (fn == NULL) {
+		g_test_skip ("no colorhug-als-3.0.2.cab, skipping");
+		return;
+	}
+	mapped = g_mapped_file_new (fn, FALSE, &error);
+	g_assert_no_error (error);
+	g_assert (mapped != NULL);
+	blob_cab = g_mapped_file_get_bytes (mapped);
+	store = as_store_new ();
+	ret = fu_cab_load_metadata (store, blob_cab, G_MAXUINT32, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* save, using the cab archive as the source */
+	fn_cache = g_build_filename (LOCALSTATEDIR, "cache", "fwupd", "metadata.cache", NULL);
+	ret = fu_store_cache_save (store, blob_cab, fn_cache, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* load into a new store */
+	store_cache = as_store_new ();
+	ret = fu_store_cache_load (store_cache, blob_cab, fn_cache, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (as_store_get_size (store_cache), ==, 1);
+	app = as_store_get_app_by_provide (store_cache,
+					   AS_PROVIDE_KIND_FIRMWARE_FLASHED,
+					   "84f40464-9272-4ef7-9399-cd95f12da696");
+	g_assert (app != NULL);
+	g_assert_cmpstr (as_app_get_id (app), ==, "com.hughski.ColorHugALS.firmware");
+	rel = as_app_get_release_default (app);
+	g_assert (rel != NULL);
+	g_assert_cmpstr (as_release_get_version (rel), ==, "3.0.2");
+	csum = as_release_get_checksum_by_target (rel, AS_CHECKSUM_TARGET_CONTENT);
+	g_assert (csum != NULL);
+	g_assert_cmpstr (as_checksum_get_filename (csum), ==, "firmware.bin");
+
+	/* different source, so the cache is stale */
+	blob_other = g_bytes_new_static ("hello", 5);
+	as_store_remove_all (store_cache);
+	ret = fu_store_cache_load (store_cache, blob_other, fn_cache, &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_INVALID_FILE);
+	g_assert (!ret);
+	g_assert_cmpint (as_store_get_size (store_cache), ==, 0);
+	g_unlink (fn_cache);
+}
+
+static void
+fu_usb_cache_func (void)
+{
+	gboolean ret;
+	const gchar *key = "usb:01:00:03:273f:1004:0002";
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *guid = NULL;
+	g_autofree gchar *product = NULL;
+	g_autofree gchar *version = NULL;
+	g_autofree gchar *data = NULL;
+	g_autoptr(FuUsbCache) cache = NULL;
+	g_autoptr(FuUsbCache) cache2 = NULL;
+	g_autoptr(FuUsbCache) cache3 = NULL;
+	g_autoptr(GError) error = NULL;
+
+	fn = g_build_filename (LOCALSTATEDIR, "cache", "fwupd", "usb.cache", NULL);
+	g_unlink (fn);
+	cache = fu_usb_cache_new ();
+	fu_usb_cache_set_boot_id (cache, "boot1");
+	ret = fu_usb_cache_load (cache, fn, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (!fu_usb_cache_lookup (cache, key, &product, &version, &guid));
+
+	/* no product string is not written as an empty entry */
+	fu_usb_cache_add (cache, key, NULL, "1.2.3", NULL);
+	ret = fu_usb_cache_save (cache, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_get_contents (fn, &data, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (g_strstr_len (data, -1, "Product") == NULL);
+
+	/* hit, after loading from disk */
+	fu_usb_cache_add (cache, key, "ColorHug2", "1.2.3", NULL);
+	ret = fu_usb_cache_save (cache, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	cache2 = fu_usb_cache_new ();
+	fu_usb_cache_set_boot_id (cache2, "boot1");
+	ret = fu_usb_cache_load (cache2, fn, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = fu_usb_cache_lookup (cache2, key, &product, &version, &guid);
+	g_assert (ret);
+	g_assert_cmpstr (product, ==, "ColorHug2");
+	g_assert_cmpstr (version, ==, "1.2.3");
+	g_assert_cmpstr (guid, ==, NULL);
+
+	/* removing the device invalidates the entry */
+	g_assert (fu_usb_cache_remove (cache2, key));
+	g_assert (!fu_usb_cache_remove (cache2, key));
+	g_assert (!fu_usb_cache_lookup (cache2, key, &product, &version, &guid));
+
+	/* as does rebooting */
+	cache3 = fu_usb_cache_new ();
+	fu_usb_cache_set_boot_id (cache3, "boot2");
+	ret = fu_usb_cache_load (cache3, fn, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (!fu_usb_cache_lookup (cache3, key, &product, &version, &guid));
+	g_unlink (fn);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -873,6 +1106,9 @@ main (int argc, char **argv)
 	g_assert_cmpint (g_mkdir_with_parents ("/tmp/fwupd-self-test/var/lib/fwupd", 0755), ==, 0);
 
 	/* tests go here */
+	g_test_add_func ("/fwupd/cab", fu_cab_func);
+	g_test_add_func ("/fwupd/store-cache", fu_store_cache_func);
+	g_test_add_func ("/fwupd/usb-cache", fu_usb_cache_func);
 	g_test_add_func ("/fwupd/rom", fu_rom_func);
 	g_test_add_func ("/fwupd/rom{all}", fu_rom_all_func);
 	g_test_add_func ("/fwupd/pending", fu_pending_func);
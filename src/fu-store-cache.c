@@ -0,0 +1,317 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <fwupd.h>
+#include <appstream-glib.h>
+
+#include "fu-device.h"
+#include "fu-store-cache.h"
+
+/* The cache is a serialized GVariant, so loading it needs no XML parsing
+ * and the strings are read straight from the mapped file. Every entry is
+ * still copied into an AsApp in the store, so this saves startup time but
+ * not memory. Only the fields the daemon needs to match devices and
+ * describe updates are stored, and the header records the SHA256 of the
+ * signed metadata it was generated from. */
+#define FU_STORE_CACHE_VERSION		1
+#define FU_STORE_CACHE_CHECKSUM_TYPE	"(uuss)"
+#define FU_STORE_CACHE_RELEASE_TYPE	"(sssttta" FU_STORE_CACHE_CHECKSUM_TYPE ")"
+#define FU_STORE_CACHE_APP_TYPE		"(sssssssssasa" FU_STORE_CACHE_RELEASE_TYPE ")"
+#define FU_STORE_CACHE_TYPE		"(usa" FU_STORE_CACHE_APP_TYPE ")"
+
+static const gchar *
+fu_store_cache_str (const gchar *str)
+{
+	return str != NULL ? str : "";
+}
+
+static const gchar *
+fu_store_cache_str_or_null (const gchar *str)
+{
+	return str[0] != '\0' ? str : NULL;
+}
+
+static GVariant *
+fu_store_cache_release_to_variant (AsRelease *rel)
+{
+	GPtrArray *checksums = as_release_get_checksums (rel);
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a" FU_STORE_CACHE_CHECKSUM_TYPE));
+	for (guint i = 0; i < checksums->len; i++) {
+		AsChecksum *csum = g_ptr_array_index (checksums, i);
+		g_variant_builder_add (&builder, FU_STORE_CACHE_CHECKSUM_TYPE,
+				       (guint32) as_checksum_get_target (csum),
+				       (guint32) as_checksum_get_kind (csum),
+				       fu_store_cache_str (as_checksum_get_filename (csum)),
+				       fu_store_cache_str (as_checksum_get_value (csum)));
+	}
+	return g_variant_new (FU_STORE_CACHE_RELEASE_TYPE,
+			      fu_store_cache_str (as_release_get_version (rel)),
+			      fu_store_cache_str (as_release_get_description (rel, NULL)),
+			      fu_store_cache_str (as_release_get_location_default (rel)),
+			      as_release_get_timestamp (rel),
+			      as_release_get_size (rel, AS_SIZE_KIND_INSTALLED),
+			      as_release_get_size (rel, AS_SIZE_KIND_DOWNLOAD),
+			      &builder);
+}
+
+static GVariant *
+fu_store_cache_app_to_variant (AsApp *app)
+{
+	AsScreenshot *ss = NULL;
+	GPtrArray *provides = as_app_get_provides (app);
+	GPtrArray *releases = as_app_get_releases (app);
+	GPtrArray *screenshots = as_app_get_screenshots (app);
+	GVariantBuilder builder_guids;
+	GVariantBuilder builder_releases;
+
+	g_variant_builder_init (&builder_guids, G_VARIANT_TYPE_STRING_ARRAY);
+	for (guint i = 0; i < provides->len; i++) {
+		AsProvide *prov = g_ptr_array_index (provides, i);
+		if (as_provide_get_kind (prov) != AS_PROVIDE_KIND_FIRMWARE_FLASHED)
+			continue;
+		if (as_provide_get_value (prov) == NULL)
+			continue;
+		g_variant_builder_add (&builder_guids, "s", as_provide_get_value (prov));
+	}
+	g_variant_builder_init (&builder_releases, G_VARIANT_TYPE ("a" FU_STORE_CACHE_RELEASE_TYPE));
+	for (guint i = 0; i < releases->len; i++) {
+		AsRelease *rel = g_ptr_array_index (releases, i);
+		g_variant_builder_add_value (&builder_releases,
+					     fu_store_cache_release_to_variant (rel));
+	}
+	if (screenshots->len > 0)
+		ss = g_ptr_array_index (screenshots, 0);
+	return g_variant_new (FU_STORE_CACHE_APP_TYPE,
+			      fu_store_cache_str (as_app_get_id (app)),
+			      fu_store_cache_str (as_app_get_name (app, NULL)),
+			      fu_store_cache_str (as_app_get_comment (app, NULL)),
+			      fu_store_cache_str (as_app_get_description (app, NULL)),
+			      fu_store_cache_str (as_app_get_developer_name (app, NULL)),
+			      fu_store_cache_str (as_app_get_project_license (app)),
+			      fu_store_cache_str (as_app_get_url_item (app, AS_URL_KIND_HOMEPAGE)),
+			      fu_store_cache_str (as_app_get_metadata_item (app, FU_DEVICE_KEY_FWUPD_PLUGIN)),
+			      fu_store_cache_str (ss != NULL ? as_screenshot_get_caption (ss, NULL) : NULL),
+			      &builder_guids,
+			      &builder_releases);
+}
+
+/* writes the firmware in @store to @filename, tagged with @blob_source */
+gboolean
+fu_store_cache_save (AsStore *store,
+		     GBytes *blob_source,
+		     const gchar *filename,
+		     GError **error)
+{
+	GPtrArray *apps = as_store_get_apps (store);
+	GVariantBuilder builder;
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *dirname = NULL;
+	g_autoptr(GVariant) val = NULL;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a" FU_STORE_CACHE_APP_TYPE));
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		if (as_app_get_kind (app) != AS_APP_KIND_FIRMWARE)
+			continue;
+		g_variant_builder_add_value (&builder, fu_store_cache_app_to_variant (app));
+	}
+	checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, blob_source);
+	val = g_variant_ref_sink (g_variant_new (FU_STORE_CACHE_TYPE,
+						 (guint32) FU_STORE_CACHE_VERSION,
+						 checksum,
+						 &builder));
+
+	/* create directory */
+	dirname = g_path_get_dirname (filename);
+	if (g_mkdir_with_parents (dirname, 0755) < 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_WRITE,
+			     "Failed to create %s", dirname);
+		return FALSE;
+	}
+	return g_file_set_contents (filename,
+				    g_variant_get_data (val),
+				    (gssize) g_variant_get_size (val),
+				    error);
+}
+
+static AsRelease *
+fu_store_cache_release_from_variant (GVariant *val)
+{
+	AsRelease *rel = as_release_new ();
+	GVariantIter iter;
+	const gchar *version;
+	const gchar *description;
+	const gchar *location;
+	const gchar *filename;
+	const gchar *value;
+	guint32 target;
+	guint32 kind;
+	guint64 timestamp;
+	guint64 size_installed;
+	guint64 size_download;
+	g_autoptr(GVariant) checksums = NULL;
+
+	g_variant_get (val, "(&s&s&sttt@a" FU_STORE_CACHE_CHECKSUM_TYPE ")",
+		       &version, &description, &location,
+		       &timestamp, &size_installed, &size_download,
+		       &checksums);
+	as_release_set_version (rel, fu_store_cache_str_or_null (version));
+	if (description[0] != '\0')
+		as_release_set_description (rel, NULL, description);
+	if (location[0] != '\0')
+		as_release_add_location (rel, location);
+	as_release_set_timestamp (rel, timestamp);
+	as_release_set_size (rel, AS_SIZE_KIND_INSTALLED, size_installed);
+	as_release_set_size (rel, AS_SIZE_KIND_DOWNLOAD, size_download);
+	g_variant_iter_init (&iter, checksums);
+	while (g_variant_iter_next (&iter, "(uu&s&s)", &target, &kind, &filename, &value)) {
+		g_autoptr(AsChecksum) csum = as_checksum_new ();
+		as_checksum_set_target (csum, target);
+		as_checksum_set_kind (csum, kind);
+		as_checksum_set_filename (csum, fu_store_cache_str_or_null (filename));
+		as_checksum_set_value (csum, fu_store_cache_str_or_null (value));
+		as_release_add_checksum (rel, csum);
+	}
+	return rel;
+}
+
+static AsApp *
+fu_store_cache_app_from_variant (GVariant *val)
+{
+	AsApp *app = as_app_new ();
+	GVariantIter iter;
+	const gchar *id;
+	const gchar *name;
+	const gchar *comment;
+	const gchar *description;
+	const gchar *developer_name;
+	const gchar *project_license;
+	const gchar *url_homepage;
+	const gchar *plugin;
+	const gchar *caption;
+	const gchar *guid;
+	GVariant *release_val;
+	g_autoptr(GVariant) guids = NULL;
+	g_autoptr(GVariant) releases = NULL;
+
+	g_variant_get (val, "(&s&s&s&s&s&s&s&s&s@as@a" FU_STORE_CACHE_RELEASE_TYPE ")",
+		       &id, &name, &comment, &description, &developer_name,
+		       &project_license, &url_homepage, &plugin, &caption,
+		       &guids, &releases);
+	as_app_set_kind (app, AS_APP_KIND_FIRMWARE);
+	as_app_set_id (app, id);
+	if (name[0] != '\0')
+		as_app_set_name (app, NULL, name);
+	if (comment[0] != '\0')
+		as_app_set_comment (app, NULL, comment);
+	if (description[0] != '\0')
+		as_app_set_description (app, NULL, description);
+	if (developer_name[0] != '\0')
+		as_app_set_developer_name (app, NULL, developer_name);
+	if (project_license[0] != '\0')
+		as_app_set_project_license (app, project_license);
+	if (url_homepage[0] != '\0')
+		as_app_add_url (app, AS_URL_KIND_HOMEPAGE, url_homepage);
+	if (plugin[0] != '\0')
+		as_app_add_metadata (app, FU_DEVICE_KEY_FWUPD_PLUGIN, plugin);
+	if (caption[0] != '\0') {
+		g_autoptr(AsScreenshot) ss = as_screenshot_new ();
+		as_screenshot_set_kind (ss, AS_SCREENSHOT_KIND_DEFAULT);
+		as_screenshot_set_caption (ss, NULL, caption);
+		as_app_add_screenshot (app, ss);
+	}
+	g_variant_iter_init (&iter, guids);
+	while (g_variant_iter_next (&iter, "&s", &guid)) {
+		g_autoptr(AsProvide) prov = as_provide_new ();
+		as_provide_set_kind (prov, AS_PROVIDE_KIND_FIRMWARE_FLASHED);
+		as_provide_set_value (prov, guid);
+		as_app_add_provide (app, prov);
+	}
+	g_variant_iter_init (&iter, releases);
+	while ((release_val = g_variant_iter_next_value (&iter)) != NULL) {
+		g_autoptr(AsRelease) rel = fu_store_cache_release_from_variant (release_val);
+		as_app_add_release (app, rel);
+		g_variant_unref (release_val);
+	}
+	return app;
+}
+
+/* adds the firmware in @filename to @store, failing if it was not
+ * generated from exactly @blob_source */
+gboolean
+fu_store_cache_load (AsStore *store,
+		     GBytes *blob_source,
+		     const gchar *filename,
+		     GError **error)
+{
+	GVariantIter iter;
+	GVariant *app_val;
+	const gchar *checksum_cache;
+	guint32 version;
+	g_autofree gchar *checksum = NULL;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+	g_autoptr(GVariant) apps = NULL;
+	g_autoptr(GVariant) val = NULL;
+
+	/* validate and read the data in-place */
+	mapped_file = g_mapped_file_new (filename, FALSE, error);
+	if (mapped_file == NULL)
+		return FALSE;
+	blob = g_mapped_file_get_bytes (mapped_file);
+	val = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (FU_STORE_CACHE_TYPE),
+							    blob, FALSE));
+
+	/* check it is current */
+	g_variant_get (val, "(u&s@a" FU_STORE_CACHE_APP_TYPE ")",
+		       &version, &checksum_cache, &apps);
+	if (version != FU_STORE_CACHE_VERSION) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "cache version %u not supported", version);
+		return FALSE;
+	}
+	checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, blob_source);
+	if (g_strcmp0 (checksum, checksum_cache) != 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "cache was generated from %s, not %s",
+			     checksum_cache, checksum);
+		return FALSE;
+	}
+
+	/* add each firmware; the store keeps its own copy of everything */
+	g_variant_iter_init (&iter, apps);
+	while ((app_val = g_variant_iter_next_value (&iter)) != NULL) {
+		g_autoptr(AsApp) app = fu_store_cache_app_from_variant (app_val);
+		as_store_add_app (store, app);
+		g_variant_unref (app_val);
+	}
+	return TRUE;
+}
@@ -0,0 +1,192 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <glib-object.h>
+#include <glib/gstdio.h>
+
+#include "fu-usb-cache.h"
+
+static void fu_usb_cache_finalize			 (GObject *object);
+
+typedef struct {
+	GKeyFile			*kf;
+	gchar				*filename;
+	gchar				*boot_id;
+} FuUsbCachePrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE (FuUsbCache, fu_usb_cache, G_TYPE_OBJECT)
+#define GET_PRIVATE(o) (fu_usb_cache_get_instance_private (o))
+
+/* the firmware version and GUID descriptors can change without the VID,
+ * PID or release changing, so entries are only valid for this boot and
+ * the caller removes them when the device is unplugged */
+void
+fu_usb_cache_set_boot_id (FuUsbCache *cache, const gchar *boot_id)
+{
+	FuUsbCachePrivate *priv = GET_PRIVATE (cache);
+	g_return_if_fail (FU_IS_USB_CACHE (cache));
+	g_free (priv->boot_id);
+	priv->boot_id = g_strdup (boot_id);
+}
+
+gboolean
+fu_usb_cache_load (FuUsbCache *cache, const gchar *filename, GError **error)
+{
+	FuUsbCachePrivate *priv = GET_PRIVATE (cache);
+	g_autoptr(GError) error_local = NULL;
+
+	g_return_val_if_fail (FU_IS_USB_CACHE (cache), FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+
+	g_free (priv->filename);
+	priv->filename = g_strdup (filename);
+	if (!g_key_file_load_from_file (priv->kf, filename,
+					G_KEY_FILE_NONE, &error_local)) {
+		if (g_error_matches (error_local, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			return TRUE;
+		g_propagate_error (error, g_steal_pointer (&error_local));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean
+fu_usb_cache_save (FuUsbCache *cache, GError **error)
+{
+	FuUsbCachePrivate *priv = GET_PRIVATE (cache);
+	g_autofree gchar *dirname = NULL;
+
+	g_return_val_if_fail (FU_IS_USB_CACHE (cache), FALSE);
+	g_return_val_if_fail (priv->filename != NULL, FALSE);
+
+	dirname = g_path_get_dirname (priv->filename);
+	if (g_mkdir_with_parents (dirname, 0755) != 0) {
+		g_set_error (error,
+			     G_FILE_ERROR,
+			     G_FILE_ERROR_FAILED,
+			     "failed to create %s", dirname);
+		return FALSE;
+	}
+	return g_key_file_save_to_file (priv->kf, priv->filename, error);
+}
+
+gboolean
+fu_usb_cache_lookup (FuUsbCache *cache,
+		     const gchar *key,
+		     gchar **product,
+		     gchar **version,
+		     gchar **guid)
+{
+	FuUsbCachePrivate *priv = GET_PRIVATE (cache);
+	g_autofree gchar *boot_id = NULL;
+
+	g_return_val_if_fail (FU_IS_USB_CACHE (cache), FALSE);
+	g_return_val_if_fail (key != NULL, FALSE);
+
+	if (priv->boot_id == NULL)
+		return FALSE;
+	if (!g_key_file_has_group (priv->kf, key))
+		return FALSE;
+
+	/* from an earlier boot, so the firmware may have changed */
+	boot_id = g_key_file_get_string (priv->kf, key, "BootId", NULL);
+	if (g_strcmp0 (boot_id, priv->boot_id) != 0) {
+		g_key_file_remove_group (priv->kf, key, NULL);
+		return FALSE;
+	}
+	*product = g_key_file_get_string (priv->kf, key, "Product", NULL);
+	*version = g_key_file_get_string (priv->kf, key, "Version", NULL);
+	*guid = g_key_file_get_string (priv->kf, key, "Guid", NULL);
+	return TRUE;
+}
+
+void
+fu_usb_cache_add (FuUsbCache *cache,
+		  const gchar *key,
+		  const gchar *product,
+		  const gchar *version,
+		  const gchar *guid)
+{
+	FuUsbCachePrivate *priv = GET_PRIVATE (cache);
+
+	g_return_if_fail (FU_IS_USB_CACHE (cache));
+	g_return_if_fail (key != NULL);
+
+	if (priv->boot_id == NULL)
+		return;
+	g_key_file_remove_group (priv->kf, key, NULL);
+	g_key_file_set_string (priv->kf, key, "BootId", priv->boot_id);
+	if (product != NULL && product[0] != '\0')
+		g_key_file_set_string (priv->kf, key, "Product", product);
+	if (version != NULL)
+		g_key_file_set_string (priv->kf, key, "Version", version);
+	if (guid != NULL)
+		g_key_file_set_string (priv->kf, key, "Guid", guid);
+}
+
+gboolean
+fu_usb_cache_remove (FuUsbCache *cache, const gchar *key)
+{
+	FuUsbCachePrivate *priv = GET_PRIVATE (cache);
+	g_return_val_if_fail (FU_IS_USB_CACHE (cache), FALSE);
+	g_return_val_if_fail (key != NULL, FALSE);
+	return g_key_file_remove_group (priv->kf, key, NULL);
+}
+
+static void
+fu_usb_cache_class_init (FuUsbCacheClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = fu_usb_cache_finalize;
+}
+
+static void
+fu_usb_cache_init (FuUsbCache *cache)
+{
+	FuUsbCachePrivate *priv = GET_PRIVATE (cache);
+	priv->kf = g_key_file_new ();
+	if (g_file_get_contents ("/proc/sys/kernel/random/boot_id",
+				 &priv->boot_id, NULL, NULL))
+		g_strstrip (priv->boot_id);
+}
+
+static void
+fu_usb_cache_finalize (GObject *object)
+{
+	FuUsbCache *cache = FU_USB_CACHE (object);
+	FuUsbCachePrivate *priv = GET_PRIVATE (cache);
+
+	g_key_file_unref (priv->kf);
+	g_free (priv->filename);
+	g_free (priv->boot_id);
+
+	G_OBJECT_CLASS (fu_usb_cache_parent_class)->finalize (object);
+}
+
+FuUsbCache *
+fu_usb_cache_new (void)
+{
+	FuUsbCache *cache;
+	cache = g_object_new (FU_TYPE_USB_CACHE, NULL);
+	return FU_USB_CACHE (cache);
+}
@@ -0,0 +1,62 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __FU_USB_CACHE_H
+#define __FU_USB_CACHE_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define FU_TYPE_USB_CACHE (fu_usb_cache_get_type ())
+G_DECLARE_DERIVABLE_TYPE (FuUsbCache, fu_usb_cache, FU, USB_CACHE, GObject)
+
+struct _FuUsbCacheClass
+{
+	GObjectClass		 parent_class;
+};
+
+FuUsbCache	*fu_usb_cache_new			(void);
+
+void		 fu_usb_cache_set_boot_id		(FuUsbCache	*cache,
+							 const gchar	*boot_id);
+gboolean	 fu_usb_cache_load			(FuUsbCache	*cache,
+							 const gchar	*filename,
+							 GError		**error);
+gboolean	 fu_usb_cache_save			(FuUsbCache	*cache,
+							 GError		**error);
+gboolean	 fu_usb_cache_lookup			(FuUsbCache	*cache,
+							 const gchar	*key,
+							 gchar		**product,
+							 gchar		**version,
+							 gchar		**guid);
+void		 fu_usb_cache_add			(FuUsbCache	*cache,
+							 const gchar	*key,
+							 const gchar	*product,
+							 const gchar	*version,
+							 const gchar	*guid);
+gboolean	 fu_usb_cache_remove			(FuUsbCache	*cache,
+							 const gchar	*key);
+
+G_END_DECLS
+
+#endif /* __FU_USB_CACHE_H */
+
@@ -54,6 +54,7 @@ typedef struct {
 	GPtrArray		*cmd_array;
 	FwupdInstallFlags	 flags;
 	FwupdClient		*client;
+	guint			 jobs;
 } FuUtilPrivate;
 
 typedef gboolean (*FuUtilPrivateCb)	(FuUtilPrivate	*util,
@@ -554,6 +555,7 @@ fu_util_verify_update_internal (FuUtilPrivate *priv,
 {
 	g_autoptr(AsStore) store = NULL;
 	g_autoptr(GFile) xml_file = NULL;
+	g_autoptr(GPtrArray) items = NULL;
 
 	store = as_store_new ();
 
@@ -564,24 +566,24 @@ fu_util_verify_update_internal (FuUtilPrivate *priv,
 			return FALSE;
 	}
 
-	/* add new values */
+	/* load all the ROMs at once as each sysfs read is slow */
 	as_store_set_api_version (store, 0.9);
-	for (guint i = 0; values[i] != NULL; i++) {
+	items = fu_rom_load_files (values, FU_ROM_LOAD_FLAG_BLANK_PPID,
+				   priv->jobs, priv->cancellable);
+
+	/* add new values in the order they were specified */
+	for (guint i = 0; i < items->len; i++) {
+		FuRomLoadItem *item = g_ptr_array_index (items, i);
+		FuRom *rom = item->rom;
 		g_autofree gchar *id = NULL;
 		g_autoptr(AsApp) app = NULL;
 		g_autoptr(AsChecksum) csum = NULL;
 		g_autoptr(AsRelease) rel = NULL;
 		g_autoptr(AsProvide) prov = NULL;
-		g_autoptr(FuRom) rom = NULL;
-		g_autoptr(GFile) file = NULL;
-		g_autoptr(GError) error_local = NULL;
 
-		file = g_file_new_for_path (values[i]);
-		rom = fu_rom_new ();
-		g_print ("Processing %s...\n", values[i]);
-		if (!fu_rom_load_file (rom, file, FU_ROM_LOAD_FLAG_BLANK_PPID,
-				       NULL, &error_local)) {
-			g_print ("%s\n", error_local->message);
+		g_print ("Processing %s...\n", item->filename);
+		if (rom == NULL) {
+			g_print ("%s\n", item->error->message);
 			continue;
 		}
 
@@ -1133,6 +1135,7 @@ main (int argc, char *argv[])
 	gboolean offline = FALSE;
 	gboolean ret;
 	gboolean verbose = FALSE;
+	gint jobs = 0;
 	gint rc = 1;
 	g_autoptr(GError) error = NULL;
 	g_autofree gchar *cmd_descriptions = NULL;
@@ -1152,6 +1155,9 @@ main (int argc, char *argv[])
 		{ "force", '\0', 0, G_OPTION_ARG_NONE, &force,
 			/* TRANSLATORS: command line option */
 			_("Override provider warning"), NULL },
+		{ "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs,
+			/* TRANSLATORS: command line option */
+			_("Number of ROMs to read at the same time"), NULL },
 		{ NULL}
 	};
 
@@ -1296,6 +1302,8 @@ main (int argc, char *argv[])
 		priv->flags |= FWUPD_INSTALL_FLAG_ALLOW_REINSTALL;
 	if (allow_older)
 		priv->flags |= FWUPD_INSTALL_FLAG_ALLOW_OLDER;
+	if (jobs > 0)
+		priv->jobs = (guint) jobs;
 	if (force)
 		priv->flags |= FWUPD_INSTALL_FLAG_FORCE;
 